@@ -0,0 +1,106 @@
+#include "burst-meter.h"
+#include "pch.h"
+
+#include <mutex>
+#include <array>
+#include <algorithm>
+#include <util/platform.h>
+
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(31, 0, 0)
+#define HAVE_PACKET_CALLBACK 1
+#else
+#define HAVE_PACKET_CALLBACK 0
+#endif
+
+static const int64_t kBucketUsec = 100000;
+static const size_t kBucketCount = 100;
+
+class BurstMeterImpl : public BurstMeter {
+    struct Bucket {
+        int64_t index = -1;
+        uint64_t bytes = 0;
+    };
+
+    std::mutex mutex_;
+    std::array<Bucket, kBucketCount> buckets_;
+    int64_t first_ = -1;
+    int64_t latest_ = -1;
+
+#if HAVE_PACKET_CALLBACK
+    static void OnPacket(obs_output_t*, encoder_packet* packet, encoder_packet_time*, void*)
+    {
+        GetBurstMeter()->Record(packet->sys_dts_usec, packet->size);
+    }
+#endif
+
+public:
+    void Attach(obs_output_t* output) override
+    {
+#if HAVE_PACKET_CALLBACK
+        obs_output_add_packet_callback(output, &BurstMeterImpl::OnPacket, nullptr);
+#else
+        (void)output;
+#endif
+    }
+
+    void Detach(obs_output_t* output) override
+    {
+#if HAVE_PACKET_CALLBACK
+        obs_output_remove_packet_callback(output, &BurstMeterImpl::OnPacket, nullptr);
+#else
+        (void)output;
+#endif
+    }
+
+    void Record(int64_t sysTimeUsec, uint64_t bytes) override
+    {
+        auto index = sysTimeUsec / kBucketUsec;
+        std::unique_lock lock(mutex_);
+        // packets of a frame arrive late at most by the encoder delay, far less than the window
+        if (index <= latest_ - static_cast<int64_t>(kBucketCount))
+            return;
+        // idle for a whole window: measure from scratch
+        if (latest_ < 0 || index - latest_ >= static_cast<int64_t>(kBucketCount))
+            first_ = index;
+
+        auto& bucket = buckets_[static_cast<size_t>(index) % kBucketCount];
+        if (bucket.index != index) {
+            bucket.index = index;
+            bucket.bytes = 0;
+        }
+        bucket.bytes += bytes;
+        if (index > latest_)
+            latest_ = index;
+    }
+
+    bool GetStats(double& peakBps, double& meanBps) override
+    {
+        std::unique_lock lock(mutex_);
+        auto now = static_cast<int64_t>(os_gettime_ns() / 1000) / kBucketUsec;
+        peakBps = 0;
+        meanBps = 0;
+        auto span = std::min<int64_t>(latest_ - first_, kBucketCount - 1);
+        if (latest_ < 0 || now - latest_ > 10 || span <= 0)
+            return false;
+
+        // the newest bucket is still filling
+        uint64_t total = 0, peak = 0;
+        for (auto& bucket : buckets_) {
+            if (bucket.index < 0 || bucket.index >= latest_ || bucket.index <= latest_ - static_cast<int64_t>(kBucketCount))
+                continue;
+            total += bucket.bytes;
+            peak = std::max(peak, bucket.bytes);
+        }
+
+        const double bucketsPerSec = 1000000.0 / kBucketUsec;
+        peakBps = peak * 8 * bucketsPerSec;
+        meanBps = total * 8 * bucketsPerSec / span;
+        return total > 0;
+    }
+};
+
+BurstMeter* GetBurstMeter()
+{
+    static BurstMeterImpl impl_;
+    return &impl_;
+}
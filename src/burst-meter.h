@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+typedef struct obs_output obs_output_t;
+
+// Aggregate egress of all attached outputs, counted per encoded packet in
+// 100 ms buckets of frame time. The peak bucket against the mean over the last
+// ten seconds shows how bursty the uplink is, e.g. when keyframes line up.
+class BurstMeter {
+public:
+    virtual ~BurstMeter() {}
+    virtual void Attach(obs_output_t* output) = 0;
+    virtual void Detach(obs_output_t* output) = 0;
+    virtual void Record(int64_t sysTimeUsec, uint64_t bytes) = 0;
+    // False when nothing was recorded recently.
+    virtual bool GetStats(double& peakBps, double& meanBps) = 0;
+};
+
+BurstMeter* GetBurstMeter();
@@ -0,0 +1,125 @@
+#include "category-cache.h"
+#include "streamlabs-api.h"
+#include "json-util.hpp"
+#include "pch.h"
+
+#include <mutex>
+#include <ctime>
+#include <cctype>
+#include <unordered_map>
+#include <util/platform.h>
+
+static const int64_t kCategoryTtlSec = 7 * 24 * 3600;
+
+class CategoryCacheImpl : public CategoryCache {
+    struct Entry {
+        std::string gameMaskId;
+        int64_t time = 0;
+    };
+
+    std::mutex mutex_;
+    std::string filename_;
+    std::unordered_map<std::string, Entry> entries_;
+
+    static std::string Normalize(const std::string& category)
+    {
+        std::string key = category;
+        for (auto& c : key)
+            c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+        return key;
+    }
+
+    static int64_t Now()
+    {
+        return static_cast<int64_t>(time(nullptr));
+    }
+
+    // caller holds mutex_
+    void Save()
+    {
+        if (filename_.empty())
+            return;
+
+        nlohmann::json json(nlohmann::json::value_t::object);
+        for (auto& [category, entry] : entries_) {
+            json[category] = { { "id", entry.gameMaskId }, { "time", entry.time } };
+        }
+        auto content = json.dump();
+        os_quick_write_utf8_file_safe(filename_.c_str(), content.c_str(), content.size(), false, "tmp", nullptr);
+    }
+
+public:
+    void Load() override
+    {
+        std::unique_lock lock(mutex_);
+        entries_.clear();
+        filename_.clear();
+
+        auto profiledir = obs_frontend_get_current_profile_path();
+        if (!profiledir)
+            return;
+        filename_ = profiledir;
+        filename_ += "/obs-multi-rtmp-categories.json";
+        bfree(profiledir);
+
+        auto content = os_quick_read_utf8_file(filename_.c_str());
+        if (!content)
+            return;
+
+        try {
+            auto json = nlohmann::json::parse(content);
+            auto now = Now();
+            for (auto& [category, item] : json.items()) {
+                if (!item.is_object())
+                    continue;
+                Entry entry;
+                entry.gameMaskId = GetJsonField<std::string>(item, "id").value_or("");
+                auto time = item.find("time");
+                if (time != item.end() && time->is_number_integer())
+                    entry.time = time->get<int64_t>();
+                if (entry.gameMaskId.empty() || now - entry.time > kCategoryTtlSec)
+                    continue;
+                entries_.emplace(category, std::move(entry));
+            }
+        }
+        catch(const std::exception& e) {
+            blog(LOG_WARNING, TAG "Fail to parse category cache: %s", e.what());
+        }
+        bfree(content);
+    }
+
+    std::optional<std::string> Lookup(const std::string& category) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = entries_.find(Normalize(category));
+        if (it == entries_.end() || Now() - it->second.time > kCategoryTtlSec)
+            return std::nullopt;
+        return it->second.gameMaskId;
+    }
+
+    void Store(const std::string& category, const std::string& gameMaskId) override
+    {
+        if (category.empty() || gameMaskId.empty())
+            return;
+
+        std::unique_lock lock(mutex_);
+        entries_[Normalize(category)] = Entry{ gameMaskId, Now() };
+        Save();
+    }
+
+    void Prewarm(const std::string& token, const std::string& category) override
+    {
+        if (token.empty() || category.empty() || Lookup(category).has_value())
+            return;
+
+        StreamlabsAPI::CategorySearch(token, category, [this, category](std::string gameMaskId) {
+            Store(category, gameMaskId);
+        });
+    }
+};
+
+CategoryCache* GetCategoryCache()
+{
+    static CategoryCacheImpl impl_;
+    return &impl_;
+}
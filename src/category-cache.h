@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <optional>
+
+// Maps Streamlabs category text to its game_mask_id. Persisted next to the
+// profile config so that starting a target normally needs no category lookup.
+class CategoryCache {
+public:
+    virtual ~CategoryCache() {}
+    // Reads the cache of the current profile. Call from the UI thread.
+    virtual void Load() = 0;
+    // Returns the cached id if it is present and not expired.
+    virtual std::optional<std::string> Lookup(const std::string& category) = 0;
+    virtual void Store(const std::string& category, const std::string& gameMaskId) = 0;
+    // Resolves the category in the background unless a fresh entry exists.
+    virtual void Prewarm(const std::string& token, const std::string& category) = 0;
+};
+
+CategoryCache* GetCategoryCache();
@@ -0,0 +1,184 @@
+#include "control-api.h"
+#include "pch.h"
+#include "stats-registry.h"
+
+#include <set>
+#include <atomic>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace {
+
+struct Selection {
+    std::vector<std::string> ids;
+    std::vector<std::string> unknown;
+};
+
+bool ReadStrings(const json& request, const char* key, std::set<std::string>& out, std::string& error)
+{
+    auto it = request.find(key);
+    if (it == request.end() || it->is_null())
+        return true;
+    if (!it->is_array()) {
+        error = std::string(key) + " is not an array";
+        return false;
+    }
+    for (auto& item : *it) {
+        if (!item.is_string()) {
+            error = std::string(key) + " must contain strings";
+            return false;
+        }
+        out.insert(item.get<std::string>());
+    }
+    return true;
+}
+
+bool Select(const json& request, const std::vector<TargetHealth>& targets, Selection& selection, std::string& error)
+{
+    std::set<std::string> ids, tags;
+    if (!ReadStrings(request, "ids", ids, error) || !ReadStrings(request, "tags", tags, error))
+        return false;
+
+    std::set<std::string> found;
+    for (auto& target : targets) {
+        bool match = ids.empty() && tags.empty();
+        match = match || ids.count(target.id) > 0;
+        match = match || std::any_of(target.tags.begin(), target.tags.end(), [&](auto& tag) { return tags.count(tag) > 0; });
+        if (match)
+            selection.ids.push_back(target.id);
+        found.insert(target.id);
+    }
+    for (auto& id : ids) {
+        if (!found.count(id))
+            selection.unknown.push_back(id);
+    }
+    return true;
+}
+
+json HealthToJson(const TargetHealth& target)
+{
+    return {
+        { "id", target.id },
+        { "name", target.name },
+        { "tags", target.tags },
+        { "running", target.running },
+        { "reconnecting", target.reconnecting },
+        { "bytes", target.totalBytes },
+        { "frames", target.totalFrames },
+        { "dropped-frames", target.droppedFrames },
+        { "congestion", target.congestion },
+        { "reconnects", target.reconnects },
+        { "last-reconnect-ms", target.lastReconnectMs },
+        { "max-reconnect-ms", target.maxReconnectMs },
+        { "downtime-ms", target.downtimeMs },
+        { "live-ms", target.liveMs },
+        { "send-queue-peak", target.queueHighWater },
+        { "video-encoder-shared", target.videoEncoderShared },
+        { "audio-encoder-shared", target.audioEncoderShared },
+    };
+}
+
+}
+
+class ControlApiImpl : public ControlApi {
+    // only read and written on the UI thread
+    ControlHost* host_ = nullptr;
+    std::atomic<bool> registered_ = false;
+
+    enum class Action { Start, Stop, Stats, Patch };
+
+    static void Reply(calldata_t* cd, const json& response)
+    {
+        calldata_set_string(cd, "response", response.dump().c_str());
+    }
+
+    void Handle(Action action, calldata_t* cd)
+    {
+        json request;
+        auto text = calldata_string(cd, "request");
+        if (text && *text) {
+            request = json::parse(text, nullptr, false);
+            if (request.is_discarded() || !request.is_object()) {
+                Reply(cd, { { "error", "request is not a JSON object" } });
+                return;
+            }
+        }
+
+        auto targets = GetStatsRegistry()->Snapshot();
+        Selection selection;
+        std::string error;
+        if (!Select(request, targets, selection, error)) {
+            Reply(cd, { { "error", error } });
+            return;
+        }
+
+        if (action == Action::Stats) {
+            std::set<std::string> selected(selection.ids.begin(), selection.ids.end());
+            json list = json::array();
+            for (auto& target : targets) {
+                if (selected.count(target.id))
+                    list.push_back(HealthToJson(target));
+            }
+            Reply(cd, { { "targets", std::move(list) }, { "unknown", selection.unknown } });
+            return;
+        }
+
+        json patch;
+        if (action == Action::Patch) {
+            auto it = request.find("patch");
+            if (it == request.end() || !it->is_object() || it->contains("id")) {
+                Reply(cd, { { "error", "patch must be an object without id" } });
+                return;
+            }
+            patch = *it;
+        }
+
+        auto queued = GetGlobalService().RunInUIThread([this, action, ids = selection.ids, patch = std::move(patch)]() {
+            if (!host_) {
+                blog(LOG_WARNING, TAG "Control request dropped, the dock is gone");
+                return;
+            }
+            if (action == Action::Start)
+                host_->StartTargets(ids);
+            else if (action == Action::Stop)
+                host_->StopTargets(ids);
+            else
+                host_->PatchTargets(ids, patch);
+        });
+        if (!queued) {
+            Reply(cd, { { "error", "UI is not ready" } });
+            return;
+        }
+        Reply(cd, { { "accepted", selection.ids }, { "unknown", selection.unknown } });
+    }
+
+    template<Action action>
+    static void Proc(void* data, calldata_t* cd)
+    {
+        static_cast<ControlApiImpl*>(data)->Handle(action, cd);
+    }
+
+public:
+    void Register() override
+    {
+        if (registered_.exchange(true))
+            return;
+        auto handler = obs_get_proc_handler();
+        proc_handler_add(handler, "void multi_rtmp_start(in string request, out string response)", &Proc<Action::Start>, this);
+        proc_handler_add(handler, "void multi_rtmp_stop(in string request, out string response)", &Proc<Action::Stop>, this);
+        proc_handler_add(handler, "void multi_rtmp_stats(in string request, out string response)", &Proc<Action::Stats>, this);
+        proc_handler_add(handler, "void multi_rtmp_patch(in string request, out string response)", &Proc<Action::Patch>, this);
+    }
+
+    void SetHost(ControlHost* host) override
+    {
+        host_ = host;
+    }
+};
+
+ControlApi* GetControlApi()
+{
+    static ControlApiImpl impl_;
+    return &impl_;
+}
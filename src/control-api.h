@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+
+// Receives batches from the control API. Called on the UI thread, once per request.
+class ControlHost {
+public:
+    virtual ~ControlHost() {}
+    virtual void StartTargets(const std::vector<std::string>& ids) = 0;
+    virtual void StopTargets(const std::vector<std::string>& ids) = 0;
+    virtual void PatchTargets(const std::vector<std::string>& ids, const nlohmann::json& patch) = 0;
+};
+
+// Procedures on the global libobs proc handler, reachable from scripts and
+// other plugins through proc_handler_call. Each takes a JSON "request" string and returns a JSON "response" string:
+//
+//   multi_rtmp_start / multi_rtmp_stop   {"ids": [...], "tags": [...]}
+//   multi_rtmp_stats                     {"ids": [...], "tags": [...]}
+//   multi_rtmp_patch                     {"ids": [...], "tags": [...], "patch": {...}}
+//
+// Targets are selected from the stats registry without touching widgets; an
+// empty selection means all targets. Start, stop and patch hand the whole
+// batch to the UI thread in one task and return without waiting for it.
+class ControlApi {
+public:
+    virtual ~ControlApi() {}
+    virtual void Register() = 0;
+    // nullptr detaches the dock; later requests then fail.
+    virtual void SetHost(ControlHost* host) = 0;
+};
+
+ControlApi* GetControlApi();
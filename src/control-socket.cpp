@@ -0,0 +1,550 @@
+#include "control-socket.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "pch.h"
+#include "stats-registry.h"
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+// events are rare next to stats, so this is only hit by a stuck client
+static const size_t kMaxQueuedEvents = 256;
+static const size_t kMaxInboundFrame = 64 * 1024;
+static const size_t kMaxClients = 16;
+static const int kPollIntervalMs = 50;
+
+enum FrameType : uint8_t {
+    FrameSubscribe = 0x01,
+    FrameStats = 0x10,
+    FrameEvent = 0x11,
+    FrameEventsLost = 0x12,
+};
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void SetNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(socket, FIONBIO, &mode);
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static bool WouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// On POSIX the socket lives in a directory only this user can enter, so its
+// permissions never matter, not even between bind and chmod.
+static std::string DefaultSocketPath()
+{
+#ifdef _WIN32
+    auto temp = getenv("TEMP");
+    return std::string(temp ? temp : ".") + "\\obs-multi-rtmp.sock";
+#else
+    auto runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+        return std::string(runtime) + "/obs-multi-rtmp.sock";
+    return "/tmp/obs-multi-rtmp-" + std::to_string(getuid()) + "/control.sock";
+#endif
+}
+
+#ifndef _WIN32
+static bool PreparePrivateDirectory(const std::string& path)
+{
+    auto dir = path.substr(0, path.rfind('/'));
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+        return false;
+    // refuse a directory somebody else created or opened up
+    struct stat info;
+    return lstat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && info.st_uid == getuid() && (info.st_mode & 077) == 0;
+}
+#endif
+
+// Another instance still accepts connections on the socket.
+static bool IsListening(const sockaddr_un& addr)
+{
+    auto probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe == kInvalidSocket)
+        return false;
+    bool live = ::connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    CloseSocket(probe);
+    return live;
+}
+
+namespace {
+
+class FrameWriter {
+    std::string data_;
+
+public:
+    explicit FrameWriter(FrameType type)
+    {
+        data_.assign(4, '\0');
+        data_.push_back(static_cast<char>(type));
+    }
+
+    void Byte(uint8_t value) { data_.push_back(static_cast<char>(value)); }
+
+    void Varint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            data_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        data_.push_back(static_cast<char>(value));
+    }
+
+    void Signed(int64_t value) { Varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)); }
+
+    void String(const std::string& value)
+    {
+        Varint(value.size());
+        data_ += value;
+    }
+
+    std::string Finish()
+    {
+        auto size = static_cast<uint32_t>(data_.size() - 4);
+        for (int i = 0; i < 4; ++i)
+            data_[i] = static_cast<char>((size >> (8 * i)) & 0xff);
+        return std::move(data_);
+    }
+};
+
+uint64_t StateOf(const TargetHealth& health)
+{
+    return health.reconnecting ? 2 : health.running ? 1 : 0;
+}
+
+uint64_t CongestionOf(const TargetHealth& health)
+{
+    return static_cast<uint64_t>(std::clamp(health.congestion, 0.0f, 1.0f) * 1000000);
+}
+
+uint64_t SharedOf(const TargetHealth& health)
+{
+    return (health.videoEncoderShared ? 1 : 0) | (health.audioEncoderShared ? 2 : 0);
+}
+
+uint32_t ChangedFields(const TargetHealth* before, const TargetHealth& after)
+{
+    if (!before)
+        return 0x3ff;
+    uint32_t mask = 0;
+    if (before->name != after.name) mask |= ControlFieldName;
+    if (StateOf(*before) != StateOf(after)) mask |= ControlFieldState;
+    if (before->totalBytes != after.totalBytes) mask |= ControlFieldBytes;
+    if (before->totalFrames != after.totalFrames) mask |= ControlFieldFrames;
+    if (before->droppedFrames != after.droppedFrames) mask |= ControlFieldDroppedFrames;
+    if (before->reconnects != after.reconnects) mask |= ControlFieldReconnects;
+    if (CongestionOf(*before) != CongestionOf(after)) mask |= ControlFieldCongestion;
+    if (before->downtimeMs != after.downtimeMs) mask |= ControlFieldDowntimeMs;
+    if (before->queueHighWater != after.queueHighWater) mask |= ControlFieldSendQueuePeak;
+    if (SharedOf(*before) != SharedOf(after)) mask |= ControlFieldEncoderShared;
+    return mask;
+}
+
+void WriteFields(FrameWriter& frame, uint32_t mask, const TargetHealth& health)
+{
+    if (mask & ControlFieldName) frame.String(health.name);
+    if (mask & ControlFieldState) frame.Varint(StateOf(health));
+    if (mask & ControlFieldBytes) frame.Varint(health.totalBytes);
+    if (mask & ControlFieldFrames) frame.Varint(health.totalFrames);
+    if (mask & ControlFieldDroppedFrames) frame.Varint(static_cast<uint64_t>(std::max(health.droppedFrames, 0)));
+    if (mask & ControlFieldReconnects) frame.Varint(static_cast<uint64_t>(std::max(health.reconnects, 0)));
+    if (mask & ControlFieldCongestion) frame.Varint(CongestionOf(health));
+    if (mask & ControlFieldDowntimeMs) frame.Varint(static_cast<uint64_t>(std::max<int64_t>(health.downtimeMs, 0)));
+    if (mask & ControlFieldSendQueuePeak) frame.Varint(health.queueHighWater);
+    if (mask & ControlFieldEncoderShared) frame.Varint(SharedOf(health));
+}
+
+struct Client {
+    SocketHandle socket = kInvalidSocket;
+    std::string inbound;
+    std::string pending;
+    size_t pendingOffset = 0;
+    std::deque<std::string> events;
+    uint64_t lostEvents = 0;
+    bool subscribed = false;
+    uint64_t statsVersion = UINT64_MAX;
+    // what this client last received
+    std::map<std::string, TargetHealth> sent;
+};
+
+}
+
+class ControlSocketImpl : public ControlSocket {
+    std::mutex mutex_;
+    std::thread worker_;
+    std::atomic<bool> running_ = false;
+    std::atomic<bool> stop_ = false;
+    std::string path_;
+
+    std::mutex eventMutex_;
+    std::vector<std::string> newEvents_;
+
+    SocketHandle Listen()
+    {
+#ifdef _WIN32
+        static std::once_flag once;
+        std::call_once(once, []() {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        });
+#endif
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path_.size() >= sizeof(addr.sun_path))
+            return kInvalidSocket;
+        memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+
+#ifndef _WIN32
+        if (!PreparePrivateDirectory(path_)) {
+            blog(LOG_WARNING, TAG "Control socket directory for %s is missing or not private", path_.c_str());
+            return kInvalidSocket;
+        }
+#endif
+        if (IsListening(addr)) {
+            blog(LOG_WARNING, TAG "Control socket %s is in use by another instance", path_.c_str());
+            return kInvalidSocket;
+        }
+
+        auto s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == kInvalidSocket)
+            return kInvalidSocket;
+
+        // nobody answered, so this is a socket file left by a crashed run
+#ifdef _WIN32
+        DeleteFileA(path_.c_str());
+#else
+        unlink(path_.c_str());
+#endif
+        if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(s, 8) != 0) {
+            CloseSocket(s);
+            return kInvalidSocket;
+        }
+        SetNonBlocking(s);
+        return s;
+    }
+
+    // Consumes complete frames; false when the client sent garbage.
+    static bool HandleInbound(Client& client)
+    {
+        size_t offset = 0;
+        while (client.inbound.size() - offset >= 4) {
+            auto p = reinterpret_cast<const uint8_t*>(client.inbound.data() + offset);
+            uint32_t size = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+            if (size == 0 || size > kMaxInboundFrame)
+                return false;
+            if (client.inbound.size() - offset - 4 < size)
+                break;
+            if (p[4] == FrameSubscribe && !client.subscribed) {
+                client.subscribed = true;
+                client.sent.clear();
+                client.statsVersion = UINT64_MAX;
+            }
+            offset += 4 + size;
+        }
+        client.inbound.erase(0, offset);
+        return true;
+    }
+
+    static std::string BuildStats(Client& client, const std::vector<TargetHealth>& targets)
+    {
+        FrameWriter frame(FrameStats);
+        std::vector<std::pair<const TargetHealth*, uint32_t>> changes;
+        std::map<std::string, TargetHealth> current;
+        for (auto& target : targets) {
+            auto it = client.sent.find(target.id);
+            auto mask = ChangedFields(it == client.sent.end() ? nullptr : &it->second, target);
+            if (mask)
+                changes.emplace_back(&target, mask);
+            current.emplace(target.id, target);
+        }
+        std::vector<std::string> removed;
+        for (auto& [id, health] : client.sent) {
+            if (!current.count(id))
+                removed.push_back(id);
+        }
+        if (changes.empty() && removed.empty())
+            return {};
+
+        frame.Varint(changes.size() + removed.size());
+        for (auto& [target, mask] : changes) {
+            frame.String(target->id);
+            frame.Varint(mask);
+            WriteFields(frame, mask, *target);
+        }
+        for (auto& id : removed) {
+            frame.String(id);
+            frame.Varint(ControlFieldRemoved);
+        }
+        client.sent = std::move(current);
+        return frame.Finish();
+    }
+
+    // Moves the next frame into pending, stats only when nothing older is waiting.
+    static void Refill(Client& client, uint64_t version, const std::vector<TargetHealth>* targets)
+    {
+        if (!client.pending.empty())
+            return;
+        if (client.lostEvents > 0) {
+            FrameWriter frame(FrameEventsLost);
+            frame.Varint(client.lostEvents);
+            client.pending = frame.Finish();
+            client.lostEvents = 0;
+        } else if (!client.events.empty()) {
+            client.pending = std::move(client.events.front());
+            client.events.pop_front();
+        } else if (client.subscribed && targets && client.statsVersion != version) {
+            client.pending = BuildStats(client, *targets);
+            client.statsVersion = version;
+        }
+        client.pendingOffset = 0;
+    }
+
+    // False when the connection is gone.
+    static bool Flush(Client& client)
+    {
+#if defined(MSG_NOSIGNAL)
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while (client.pendingOffset < client.pending.size()) {
+            auto sent = ::send(client.socket, client.pending.data() + client.pendingOffset,
+                static_cast<int>(client.pending.size() - client.pendingOffset), flags);
+            if (sent < 0 && WouldBlock())
+                return true;
+            if (sent <= 0)
+                return false;
+            client.pendingOffset += static_cast<size_t>(sent);
+        }
+        client.pending.clear();
+        client.pendingOffset = 0;
+        return true;
+    }
+
+    void Run(SocketHandle listener)
+    {
+        std::vector<std::unique_ptr<Client>> clients;
+        std::vector<TargetHealth> targets;
+        uint64_t targetsVersion = UINT64_MAX;
+
+        while (!stop_) {
+            std::vector<std::string> events;
+            {
+                std::unique_lock lock(eventMutex_);
+                events.swap(newEvents_);
+            }
+            for (auto& client : clients) {
+                if (!client->subscribed)
+                    continue;
+                for (auto& event : events) {
+                    if (client->events.size() >= kMaxQueuedEvents) {
+                        client->events.pop_front();
+                        ++client->lostEvents;
+                    }
+                    client->events.push_back(event);
+                }
+            }
+
+            auto version = GetStatsRegistry()->Version();
+            bool wantStats = std::any_of(clients.begin(), clients.end(), [&](auto& c) {
+                return c->subscribed && c->pending.empty() && c->events.empty() && c->statsVersion != version;
+            });
+            if (wantStats && targetsVersion != version) {
+                targets = GetStatsRegistry()->Snapshot();
+                targetsVersion = version;
+            }
+
+            std::vector<pollfd> fds;
+            fds.push_back({ listener, POLLIN, 0 });
+            for (auto& client : clients) {
+                Refill(*client, targetsVersion, wantStats ? &targets : nullptr);
+                short interest = POLLIN;
+                if (!client->pending.empty())
+                    interest |= POLLOUT;
+                fds.push_back({ client->socket, interest, 0 });
+            }
+
+#ifdef _WIN32
+            int ret = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), kPollIntervalMs);
+#else
+            int ret = poll(fds.data(), fds.size(), kPollIntervalMs);
+            if (ret < 0 && errno == EINTR)
+                ret = 0;
+#endif
+            if (ret < 0)
+                break;
+
+            std::vector<bool> closed(clients.size(), false);
+            for (size_t i = 0; i < clients.size(); ++i) {
+                auto& client = *clients[i];
+                auto revents = fds[i + 1].revents;
+                if (revents & (POLLERR | POLLNVAL)) {
+                    closed[i] = true;
+                    continue;
+                }
+                if (revents & (POLLIN | POLLHUP)) {
+                    char buffer[4096];
+                    auto received = ::recv(client.socket, buffer, sizeof(buffer), 0);
+                    if (received > 0) {
+                        client.inbound.append(buffer, static_cast<size_t>(received));
+                        closed[i] = !HandleInbound(client);
+                    } else if (received == 0 || !WouldBlock()) {
+                        closed[i] = true;
+                    }
+                }
+                if (!closed[i] && (revents & POLLOUT))
+                    closed[i] = !Flush(client);
+            }
+            for (size_t i = clients.size(); i-- > 0;) {
+                if (closed[i]) {
+                    CloseSocket(clients[i]->socket);
+                    clients.erase(clients.begin() + static_cast<ptrdiff_t>(i));
+                }
+            }
+
+            if (fds[0].revents & POLLIN) {
+                auto socket = ::accept(listener, nullptr, nullptr);
+                if (socket != kInvalidSocket) {
+                    if (clients.size() >= kMaxClients) {
+                        CloseSocket(socket);
+                    } else {
+                        SetNonBlocking(socket);
+                        auto client = std::make_unique<Client>();
+                        client->socket = socket;
+                        clients.push_back(std::move(client));
+                    }
+                }
+            }
+        }
+
+        for (auto& client : clients)
+            CloseSocket(client->socket);
+        CloseSocket(listener);
+#ifdef _WIN32
+        DeleteFileA(path_.c_str());
+#else
+        unlink(path_.c_str());
+#endif
+    }
+
+public:
+    ~ControlSocketImpl()
+    {
+        Stop();
+    }
+
+    bool Start() override
+    {
+        std::unique_lock lock(mutex_);
+        if (worker_.joinable())
+            return true;
+
+        path_ = DefaultSocketPath();
+        auto listener = Listen();
+        if (listener == kInvalidSocket) {
+            blog(LOG_WARNING, TAG "Cannot listen on control socket %s", path_.c_str());
+            return false;
+        }
+
+        stop_ = false;
+        running_ = true;
+        worker_ = std::thread([this, listener]() { Run(listener); });
+        blog(LOG_INFO, TAG "Control socket listening on %s", path_.c_str());
+        return true;
+    }
+
+    void Stop() override
+    {
+        std::unique_lock lock(mutex_);
+        if (!worker_.joinable())
+            return;
+        running_ = false;
+        stop_ = true;
+        worker_.join();
+        {
+            std::unique_lock eventLock(eventMutex_);
+            newEvents_.clear();
+        }
+        blog(LOG_INFO, TAG "Control socket closed");
+    }
+
+    void PostEvent(const std::string& targetId, ControlEvent event, int code) override
+    {
+        if (!running_)
+            return;
+
+        FrameWriter frame(FrameEvent);
+        frame.String(targetId);
+        frame.Byte(static_cast<uint8_t>(event));
+        frame.Signed(code);
+        frame.Varint(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()));
+
+        std::unique_lock lock(eventMutex_);
+        // the worker drains this every poll interval; cap it in case the worker is gone
+        if (newEvents_.size() < kMaxQueuedEvents)
+            newEvents_.push_back(frame.Finish());
+    }
+
+    std::string Path() override
+    {
+        std::unique_lock lock(mutex_);
+        return path_;
+    }
+};
+
+ControlSocket* GetControlSocket()
+{
+    static ControlSocketImpl impl_;
+    return &impl_;
+}
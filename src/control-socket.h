@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Push feed of target lifecycle events and stats over a local Unix-domain
+// socket, for orchestrators that do not want to poll.
+//
+// Every frame is a little-endian u32 length followed by that many bytes: a
+// u8 frame type and its payload. Varints are unsigned LEB128, strings are a
+// varint length followed by UTF-8 bytes.
+//
+//   client -> plugin  0x01 Subscribe     (no payload)
+//   plugin -> client  0x10 Stats         varint count, then per target:
+//                                          string id, varint field mask,
+//                                          the masked fields in bit order
+//                     0x11 Event         string id, u8 event, varint code
+//                                          (zigzag), varint unix time in us
+//                     0x12 EventsLost    varint number of dropped events
+//
+// Stats frames only carry fields that changed since the last frame sent to
+// that client; the first one after Subscribe carries everything. A client
+// that reads slowly skips intermediate stats instead of queueing them, and
+// keeps only its 256 most recent events.
+enum ControlStatsField : uint32_t {
+    ControlFieldName = 1 << 0,            // string
+    ControlFieldState = 1 << 1,           // varint: 0 stopped, 1 running, 2 reconnecting
+    ControlFieldBytes = 1 << 2,           // varint
+    ControlFieldFrames = 1 << 3,          // varint
+    ControlFieldDroppedFrames = 1 << 4,   // varint
+    ControlFieldReconnects = 1 << 5,      // varint
+    ControlFieldCongestion = 1 << 6,      // varint, 0..1000000
+    ControlFieldDowntimeMs = 1 << 7,      // varint
+    ControlFieldSendQueuePeak = 1 << 8,   // varint
+    ControlFieldEncoderShared = 1 << 9,   // varint: bit 0 video, bit 1 audio
+    ControlFieldRemoved = 1 << 15,        // target was deleted, no further fields
+};
+
+enum class ControlEvent : uint8_t {
+    Starting = 1,
+    Started = 2,
+    Reconnecting = 3,
+    Reconnected = 4,
+    Stopping = 5,
+    Stopped = 6,
+};
+
+class ControlSocket {
+public:
+    virtual ~ControlSocket() {}
+    virtual bool Start() = 0;
+    virtual void Stop() = 0;
+    // Cheap no-op while stopped; safe from output signal threads.
+    virtual void PostEvent(const std::string& targetId, ControlEvent event, int code = 0) = 0;
+    virtual std::string Path() = 0;
+};
+
+ControlSocket* GetControlSocket();
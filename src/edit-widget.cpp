@@ -12,6 +12,8 @@
 #include "obs-properties-widget.h"
 #include "helpers.h"
 #include "protocols.h"
+#include "category-cache.h"
+#include "egress-manager.h"
 #include <qdesktopservices.h>
 
 static std::optional<int> ParseStringToInt(const QString& str) {
@@ -236,6 +238,7 @@ class EditOutputWidgetImpl: public EditOutputWidget
     QComboBox* v_scene_ = 0;
     QLineEdit* v_resolution_ = 0;
     QComboBox* v_fpsdenumerator_ = 0;
+    QComboBox* v_scaletype_ = 0;
     QLabel* v_share_notify_ = 0;
 
     QComboBox* aenc_ = 0;
@@ -243,6 +246,11 @@ class EditOutputWidgetImpl: public EditOutputWidget
     QComboBox* a_vod_track_ = nullptr;
     QLabel* a_share_notify_ = 0;
 
+    QComboBox* tuningProfile_ = 0;
+    QCheckBox* tuningApplyAll_ = 0;
+    QCheckBox* autoEgress_ = 0;
+    QLineEdit* tags_ = 0;
+
     QCheckBox* syncStart_ = 0;
     QCheckBox* syncStop_ = 0;
     QCheckBox* streamlabsToken_ = 0;
@@ -457,6 +465,11 @@ protected:
             protocol_info = GetProtocolInfos()->GetList();
         }
 
+        if (!protocol_info->serviceId) {
+            serviceSettings_->ClearProperties();
+            return;
+        }
+
         auto service = obs_service_create(protocol_info->serviceId, ("tmp_service_" + targetid_).c_str(), from_json(config_->serviceParam), nullptr);
         serviceSettings_->UpdateProperties(
             obs_service_properties(service),
@@ -574,6 +587,12 @@ public:
                         v_resolution_->setPlaceholderText(obs_module_text("SameAsOBSNow"));
                     }
                     ++currow;
+                    {
+                        int curcol = 0;
+                        encLayout->addWidget(new QLabel(obs_module_text("VideoScaleType"), gp), currow, curcol++);
+                        encLayout->addWidget(v_scaletype_ = new QComboBox(gp), currow, curcol++);
+                    }
+                    ++currow;
                     {
                         int curcol = 0;
                         encLayout->addWidget(new QLabel(obs_module_text("VideoFPSDenumerator"), gp), currow, curcol++);
@@ -652,6 +671,17 @@ public:
                     QObject::connect(streamlabsGetToken_, &QPushButton::clicked, []() {
                         QDesktopServices::openUrl(QUrl("https://github.com/Loukious/StreamlabsTikTokStreamKeyGenerator"));
                     });
+                    auto tuningLayout = new QHBoxLayout();
+                    tuningLayout->addWidget(new QLabel(obs_module_text("TuningProfile"), gp));
+                    tuningLayout->addWidget(tuningProfile_ = new QComboBox(gp), 1);
+                    otherLayout->addLayout(tuningLayout, 4, 0);
+                    otherLayout->addWidget(tuningApplyAll_ = new QCheckBox(obs_module_text("TuningApplyAll"), gp), 5, 0);
+                    otherLayout->addWidget(autoEgress_ = new QCheckBox(obs_module_text("AutoEgress"), gp), 6, 0);
+                    auto tagsLayout = new QHBoxLayout();
+                    tagsLayout->addWidget(new QLabel(obs_module_text("Tags"), gp));
+                    tagsLayout->addWidget(tags_ = new QLineEdit("", gp), 1);
+                    tags_->setToolTip(obs_module_text("Tags.Tip"));
+                    otherLayout->addLayout(tagsLayout, 7, 0);
                     gp->setLayout(otherLayout);
                 }
 
@@ -677,11 +707,31 @@ public:
             auto okbtn = new QPushButton(obs_module_text("OK"), container_);
             QObject::connect(okbtn, &QPushButton::clicked, [this]() {
                 SaveConfig();
+                GetProtocolInfos()->ApplyTuningProfile(*config_);
+                auto problems = GetProtocolInfos()->CheckTuning(*config_);
+                if (!problems.empty()) {
+                    std::string text = obs_module_text("Error.Tuning");
+                    for (auto& problem : problems)
+                        text += "\n" + problem;
+                    QMessageBox(QMessageBox::Icon::Warning,
+                        obs_module_text("Notice.Title"),
+                        QString::fromUtf8(text),
+                        QMessageBox::StandardButton::Ok,
+                        this
+                    ).exec();
+                    updateServiceTab();
+                    updateOutputTab();
+                    return;
+                }
+
                 auto& global = GlobalMultiOutputConfig();
                 auto it = FindById(global.targets, config_->id);
                 if (it != nullptr) {
                     *it = *config_;
                 }
+                if (tuningApplyAll_->isChecked())
+                    ApplyTuningToProtocolTargets();
+                PrewarmStreamlabsCategory();
                 done(DialogCode::Accepted);
             });
             layout->addWidget(okbtn);
@@ -702,6 +752,7 @@ public:
 
         LoadProtocols();
         LoadFPSDenumerator();
+        LoadScaleTypes();
         LoadEncoders();
         LoadScenes();
 
@@ -710,6 +761,50 @@ public:
         UpdateUI();
     }
 
+    void PrewarmStreamlabsCategory()
+    {
+        if (!config_->streamlabsToken || config_->streamlabsCategory.empty())
+            return;
+
+        auto useAuth = GetJsonField<bool>(config_->serviceParam, "use_auth");
+        auto token = GetJsonField<std::string>(config_->serviceParam, "password");
+        if (useAuth.value_or(false) && token.has_value())
+            GetCategoryCache()->Prewarm(*token, config_->streamlabsCategory);
+    }
+
+    // Gives every target of the same protocol this target's tuning profile.
+    void ApplyTuningToProtocolTargets()
+    {
+        int count = 0;
+        for (auto& target : GlobalMultiOutputConfig().targets) {
+            if (target->id == config_->id || target->protocol != config_->protocol)
+                continue;
+            target->tuningProfile = config_->tuningProfile;
+            GetProtocolInfos()->ApplyTuningProfile(*target);
+            ++count;
+        }
+        blog(LOG_INFO, TAG "Applied tuning profile \"%s\" to %d other %s targets",
+            config_->tuningProfile.c_str(), count, config_->protocol.c_str());
+    }
+
+    void LoadTuningProfiles(const std::string& protocol, const std::string& selected)
+    {
+        QSignalBlocker blocker(tuningProfile_);
+        tuningProfile_->clear();
+        tuningProfile_->addItem(obs_module_text("Tuning.None"), "");
+
+        auto info = GetProtocolInfos()->GetInfo(protocol.c_str());
+        if (info && info->tuningProfiles) {
+            for (auto p = info->tuningProfiles; p->id; ++p)
+                tuningProfile_->addItem(obs_module_text(p->label), p->id);
+        }
+
+        auto idx = tuningProfile_->findData(QString::fromUtf8(selected));
+        tuningProfile_->setCurrentIndex(idx < 0 ? 0 : idx);
+        tuningProfile_->setEnabled(tuningProfile_->count() > 1);
+        tuningApplyAll_->setEnabled(tuningProfile_->count() > 1);
+    }
+
     void ConnectWidgetSignals()
     {
         QObject::connect(venc_, (void (QComboBox::*)(int)) &QComboBox::currentIndexChanged, [this](){
@@ -728,6 +823,14 @@ public:
             SaveConfig();
             LoadConfig();
             UpdateUI();
+            GetProtocolInfos()->ApplyTuningProfile(*config_);
+            updateServiceTab();
+            updateOutputTab();
+        });
+
+        QObject::connect(tuningProfile_, (void (QComboBox::*)(int)) &QComboBox::currentIndexChanged, [this](){
+            SaveConfig();
+            GetProtocolInfos()->ApplyTuningProfile(*config_);
             updateServiceTab();
             updateOutputTab();
         });
@@ -814,6 +917,14 @@ public:
         }
     }
 
+    void LoadScaleTypes()
+    {
+        v_scaletype_->addItem(obs_module_text("ScaleType.Bilinear"), "bilinear");
+        v_scaletype_->addItem(obs_module_text("ScaleType.Area"), "area");
+        v_scaletype_->addItem(obs_module_text("ScaleType.Bicubic"), "bicubic");
+        v_scaletype_->addItem(obs_module_text("ScaleType.Lanczos"), "lanczos");
+    }
+
     void LoadScenes()
     {
         v_scene_->addItem(obs_module_text("SameAsOBSScene"), "");
@@ -848,12 +959,14 @@ public:
             v_scene_->setEnabled(false);
             v_resolution_->setEnabled(false);
             v_fpsdenumerator_->setEnabled(false);
+            v_scaletype_->setEnabled(false);
         }
         else
         {
             v_scene_->setEnabled(true);
             v_resolution_->setEnabled(true);
             v_fpsdenumerator_->setEnabled(true);
+            v_scaletype_->setEnabled(true);
         }
 
         auto makeShareNotify = [&](auto& targets) {
@@ -946,6 +1059,7 @@ public:
             it->resolution.reset();
 
         it->fpsDenumerator = v_fpsdenumerator_->currentData().toInt();
+        it->scaleType = tostdu8(v_scaletype_->currentData().toString());
         
         it->encoderParams = videoEncoderSettings_->Save();
     }
@@ -989,6 +1103,14 @@ public:
         config_->streamlabsTitle = tostdu8(streamlabsTitle_->text());
         config_->streamlabsCategory = tostdu8(streamlabsCategory_->text());
         config_->streamlabsMatureContent = streamlabsMatureContent_->isChecked();
+        config_->tuningProfile = tostdu8(tuningProfile_->currentData().toString());
+        config_->autoEgress = autoEgress_->isChecked();
+        config_->tags.clear();
+        for (auto& tag : tags_->text().split(',', Qt::SkipEmptyParts)) {
+            auto trimmed = tag.trimmed();
+            if (!trimmed.isEmpty())
+                config_->tags.push_back(tostdu8(trimmed));
+        }
         config_->outputParam = outputSettings_->Save();
         config_->serviceParam = serviceSettings_->Save();
 
@@ -1028,12 +1150,20 @@ public:
         auto protocolIndex = protocolSelector_->findData(QString::fromUtf8(target.protocol));
         if (protocolIndex < 0) protocolIndex = 0;
         protocolSelector_->setCurrentIndex(protocolIndex);
+        LoadTuningProfiles(target.protocol, target.tuningProfile);
         syncStart_->setChecked(target.syncStart);
         syncStop_->setChecked(target.syncStop);
         streamlabsToken_->setChecked(target.streamlabsToken);
         streamlabsTitle_->setText(QString::fromUtf8(target.streamlabsTitle));
         streamlabsCategory_->setText(QString::fromUtf8(target.streamlabsCategory));
         streamlabsMatureContent_->setChecked(target.streamlabsMatureContent);
+        autoEgress_->setChecked(target.autoEgress);
+        QStringList tags;
+        for (auto& tag : target.tags)
+            tags << QString::fromUtf8(tag);
+        tags_->setText(tags.join(", "));
+        auto info = GetProtocolInfos()->GetInfo(target.protocol.c_str());
+        autoEgress_->setEnabled(info && EgressSupportsOutput(info->outputId));
     }
 
     using IdOrVideoConfig = std::variant<std::string_view, VideoEncoderConfig*>;
@@ -1087,6 +1217,13 @@ public:
             v_fpsdenumerator_->setCurrentIndex(idx);
         }
 
+        {
+            auto idx = v_scaletype_->findData(QString::fromUtf8(config.scaleType));
+            if (idx < 0)
+                idx = v_scaletype_->findData("bicubic");
+            v_scaletype_->setCurrentIndex(idx);
+        }
+
         {
             auto encoder = obs_video_encoder_create(config.encoderId.c_str(), ("tmp_video_encoder_" + targetid_ + "_" + config.id).c_str(), from_json(config.encoderParams), nullptr);
             videoEncoderSettings_->UpdateProperties(
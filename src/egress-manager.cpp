@@ -0,0 +1,423 @@
+#include "egress-manager.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#endif
+
+#include "fanout-output.h"
+#include "json-util.hpp"
+#include "pch.h"
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <util/platform.h>
+
+static const auto kRefreshInterval = std::chrono::seconds(2);
+// an interface whose targets report more congestion than this on average takes no new targets
+static const float kSaturatedCongestion = 0.5f;
+static const double kBitrateSmoothing = 0.3;
+
+bool EgressSupportsOutput(const char* outputId)
+{
+    return outputId && (strcmp(outputId, "rtmp_output") == 0 || strcmp(outputId, FANOUT_OUTPUT_ID) == 0);
+}
+
+struct LocalInterface {
+    std::string name;
+    std::string address;
+    bool up = false;
+};
+
+#ifdef _WIN32
+static std::vector<LocalInterface> EnumerateInterfaces()
+{
+    std::vector<LocalInterface> result;
+
+    ULONG size = 16 * 1024;
+    std::vector<uint8_t> buffer;
+    ULONG ret;
+    do {
+        buffer.resize(size);
+        ret = GetAdaptersAddresses(AF_UNSPEC,
+            GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER,
+            nullptr, reinterpret_cast<IP_ADAPTER_ADDRESSES*>(buffer.data()), &size);
+    } while (ret == ERROR_BUFFER_OVERFLOW);
+    if (ret != NO_ERROR)
+        return result;
+
+    for (auto adapter = reinterpret_cast<IP_ADAPTER_ADDRESSES*>(buffer.data()); adapter; adapter = adapter->Next) {
+        if (adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK)
+            continue;
+
+        LocalInterface iface;
+        int len = WideCharToMultiByte(CP_UTF8, 0, adapter->FriendlyName, -1, nullptr, 0, nullptr, nullptr);
+        if (len > 1) {
+            iface.name.resize(len - 1);
+            WideCharToMultiByte(CP_UTF8, 0, adapter->FriendlyName, -1, iface.name.data(), len, nullptr, nullptr);
+        } else {
+            iface.name = adapter->AdapterName;
+        }
+        iface.up = adapter->OperStatus == IfOperStatusUp;
+
+        // prefer the first IPv4 address, fall back to IPv6
+        for (auto unicast = adapter->FirstUnicastAddress; unicast; unicast = unicast->Next) {
+            char text[INET6_ADDRSTRLEN] = {};
+            auto sa = unicast->Address.lpSockaddr;
+            if (sa->sa_family == AF_INET) {
+                inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(sa)->sin_addr, text, sizeof(text));
+                iface.address = text;
+                break;
+            }
+            if (sa->sa_family == AF_INET6 && iface.address.empty()) {
+                auto addr6 = &reinterpret_cast<sockaddr_in6*>(sa)->sin6_addr;
+                if (!IN6_IS_ADDR_LINKLOCAL(addr6)) {
+                    inet_ntop(AF_INET6, addr6, text, sizeof(text));
+                    iface.address = text;
+                }
+            }
+        }
+        if (!iface.address.empty())
+            result.push_back(std::move(iface));
+    }
+    return result;
+}
+#else
+static std::vector<LocalInterface> EnumerateInterfaces()
+{
+    std::vector<LocalInterface> result;
+
+    ifaddrs* list = nullptr;
+    if (getifaddrs(&list) != 0)
+        return result;
+
+    std::map<std::string, LocalInterface> byName;
+    for (auto item = list; item; item = item->ifa_next) {
+        if (!item->ifa_addr || (item->ifa_flags & IFF_LOOPBACK))
+            continue;
+
+        char text[INET6_ADDRSTRLEN] = {};
+        bool ipv4 = false;
+        if (item->ifa_addr->sa_family == AF_INET) {
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(item->ifa_addr)->sin_addr, text, sizeof(text));
+            ipv4 = true;
+        } else if (item->ifa_addr->sa_family == AF_INET6) {
+            auto addr6 = &reinterpret_cast<sockaddr_in6*>(item->ifa_addr)->sin6_addr;
+            if (IN6_IS_ADDR_LINKLOCAL(addr6))
+                continue;
+            inet_ntop(AF_INET6, addr6, text, sizeof(text));
+        } else {
+            continue;
+        }
+
+        auto& iface = byName[item->ifa_name];
+        iface.name = item->ifa_name;
+        iface.up = (item->ifa_flags & IFF_UP) && (item->ifa_flags & IFF_RUNNING);
+        // prefer IPv4, keep the first address of a family
+        if (iface.address.empty() || (ipv4 && iface.address.find(':') != std::string::npos))
+            iface.address = text;
+    }
+    freeifaddrs(list);
+
+    for (auto& [name, iface] : byName)
+        result.push_back(std::move(iface));
+    return result;
+}
+#endif
+
+class EgressManagerImpl : public EgressManager {
+    using Clock = std::chrono::steady_clock;
+
+    struct Interface {
+        std::string address;
+        bool up = false;
+        int weight = 1;
+    };
+
+    struct Target {
+        std::string iface;
+        uint64_t lastBytes = 0;
+        Clock::time_point lastTime;
+        bool hasBaseline = false;
+        bool hasSample = false;
+        double bitsPerSec = 0;
+        float congestion = 0;
+    };
+
+    std::mutex mutex_;
+    std::string filename_;
+    std::map<std::string, int> weights_;
+    std::map<std::string, Interface> interfaces_;
+    std::unordered_map<std::string, Target> targets_;
+    Clock::time_point lastRefresh_;
+    bool refreshed_ = false;
+
+    // caller holds mutex_
+    void Save()
+    {
+        if (filename_.empty())
+            return;
+
+        nlohmann::json weights(nlohmann::json::value_t::object);
+        for (auto& [name, weight] : weights_)
+            weights[name] = weight;
+        auto content = nlohmann::json{ { "weights", weights } }.dump();
+        os_quick_write_utf8_file_safe(filename_.c_str(), content.c_str(), content.size(), false, "tmp", nullptr);
+    }
+
+    // caller holds mutex_
+    void Refresh(bool force)
+    {
+        auto now = Clock::now();
+        if (!force && refreshed_ && now - lastRefresh_ < kRefreshInterval)
+            return;
+        refreshed_ = true;
+        lastRefresh_ = now;
+
+        auto current = EnumerateInterfaces();
+        for (auto& [name, iface] : interfaces_)
+            iface.up = false;
+        for (auto& local : current) {
+            if (interfaces_.find(local.name) == interfaces_.end())
+                blog(LOG_INFO, TAG "Egress interface %s (%s) found", local.name.c_str(), local.address.c_str());
+            auto& iface = interfaces_[local.name];
+            iface.address = local.address;
+            iface.up = local.up;
+            auto weight = weights_.find(local.name);
+            iface.weight = weight != weights_.end() ? weight->second : 1;
+        }
+
+        // forget interfaces that disappeared once nothing is bound to them
+        for (auto it = interfaces_.begin(); it != interfaces_.end();) {
+            bool inUse = false;
+            for (auto& [id, target] : targets_)
+                inUse = inUse || target.iface == it->first;
+            bool present = false;
+            for (auto& local : current)
+                present = present || local.name == it->first;
+            if (!present && !inUse)
+                it = interfaces_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // caller holds mutex_
+    bool IsSaturated(const std::string& name)
+    {
+        float total = 0;
+        int count = 0;
+        for (auto& [id, target] : targets_) {
+            if (target.iface == name && target.hasSample) {
+                total += target.congestion;
+                ++count;
+            }
+        }
+        return count > 0 && total / count > kSaturatedCongestion;
+    }
+
+    // caller holds mutex_
+    bool IsUsable(const std::string& name)
+    {
+        auto it = interfaces_.find(name);
+        return it != interfaces_.end() && it->second.up && it->second.weight > 0 && !it->second.address.empty();
+    }
+
+    // caller holds mutex_
+    std::string Pick(const std::string& targetId)
+    {
+        // targets without a measurement yet count as an average one
+        double measured = 0;
+        int measuredCount = 0;
+        for (auto& [id, target] : targets_) {
+            if (target.hasSample) {
+                measured += target.bitsPerSec;
+                ++measuredCount;
+            }
+        }
+        double unit = measuredCount > 0 ? std::max(measured / measuredCount, 1.0) : 1.0;
+
+        std::string best;
+        double bestScore = 0;
+        bool bestSaturated = true;
+        for (auto& [name, iface] : interfaces_) {
+            if (!IsUsable(name))
+                continue;
+
+            double load = 0;
+            for (auto& [id, target] : targets_) {
+                if (id != targetId && target.iface == name)
+                    load += target.hasSample ? target.bitsPerSec : unit;
+            }
+            double score = load / iface.weight;
+            bool saturated = IsSaturated(name);
+
+            if (best.empty() || (bestSaturated && !saturated) || (saturated == bestSaturated && score < bestScore)) {
+                best = name;
+                bestScore = score;
+                bestSaturated = saturated;
+            }
+        }
+        return best;
+    }
+
+    // caller holds mutex_
+    std::string Bind(const std::string& targetId, const std::string& name)
+    {
+        auto& target = targets_[targetId];
+        target = Target{};
+        target.iface = name;
+        if (name.empty())
+            return {};
+        return interfaces_[name].address;
+    }
+
+public:
+    void Load() override
+    {
+        auto path = obs_module_config_path("egress.json");
+        if (!path)
+            return;
+
+        std::unique_lock lock(mutex_);
+        filename_ = path;
+        bfree(path);
+
+        auto dir = obs_module_config_path("");
+        if (dir) {
+            os_mkdirs(dir);
+            bfree(dir);
+        }
+
+        auto content = os_quick_read_utf8_file(filename_.c_str());
+        if (!content)
+            return;
+
+        try {
+            auto json = nlohmann::json::parse(content);
+            auto weights = json.find("weights");
+            if (weights != json.end() && weights->is_object()) {
+                for (auto& [name, weight] : weights->items()) {
+                    if (weight.is_number_integer())
+                        weights_[name] = std::max(weight.get<int>(), 0);
+                }
+            }
+        }
+        catch(const std::exception& e) {
+            blog(LOG_WARNING, TAG "Fail to parse egress config: %s", e.what());
+        }
+        bfree(content);
+    }
+
+    std::string Assign(const std::string& targetId) override
+    {
+        std::unique_lock lock(mutex_);
+        Refresh(false);
+        auto name = Pick(targetId);
+        if (name.empty())
+            blog(LOG_WARNING, TAG "No usable egress interface for target %s", targetId.c_str());
+        else
+            blog(LOG_INFO, TAG "Target %s egresses through %s", targetId.c_str(), name.c_str());
+        return Bind(targetId, name);
+    }
+
+    std::string Reassign(const std::string& targetId) override
+    {
+        std::unique_lock lock(mutex_);
+        Refresh(true);
+
+        auto it = targets_.find(targetId);
+        std::string current = it != targets_.end() ? it->second.iface : std::string();
+        if (!current.empty() && IsUsable(current) && !IsSaturated(current)) {
+            it->second.hasBaseline = false;
+            return interfaces_[current].address;
+        }
+
+        auto name = Pick(targetId);
+        if (name != current) {
+            blog(LOG_INFO, TAG "Moving target %s from %s to %s",
+                targetId.c_str(), current.empty() ? "(none)" : current.c_str(), name.empty() ? "(none)" : name.c_str());
+        }
+        return Bind(targetId, name);
+    }
+
+    void Release(const std::string& targetId) override
+    {
+        std::unique_lock lock(mutex_);
+        targets_.erase(targetId);
+    }
+
+    void Report(const std::string& targetId, uint64_t totalBytes, float congestion) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = targets_.find(targetId);
+        if (it == targets_.end())
+            return;
+
+        auto& target = it->second;
+        auto now = Clock::now();
+        target.congestion = congestion;
+        if (target.hasBaseline && totalBytes >= target.lastBytes) {
+            auto interval = std::chrono::duration<double>(now - target.lastTime).count();
+            if (interval > 0) {
+                auto bps = (totalBytes - target.lastBytes) * 8 / interval;
+                target.bitsPerSec = target.hasSample ? target.bitsPerSec + (bps - target.bitsPerSec) * kBitrateSmoothing : bps;
+                target.hasSample = true;
+            }
+        }
+        target.lastBytes = totalBytes;
+        target.lastTime = now;
+        target.hasBaseline = true;
+    }
+
+    std::vector<EgressInterfaceInfo> GetInterfaces() override
+    {
+        std::unique_lock lock(mutex_);
+        Refresh(false);
+
+        std::vector<EgressInterfaceInfo> result;
+        for (auto& [name, iface] : interfaces_) {
+            EgressInterfaceInfo info;
+            info.name = name;
+            info.address = iface.address;
+            info.up = iface.up;
+            info.weight = iface.weight;
+            info.saturated = IsSaturated(name);
+            for (auto& [id, target] : targets_) {
+                if (target.iface == name) {
+                    ++info.targets;
+                    info.bitsPerSec += target.bitsPerSec;
+                }
+            }
+            result.push_back(std::move(info));
+        }
+        return result;
+    }
+
+    void SetWeight(const std::string& name, int weight) override
+    {
+        std::unique_lock lock(mutex_);
+        weights_[name] = std::max(weight, 0);
+        auto it = interfaces_.find(name);
+        if (it != interfaces_.end())
+            it->second.weight = weights_[name];
+        Save();
+    }
+};
+
+EgressManager* GetEgressManager()
+{
+    static EgressManagerImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct EgressInterfaceInfo {
+    std::string name;
+    std::string address;
+    bool up = false;
+    bool saturated = false;
+    int weight = 1;
+    int targets = 0;
+    double bitsPerSec = 0;
+};
+
+// Spreads targets over the local network interfaces by setting bind_ip.
+// A target goes to the interface with the least measured throughput relative
+// to its weight, and moves on reconnect when its interface went down or is
+// congested. Weights are persisted in the module config directory.
+class EgressManager {
+public:
+    virtual ~EgressManager() {}
+    virtual void Load() = 0;
+    // Address to bind for a target about to connect. Empty when no interface is usable.
+    virtual std::string Assign(const std::string& targetId) = 0;
+    // Like Assign, but keeps the current interface while it is up and not saturated.
+    // Safe to call from output signal threads.
+    virtual std::string Reassign(const std::string& targetId) = 0;
+    virtual void Release(const std::string& targetId) = 0;
+    // Feeds the measured throughput. congestion is obs_output_get_congestion.
+    virtual void Report(const std::string& targetId, uint64_t totalBytes, float congestion) = 0;
+    virtual std::vector<EgressInterfaceInfo> GetInterfaces() = 0;
+    // 0 excludes the interface.
+    virtual void SetWeight(const std::string& name, int weight) = 0;
+};
+
+EgressManager* GetEgressManager();
+
+// Outputs that honour the bind_ip setting.
+bool EgressSupportsOutput(const char* outputId);
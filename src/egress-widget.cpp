@@ -0,0 +1,118 @@
+#include "egress-widget.h"
+#include "egress-manager.h"
+#include "output-config.h"
+#include "helpers.h"
+
+#include <QSpinBox>
+
+class EgressWidgetImpl : public EgressWidget
+{
+    struct Row {
+        std::string name;
+        QLabel* name_ = 0;
+        QSpinBox* weight_ = 0;
+        QLabel* status_ = 0;
+    };
+
+    QGroupBox* group_ = 0;
+    QGridLayout* layout_ = 0;
+    QTimer* timer_ = 0;
+    std::vector<Row> rows_;
+
+    static bool AnyTargetUsesEgress()
+    {
+        for (auto& target : GlobalMultiOutputConfig().targets) {
+            if (target->autoEgress)
+                return true;
+        }
+        return false;
+    }
+
+    void Rebuild(const std::vector<EgressInterfaceInfo>& interfaces)
+    {
+        for (auto& row : rows_) {
+            delete row.name_;
+            delete row.weight_;
+            delete row.status_;
+        }
+        rows_.clear();
+
+        int index = 0;
+        for (auto& iface : interfaces) {
+            Row row;
+            row.name = iface.name;
+            layout_->addWidget(row.name_ = new QLabel(group_), index, 0);
+            layout_->addWidget(row.weight_ = new QSpinBox(group_), index, 1);
+            layout_->addWidget(row.status_ = new QLabel(group_), index, 2);
+            row.weight_->setRange(0, 100);
+            row.weight_->setPrefix(obs_module_text("Egress.Weight"));
+            row.weight_->setToolTip(obs_module_text("Egress.WeightTip"));
+            row.weight_->setValue(iface.weight);
+            QObject::connect(row.weight_, (void (QSpinBox::*)(int)) &QSpinBox::valueChanged, [name = iface.name](int value) {
+                GetEgressManager()->SetWeight(name, value);
+            });
+            rows_.push_back(row);
+            ++index;
+        }
+        layout_->setColumnStretch(2, 1);
+    }
+
+    void Refresh()
+    {
+        if (!AnyTargetUsesEgress()) {
+            setVisible(false);
+            return;
+        }
+        setVisible(true);
+
+        auto interfaces = GetEgressManager()->GetInterfaces();
+        bool same = interfaces.size() == rows_.size();
+        for (size_t i = 0; same && i < interfaces.size(); ++i)
+            same = interfaces[i].name == rows_[i].name;
+        if (!same)
+            Rebuild(interfaces);
+
+        for (size_t i = 0; i < interfaces.size(); ++i) {
+            auto& iface = interfaces[i];
+            auto& row = rows_[i];
+            row.name_->setText(QString::fromUtf8(iface.name + " (" + iface.address + ")"));
+
+            std::string status = FormatBitrate(iface.bitsPerSec) + "  "
+                + std::to_string(iface.targets) + " " + obs_module_text("Egress.Targets");
+            if (!iface.up)
+                status += "  " + std::string(obs_module_text("Egress.Down"));
+            else if (iface.saturated)
+                status += "  " + std::string(obs_module_text("Egress.Saturated"));
+            row.status_->setText(QString::fromUtf8(status));
+
+            if (!row.weight_->hasFocus() && row.weight_->value() != iface.weight) {
+                QSignalBlocker blocker(row.weight_);
+                row.weight_->setValue(iface.weight);
+            }
+        }
+    }
+
+public:
+    EgressWidgetImpl(QWidget* parent)
+        : QWidget(parent)
+    {
+        auto layout = new QGridLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->addWidget(group_ = new QGroupBox(obs_module_text("Egress.Title"), this), 0, 0);
+        layout_ = new QGridLayout(group_);
+        group_->setLayout(layout_);
+        setLayout(layout);
+
+        timer_ = new QTimer(this);
+        timer_->setInterval(std::chrono::milliseconds(1000));
+        QObject::connect(timer_, &QTimer::timeout, [this]() {
+            Refresh();
+        });
+        timer_->start();
+        Refresh();
+    }
+};
+
+EgressWidget* createEgressWidget(QWidget* parent) {
+    return new EgressWidgetImpl(parent);
+}
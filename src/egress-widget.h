@@ -0,0 +1,10 @@
+#include "pch.h"
+
+// Per-interface throughput and weights of the egress manager, shown in the dock
+// while at least one target picks its interface automatically.
+class EgressWidget : virtual public QWidget {
+public:
+    virtual ~EgressWidget() {}
+};
+
+EgressWidget* createEgressWidget(QWidget* parent = 0);
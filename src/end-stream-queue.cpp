@@ -0,0 +1,255 @@
+#include "end-stream-queue.h"
+#include "streamlabs-api.h"
+#include "json-util.hpp"
+#include "pch.h"
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
+#include <util/platform.h>
+
+static const int kMaxAttempts = 8;
+static const auto kBaseBackoff = std::chrono::seconds(2);
+static const auto kMaxBackoff = std::chrono::seconds(120);
+
+class EndStreamQueueImpl : public EndStreamQueue {
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        std::string token;
+        std::string streamID;
+        int attempts = 0;
+        Clock::time_point due;
+        bool inFlight = false;
+        // already tried once by the running flush
+        bool flushed = false;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Job> jobs_;
+    std::string filename_;
+    bool stopping_ = false;
+    bool flushing_ = false;
+    std::once_flag startOnce_;
+    std::thread worker_;
+    std::mt19937 random_{ std::random_device{}() };
+
+    // caller holds mutex_
+    void Save()
+    {
+        if (filename_.empty())
+            return;
+
+        nlohmann::json json(nlohmann::json::value_t::array);
+        for (auto& job : jobs_) {
+            // attempts start over in the next session
+            json.push_back({ { "token", job.token }, { "stream", job.streamID } });
+        }
+        auto content = json.dump();
+        os_quick_write_utf8_file_safe(filename_.c_str(), content.c_str(), content.size(), false, "tmp", nullptr);
+    }
+
+    // caller holds mutex_
+    Clock::duration Backoff(int attempts)
+    {
+        auto delay = kBaseBackoff * (1 << std::min(attempts - 1, 10));
+        auto capped = std::chrono::duration_cast<std::chrono::milliseconds>(std::min<Clock::duration>(delay, kMaxBackoff));
+        // equal jitter: keep half of the delay, randomize the other half
+        std::uniform_int_distribution<int64_t> jitter(0, capped.count() / 2);
+        return capped / 2 + std::chrono::milliseconds(jitter(random_));
+    }
+
+    void Start()
+    {
+        std::call_once(startOnce_, [this]() { worker_ = std::thread([this]() { Run(); }); });
+    }
+
+    void OnFinished(std::list<Job>::iterator it, bool success)
+    {
+        std::unique_lock lock(mutex_);
+        if (stopping_)
+            return; // aborted by the HTTP client shutting down, already persisted as is
+
+        it->inFlight = false;
+        if (success) {
+            blog(LOG_INFO, TAG "Streamlabs stream %s ended", it->streamID.c_str());
+            jobs_.erase(it);
+        } else if (it->flushed) {
+            // a quick try before exit, it does not use up the attempts of the job
+            it->due = Clock::now() + Backoff(std::max(it->attempts, 1));
+            blog(LOG_INFO, TAG "Ending Streamlabs stream %s failed during flush", it->streamID.c_str());
+        } else if (++it->attempts >= kMaxAttempts) {
+            blog(LOG_WARNING, TAG "Giving up ending Streamlabs stream %s after %d attempts", it->streamID.c_str(), it->attempts);
+            jobs_.erase(it);
+        } else {
+            // a flush still owes this job its own try
+            auto delay = flushing_ ? Clock::duration::zero() : Backoff(it->attempts);
+            it->due = Clock::now() + delay;
+            blog(LOG_INFO, TAG "Retrying end of Streamlabs stream %s in %lld ms", it->streamID.c_str(),
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(delay).count());
+        }
+        Save();
+        cv_.notify_all();
+    }
+
+    void Run()
+    {
+        std::unique_lock lock(mutex_);
+        while (!stopping_) {
+            auto now = Clock::now();
+            auto next = Clock::time_point::max();
+            auto due = jobs_.end();
+            for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+                if (it->inFlight || (flushing_ && it->flushed))
+                    continue;
+                if (it->due <= now) {
+                    due = it;
+                    break;
+                }
+                next = std::min(next, it->due);
+            }
+
+            if (due == jobs_.end()) {
+                if (next == Clock::time_point::max())
+                    cv_.wait(lock);
+                else
+                    cv_.wait_until(lock, next);
+                continue;
+            }
+
+            due->inFlight = true;
+            due->flushed = flushing_;
+            auto token = due->token;
+            auto streamID = due->streamID;
+            lock.unlock();
+            StreamlabsAPI::EndStream(token, streamID, [this, due](bool success) { OnFinished(due, success); });
+            lock.lock();
+        }
+    }
+
+public:
+    void Load() override
+    {
+        auto path = obs_module_config_path("end-stream-queue.json");
+        if (!path)
+            return;
+
+        std::unique_lock lock(mutex_);
+        filename_ = path;
+        bfree(path);
+
+        auto dir = obs_module_config_path("");
+        if (dir) {
+            os_mkdirs(dir);
+            bfree(dir);
+        }
+
+        auto content = os_quick_read_utf8_file(filename_.c_str());
+        if (!content)
+            return;
+
+        try {
+            auto json = nlohmann::json::parse(content);
+            for (auto& item : json) {
+                Job job;
+                job.token = GetJsonField<std::string>(item, "token").value_or("");
+                job.streamID = GetJsonField<std::string>(item, "stream").value_or("");
+                job.due = Clock::now();
+                if (job.token.empty() || job.streamID.empty())
+                    continue;
+                jobs_.push_back(std::move(job));
+            }
+        }
+        catch(const std::exception& e) {
+            blog(LOG_WARNING, TAG "Fail to parse pending end-stream requests: %s", e.what());
+        }
+        bfree(content);
+
+        if (!jobs_.empty()) {
+            blog(LOG_INFO, TAG "Resuming %d pending Streamlabs end-stream requests", (int)jobs_.size());
+            lock.unlock();
+            Start();
+            cv_.notify_all();
+        }
+    }
+
+    void Enqueue(const std::string& token, const std::string& streamID) override
+    {
+        if (token.empty() || streamID.empty()) {
+            blog(LOG_WARNING, TAG "EndStream: %s is empty", token.empty() ? "token" : "streamID");
+            return;
+        }
+
+        {
+            std::unique_lock lock(mutex_);
+            if (stopping_)
+                return;
+            auto found = std::find_if(jobs_.begin(), jobs_.end(), [&](const Job& job) { return job.streamID == streamID; });
+            if (found != jobs_.end())
+                return;
+
+            Job job;
+            job.token = token;
+            job.streamID = streamID;
+            job.due = Clock::now();
+            jobs_.push_back(std::move(job));
+            Save();
+        }
+        Start();
+        cv_.notify_all();
+    }
+
+    void Flush(int timeoutMs) override
+    {
+        std::unique_lock lock(mutex_);
+        if (jobs_.empty())
+            return;
+
+        flushing_ = true;
+        auto now = Clock::now();
+        for (auto& job : jobs_) {
+            if (!job.inFlight)
+                job.due = now;
+        }
+        cv_.notify_all();
+
+        // one attempt per job, failures stay queued for the next session
+        auto deadline = now + std::chrono::milliseconds(timeoutMs);
+        cv_.wait_until(lock, deadline, [this]() {
+            return std::all_of(jobs_.begin(), jobs_.end(), [](const Job& job) { return job.flushed && !job.inFlight; });
+        });
+        flushing_ = false;
+        for (auto& job : jobs_)
+            job.flushed = false;
+        if (!jobs_.empty())
+            blog(LOG_WARNING, TAG "%d Streamlabs end-stream requests still pending, retrying on next start", (int)jobs_.size());
+    }
+
+    void Shutdown() override
+    {
+        {
+            std::unique_lock lock(mutex_);
+            if (stopping_)
+                return;
+            stopping_ = true;
+            for (auto& job : jobs_)
+                job.inFlight = false;
+            Save();
+        }
+        cv_.notify_all();
+        std::call_once(startOnce_, []() {});
+        if (worker_.joinable())
+            worker_.join();
+    }
+};
+
+EndStreamQueue* GetEndStreamQueue()
+{
+    static EndStreamQueueImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+// Ends Streamlabs streams in the background. Jobs are retried with jittered
+// exponential backoff and persisted in the module config directory, so a
+// stream that could not be ended before OBS exited is ended on next start.
+class EndStreamQueue {
+public:
+    virtual ~EndStreamQueue() {}
+    // Restores jobs left over from the previous session.
+    virtual void Load() = 0;
+    // Never blocks on the network.
+    virtual void Enqueue(const std::string& token, const std::string& streamID) = 0;
+    // Tries every outstanding job once more, waiting up to timeoutMs. Failures
+    // stay queued and do not count against the retry limit.
+    virtual void Flush(int timeoutMs) = 0;
+    // Stops the worker and persists whatever is left. Call before the HTTP client shuts down.
+    virtual void Shutdown() = 0;
+};
+
+EndStreamQueue* GetEndStreamQueue();
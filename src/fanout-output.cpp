@@ -0,0 +1,571 @@
+#include "fanout-output.h"
+#include "flv-tag-cache.h"
+#include "gop-cache.h"
+#include "rtmp-publisher.h"
+#include "pch.h"
+
+#include <obs-avc.h>
+#include <util/platform.h>
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+static const int kConnectTimeoutMs = 10000;
+static const auto kShutdownTimeout = std::chrono::seconds(5);
+static const auto kPollInterval = std::chrono::milliseconds(100);
+static const int kDefaultMaxQueueMb = 16;
+
+class FanoutOutput {
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedTag {
+        FlvTagPtr tag;
+        uint32_t timestamp;
+    };
+
+    enum class DropPolicy {
+        Keyframe,
+        NonReference,
+        Disconnect,
+    };
+
+    obs_output_t* output_;
+    std::string url_;
+    std::string key_;
+    std::string bindIp_;
+    std::thread worker_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<QueuedTag> queue_;
+    std::unique_ptr<RtmpPublisher> publisher_;
+    bool workerRunning_ = false;
+    bool stopping_ = false;
+    bool encodeError_ = false;
+    uint64_t stopTsUsec_ = 0;
+    Clock::time_point stopDeadline_;
+    // timestamps follow the system clock of the frames, which is shared with tags from the GOP cache
+    bool haveBase_ = false;
+    int64_t baseSysDtsUsec_ = 0;
+    int64_t lastSysDtsUsec_[2] = { INT64_MIN, INT64_MIN };
+    uint64_t gopId_ = 0;
+    bool priming_ = false;
+    Clock::time_point startTime_;
+
+    DropPolicy dropPolicy_ = DropPolicy::Keyframe;
+    size_t maxQueueBytes_ = kDefaultMaxQueueMb * 1024 * 1024;
+    size_t queuedBytes_ = 0;
+    // over the lifetime of the output, reconnects included
+    size_t queueHighWater_ = 0;
+    bool waitForKeyframe_ = false;
+    bool overflowed_ = false;
+
+    std::atomic<bool> active_ = false;
+    std::atomic<uint64_t> totalBytes_ = 0;
+    std::atomic<int> connectTimeMs_ = 0;
+    std::atomic<uint64_t> droppedBytes_ = 0;
+    std::atomic<uint64_t> droppedPackets_ = 0;
+    std::atomic<int> droppedFrames_ = 0;
+
+    void CountDropped(const FlvTag& tag)
+    {
+        droppedBytes_ += tag.body.size();
+        ++droppedPackets_;
+        if (tag.video)
+            ++droppedFrames_;
+    }
+
+    // Applies the drop policy until a tag of the given size fits. Caller holds mutex_.
+    void MakeRoom(size_t incoming)
+    {
+        if (queuedBytes_ + incoming <= maxQueueBytes_)
+            return;
+
+        if (dropPolicy_ == DropPolicy::Disconnect) {
+            if (!overflowed_) {
+                overflowed_ = true;
+                if (publisher_)
+                    publisher_->Abort();
+                cv_.notify_all();
+            }
+            return;
+        }
+
+        if (dropPolicy_ == DropPolicy::NonReference) {
+            std::deque<QueuedTag> kept;
+            for (auto& item : queue_) {
+                auto& tag = *item.tag;
+                if (queuedBytes_ + incoming > maxQueueBytes_ && tag.video && tag.dropPriority == OBS_NAL_PRIORITY_DISPOSABLE) {
+                    queuedBytes_ -= tag.body.size();
+                    CountDropped(tag);
+                } else {
+                    kept.push_back(std::move(item));
+                }
+            }
+            queue_.swap(kept);
+            if (queuedBytes_ + incoming <= maxQueueBytes_)
+                return;
+        }
+
+        // everything queued goes, sending resumes at the next keyframe
+        for (auto& item : queue_)
+            CountDropped(*item.tag);
+        queue_.clear();
+        queuedBytes_ = 0;
+        waitForKeyframe_ = true;
+    }
+
+    // Caller holds mutex_. A tag can arrive both from libobs and from the GOP cache, it is queued once.
+    void Enqueue(FlvTagPtr tag)
+    {
+        auto& last = lastSysDtsUsec_[tag->video ? 1 : 0];
+        if (tag->sysDtsUsec <= last)
+            return;
+        last = tag->sysDtsUsec;
+        if (!haveBase_) {
+            haveBase_ = true;
+            baseSysDtsUsec_ = tag->sysDtsUsec;
+        }
+
+        MakeRoom(tag->body.size());
+        if (overflowed_) {
+            CountDropped(*tag);
+            return;
+        }
+        // after MakeRoom, which may have just emptied the queue
+        if (waitForKeyframe_ && tag->video) {
+            if (!tag->keyframe) {
+                CountDropped(*tag);
+                return;
+            }
+            waitForKeyframe_ = false;
+        }
+
+        auto timestamp = std::max<int64_t>((tag->sysDtsUsec - baseSysDtsUsec_) / 1000, 0);
+        queuedBytes_ += tag->body.size();
+        queueHighWater_ = std::max(queueHighWater_, queuedBytes_);
+        queue_.push_back({ std::move(tag), static_cast<uint32_t>(timestamp) });
+        cv_.notify_one();
+    }
+
+    // Tags other outputs on the same encoders receive, while libobs still holds back ours.
+    void OnSharedTag(const FlvTagPtr& tag)
+    {
+        std::unique_lock lock(mutex_);
+        if (priming_ && !stopping_)
+            Enqueue(tag);
+    }
+
+    bool SendHeaders(RtmpPublisher& publisher)
+    {
+        auto venc = obs_output_get_video_encoder(output_);
+        auto aenc = obs_output_get_audio_encoder(output_, 0);
+
+        std::vector<std::pair<std::string, double>> metadata;
+        if (venc) {
+            metadata.emplace_back("width", obs_encoder_get_width(venc));
+            metadata.emplace_back("height", obs_encoder_get_height(venc));
+            if (auto video = obs_encoder_video(venc))
+                metadata.emplace_back("framerate", video_output_get_frame_rate(video) / std::max<uint32_t>(obs_encoder_get_frame_rate_divisor(venc), 1));
+            metadata.emplace_back("videocodecid", 7);
+            auto settings = obs_encoder_get_settings(venc);
+            metadata.emplace_back("videodatarate", static_cast<double>(obs_data_get_int(settings, "bitrate")));
+            obs_data_release(settings);
+        }
+        if (aenc) {
+            metadata.emplace_back("audiocodecid", 10);
+            metadata.emplace_back("audiosamplerate", obs_encoder_get_sample_rate(aenc));
+            if (auto audio = obs_encoder_audio(aenc))
+                metadata.emplace_back("audiochannels", audio_output_get_channels(audio));
+            auto settings = obs_encoder_get_settings(aenc);
+            metadata.emplace_back("audiodatarate", static_cast<double>(obs_data_get_int(settings, "bitrate")));
+            obs_data_release(settings);
+        }
+        if (!publisher.SendMetadata(metadata))
+            return false;
+
+        uint8_t* extra = nullptr;
+        size_t extraSize = 0;
+        if (venc && obs_encoder_get_extra_data(venc, &extra, &extraSize)) {
+            uint8_t* header = nullptr;
+            auto headerSize = obs_parse_avc_header(&header, extra, extraSize);
+            std::vector<uint8_t> body = { 0x17, 0x00, 0x00, 0x00, 0x00 };
+            body.insert(body.end(), header, header + headerSize);
+            bfree(header);
+            if (!publisher.Send(RtmpPublisher::Video, 0, body.data(), body.size()))
+                return false;
+        }
+        if (aenc && obs_encoder_get_extra_data(aenc, &extra, &extraSize)) {
+            std::vector<uint8_t> body = { 0xAF, 0x00 };
+            body.insert(body.end(), extra, extra + extraSize);
+            if (!publisher.Send(RtmpPublisher::Audio, 0, body.data(), body.size()))
+                return false;
+        }
+        return true;
+    }
+
+    void Run()
+    {
+        bool stopRequested;
+        {
+            std::unique_lock lock(mutex_);
+            publisher_ = CreateRtmpPublisher();
+            publisher_->SetBindAddress(bindIp_);
+            stopRequested = stopping_;
+        }
+
+        std::string error;
+        auto begin = os_gettime_ns();
+        bool connected = !stopRequested && publisher_->Connect(url_, key_, kConnectTimeoutMs, error);
+        connectTimeMs_ = static_cast<int>((os_gettime_ns() - begin) / 1000000);
+
+        if (!connected) {
+            GetGopCache()->Detach(gopId_);
+            std::unique_lock lock(mutex_);
+            publisher_.reset();
+            workerRunning_ = false;
+            bool stopping = stopping_;
+            lock.unlock();
+
+            if (!stopping)
+                blog(LOG_WARNING, TAG "Fan-out output failed to connect: %s", error.c_str());
+            obs_output_signal_stop(output_, stopping ? OBS_OUTPUT_SUCCESS : OBS_OUTPUT_CONNECT_FAILED);
+            return;
+        }
+
+        blog(LOG_INFO, TAG "Fan-out output connected in %d ms", connectTimeMs_.load());
+
+        // on an encoder that is already running, start with its current GOP instead of waiting for the next keyframe
+        {
+            std::unique_lock lock(mutex_);
+            priming_ = true;
+        }
+        auto primed = GetGopCache()->Follow(gopId_, [this](const FlvTagPtr& tag) { OnSharedTag(tag); });
+        if (primed > 0) {
+            blog(LOG_INFO, TAG "Fan-out output primed with %d tags from the GOP cache", static_cast<int>(primed));
+        } else {
+            std::unique_lock lock(mutex_);
+            priming_ = false;
+        }
+
+        active_ = true;
+        obs_output_begin_data_capture(output_, 0);
+
+        auto& publisherRef = *publisher_;
+        bool sentHeaders = false;
+        bool sentFirstFrame = false;
+        int code = OBS_OUTPUT_DISCONNECTED;
+        auto lastPoll = Clock::now();
+
+        std::unique_lock lock(mutex_);
+        for (;;) {
+            cv_.wait_for(lock, kPollInterval, [this]() { return !queue_.empty() || stopping_ || encodeError_; });
+            if (encodeError_) {
+                code = OBS_OUTPUT_ENCODE_ERROR;
+                break;
+            }
+            if (overflowed_) {
+                blog(LOG_WARNING, TAG "Fan-out output queue exceeded %d MB, disconnecting",
+                    static_cast<int>(maxQueueBytes_ / (1024 * 1024)));
+                break;
+            }
+            if (stopping_ && stopTsUsec_ == 0)
+                break;
+            if (stopping_ && Clock::now() >= stopDeadline_) {
+                // a stalled ingest also skips the unpublish handshake in Close
+                if (!queue_.empty()) {
+                    blog(LOG_WARNING, TAG "Fan-out output did not drain within %d s, closing",
+                        static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(kShutdownTimeout).count()));
+                    publisherRef.Abort();
+                }
+                break;
+            }
+
+            if (Clock::now() - lastPoll >= kPollInterval) {
+                lastPoll = Clock::now();
+                lock.unlock();
+                bool alive = publisherRef.Poll();
+                lock.lock();
+                if (!alive)
+                    break;
+            }
+
+            if (queue_.empty())
+                continue;
+
+            auto item = std::move(queue_.front());
+            queue_.pop_front();
+            queuedBytes_ -= item.tag->body.size();
+            if (stopping_ && item.tag->sysDtsUsec >= static_cast<int64_t>(stopTsUsec_))
+                break;
+            lock.unlock();
+
+            bool ok = sentHeaders || SendHeaders(publisherRef);
+            sentHeaders = true;
+            ok = ok && publisherRef.Send(item.tag->video ? RtmpPublisher::Video : RtmpPublisher::Audio,
+                item.timestamp, item.tag->body.data(), item.tag->body.size());
+            totalBytes_ = publisherRef.BytesSent();
+
+            if (ok && item.tag->video && !sentFirstFrame) {
+                sentFirstFrame = true;
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime_).count();
+                blog(LOG_INFO, TAG "Fan-out output sent its first frame %d ms after start (%s)",
+                    static_cast<int>(ms), primed > 0 ? "from the GOP cache" : "waited for a keyframe");
+            }
+
+            lock.lock();
+            if (!ok)
+                break;
+        }
+
+        active_ = false;
+        priming_ = false;
+        queue_.clear();
+        queuedBytes_ = 0;
+        lock.unlock();
+
+        GetGopCache()->Unfollow(gopId_);
+        GetGopCache()->Detach(gopId_);
+
+        publisherRef.Close();
+        uint64_t serialized = 0, reused = 0;
+        GetFlvTagCache()->GetStats(serialized, reused);
+        blog(LOG_INFO, TAG "Fan-out output sent %llu bytes, dropped %llu packets (%llu bytes); FLV tags serialized %llu, reused %llu",
+            (unsigned long long)totalBytes_.load(), (unsigned long long)droppedPackets_.load(), (unsigned long long)droppedBytes_.load(),
+            (unsigned long long)serialized, (unsigned long long)reused);
+
+        lock.lock();
+        publisher_.reset();
+        workerRunning_ = false;
+        bool stopping = stopping_;
+        lock.unlock();
+
+        if (stopping) {
+            obs_output_end_data_capture(output_);
+        } else {
+            blog(LOG_WARNING, TAG "Fan-out output disconnected");
+            obs_output_signal_stop(output_, code);
+        }
+    }
+
+    void JoinWorker()
+    {
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+public:
+    FanoutOutput(obs_data_t* settings, obs_output_t* output)
+        : output_(output)
+    {
+        Update(settings);
+        proc_handler_add(obs_output_get_proc_handler(output), "void get_queue_high_water(out int bytes)",
+            [](void* data, calldata_t* cd) {
+                calldata_set_int(cd, "bytes", static_cast<long long>(static_cast<FanoutOutput*>(data)->QueueHighWater()));
+            }, this);
+    }
+
+    ~FanoutOutput()
+    {
+        {
+            std::unique_lock lock(mutex_);
+            stopping_ = true;
+            if (publisher_)
+                publisher_->Abort();
+        }
+        cv_.notify_all();
+        JoinWorker();
+    }
+
+    void Update(obs_data_t* settings)
+    {
+        auto maxQueueMb = std::max<long long>(obs_data_get_int(settings, "max_queue_mb"), 1);
+        std::string policy = obs_data_get_string(settings, "drop_policy");
+        // same convention as rtmp_output
+        std::string bindIp = obs_data_get_string(settings, "bind_ip");
+
+        std::unique_lock lock(mutex_);
+        bindIp_ = bindIp == "default" ? std::string() : bindIp;
+        maxQueueBytes_ = static_cast<size_t>(maxQueueMb) * 1024 * 1024;
+        if (policy == "nonref")
+            dropPolicy_ = DropPolicy::NonReference;
+        else if (policy == "disconnect")
+            dropPolicy_ = DropPolicy::Disconnect;
+        else
+            dropPolicy_ = DropPolicy::Keyframe;
+    }
+
+    bool Start()
+    {
+        if (!obs_output_can_begin_data_capture(output_, 0))
+            return false;
+        if (!obs_output_initialize_encoders(output_, 0))
+            return false;
+
+        auto service = obs_output_get_service(output_);
+        if (!service)
+            return false;
+        auto url = obs_service_get_connect_info(service, OBS_SERVICE_CONNECT_INFO_SERVER_URL);
+        auto key = obs_service_get_connect_info(service, OBS_SERVICE_CONNECT_INFO_STREAM_KEY);
+        url_ = url ? url : "";
+        key_ = key ? key : "";
+
+        // a previous attempt has signalled its stop before a reconnect starts us again
+        JoinWorker();
+
+        {
+            std::unique_lock lock(mutex_);
+            workerRunning_ = true;
+            stopping_ = false;
+            encodeError_ = false;
+            stopTsUsec_ = 0;
+            haveBase_ = false;
+            lastSysDtsUsec_[0] = lastSysDtsUsec_[1] = INT64_MIN;
+            priming_ = false;
+            queue_.clear();
+            queuedBytes_ = 0;
+            waitForKeyframe_ = false;
+            overflowed_ = false;
+        }
+        totalBytes_ = 0;
+        connectTimeMs_ = 0;
+        droppedBytes_ = 0;
+        droppedPackets_ = 0;
+        droppedFrames_ = 0;
+        startTime_ = Clock::now();
+        gopId_ = GetGopCache()->Attach(obs_output_get_video_encoder(output_), obs_output_get_audio_encoder(output_, 0));
+        worker_ = std::thread([this]() { Run(); });
+        return true;
+    }
+
+    void Stop(uint64_t ts)
+    {
+        bool running;
+        {
+            std::unique_lock lock(mutex_);
+            if (stopping_ && ts != 0)
+                return;
+            stopping_ = true;
+            stopTsUsec_ = ts / 1000;
+            stopDeadline_ = Clock::now() + kShutdownTimeout;
+            // nothing to drain while connecting, and a forced stop must not wait on the network
+            if (publisher_ && (!active_ || ts == 0))
+                publisher_->Abort();
+            running = workerRunning_;
+        }
+        cv_.notify_all();
+
+        if (!running)
+            obs_output_signal_stop(output_, OBS_OUTPUT_SUCCESS);
+    }
+
+    void OnPacket(encoder_packet* packet)
+    {
+        if (!packet) {
+            std::unique_lock lock(mutex_);
+            encodeError_ = true;
+            cv_.notify_all();
+            return;
+        }
+
+        if (!active_)
+            return;
+
+        auto tag = GetFlvTagCache()->Get(packet);
+        GetGopCache()->Push(gopId_, tag);
+
+        bool caughtUp = false;
+        {
+            std::unique_lock lock(mutex_);
+            if (stopping_ && stopTsUsec_ == 0)
+                return;
+            // libobs starts our video at a keyframe, from here on our own packets are complete
+            if (priming_ && tag->video) {
+                priming_ = false;
+                caughtUp = true;
+            }
+            Enqueue(std::move(tag));
+        }
+        if (caughtUp)
+            GetGopCache()->Unfollow(gopId_);
+    }
+
+    uint64_t TotalBytes() const { return totalBytes_; }
+
+    size_t QueueHighWater()
+    {
+        std::unique_lock lock(mutex_);
+        return queueHighWater_;
+    }
+    int ConnectTimeMs() const { return connectTimeMs_; }
+    int DroppedFrames() const { return droppedFrames_; }
+
+    float Congestion()
+    {
+        std::unique_lock lock(mutex_);
+        return std::min(static_cast<float>(queuedBytes_) / static_cast<float>(maxQueueBytes_), 1.0f);
+    }
+};
+
+void RegisterFanoutOutput()
+{
+    obs_output_info info = {};
+    info.id = FANOUT_OUTPUT_ID;
+    info.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE;
+    info.encoded_video_codecs = "h264";
+    info.encoded_audio_codecs = "aac";
+    info.protocols = "RTMP";
+    info.get_name = [](void*) -> const char* {
+        return obs_module_text("Output.Fanout");
+    };
+    info.create = [](obs_data_t* settings, obs_output_t* output) -> void* {
+        return new FanoutOutput(settings, output);
+    };
+    info.update = [](void* data, obs_data_t* settings) {
+        static_cast<FanoutOutput*>(data)->Update(settings);
+    };
+    info.get_defaults = [](obs_data_t* settings) {
+        obs_data_set_default_int(settings, "max_queue_mb", kDefaultMaxQueueMb);
+        obs_data_set_default_string(settings, "drop_policy", "keyframe");
+        obs_data_set_default_string(settings, "bind_ip", "default");
+    };
+    info.get_properties = [](void*) -> obs_properties_t* {
+        auto props = obs_properties_create();
+        obs_properties_add_int(props, "max_queue_mb", obs_module_text("Fanout.MaxQueue"), 1, 1024, 1);
+        auto policy = obs_properties_add_list(props, "drop_policy", obs_module_text("Fanout.DropPolicy"),
+            OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+        obs_property_list_add_string(policy, obs_module_text("Fanout.DropPolicy.Keyframe"), "keyframe");
+        obs_property_list_add_string(policy, obs_module_text("Fanout.DropPolicy.NonReference"), "nonref");
+        obs_property_list_add_string(policy, obs_module_text("Fanout.DropPolicy.Disconnect"), "disconnect");
+        return props;
+    };
+    info.destroy = [](void* data) {
+        delete static_cast<FanoutOutput*>(data);
+    };
+    info.start = [](void* data) -> bool {
+        return static_cast<FanoutOutput*>(data)->Start();
+    };
+    info.stop = [](void* data, uint64_t ts) {
+        static_cast<FanoutOutput*>(data)->Stop(ts);
+    };
+    info.encoded_packet = [](void* data, encoder_packet* packet) {
+        static_cast<FanoutOutput*>(data)->OnPacket(packet);
+    };
+    info.get_total_bytes = [](void* data) -> uint64_t {
+        return static_cast<FanoutOutput*>(data)->TotalBytes();
+    };
+    info.get_connect_time_ms = [](void* data) -> int {
+        return static_cast<FanoutOutput*>(data)->ConnectTimeMs();
+    };
+    info.get_dropped_frames = [](void* data) -> int {
+        return static_cast<FanoutOutput*>(data)->DroppedFrames();
+    };
+    info.get_congestion = [](void* data) -> float {
+        return static_cast<FanoutOutput*>(data)->Congestion();
+    };
+    obs_register_output(&info);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// RTMP output whose FLV tags are serialized once and shared by every target
+// using the same encoders; each target keeps its own connection and send queue.
+#define FANOUT_OUTPUT_ID "multi_rtmp_fanout_output"
+
+void RegisterFanoutOutput();
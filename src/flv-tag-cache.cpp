@@ -0,0 +1,124 @@
+#include "flv-tag-cache.h"
+#include "pch.h"
+
+#include <obs-avc.h>
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+
+// A few seconds of packets; outputs receive a packet within microseconds of each other.
+static const size_t kCacheCapacity = 1024;
+
+static int64_t PacketMs(const encoder_packet* packet, int64_t value)
+{
+    return value * 1000 * packet->timebase_num / packet->timebase_den;
+}
+
+class FlvTagCacheImpl : public FlvTagCache {
+    struct Key {
+        const void* encoder;
+        int64_t sysDtsUsec;
+        size_t size;
+        size_t track;
+        int type;
+
+        bool operator==(const Key& other) const
+        {
+            return encoder == other.encoder && sysDtsUsec == other.sysDtsUsec && size == other.size
+                && track == other.track && type == other.type;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            auto h = std::hash<const void*>()(key.encoder);
+            h ^= std::hash<int64_t>()(key.sysDtsUsec) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            h ^= key.size + (key.track << 1) + (size_t(key.type) << 2);
+            return h;
+        }
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<Key, FlvTagPtr, KeyHash> tags_;
+    std::deque<Key> order_;
+    std::atomic<uint64_t> serialized_ = 0;
+    std::atomic<uint64_t> reused_ = 0;
+
+    static FlvTagPtr Serialize(const encoder_packet* packet)
+    {
+        auto tag = std::make_shared<FlvTag>();
+        tag->video = packet->type == OBS_ENCODER_VIDEO;
+        tag->sysDtsUsec = packet->sys_dts_usec;
+        tag->dropPriority = packet->drop_priority;
+
+        auto& body = tag->body;
+        if (tag->video) {
+            encoder_packet avc = {};
+            obs_parse_avc_packet(&avc, packet);
+
+            auto cts = static_cast<int32_t>(PacketMs(packet, packet->pts - packet->dts));
+            tag->keyframe = avc.keyframe;
+            tag->dropPriority = avc.drop_priority;
+            body.reserve(5 + avc.size);
+            body.push_back(avc.keyframe ? 0x17 : 0x27);
+            body.push_back(0x01);
+            body.push_back(uint8_t(cts >> 16));
+            body.push_back(uint8_t(cts >> 8));
+            body.push_back(uint8_t(cts));
+            body.insert(body.end(), avc.data, avc.data + avc.size);
+            obs_encoder_packet_release(&avc);
+        } else {
+            tag->keyframe = true;
+            body.reserve(2 + packet->size);
+            body.push_back(0xAF);
+            body.push_back(0x01);
+            body.insert(body.end(), packet->data, packet->data + packet->size);
+        }
+        return tag;
+    }
+
+public:
+    FlvTagPtr Get(const encoder_packet* packet) override
+    {
+        Key key{ packet->encoder, packet->sys_dts_usec, packet->size, packet->track_idx, static_cast<int>(packet->type) };
+        {
+            std::unique_lock lock(mutex_);
+            auto it = tags_.find(key);
+            if (it != tags_.end()) {
+                ++reused_;
+                return it->second;
+            }
+        }
+
+        auto tag = Serialize(packet);
+
+        std::unique_lock lock(mutex_);
+        auto [it, inserted] = tags_.emplace(key, tag);
+        if (!inserted) {
+            ++reused_;
+            return it->second;
+        }
+        ++serialized_;
+        order_.push_back(key);
+        while (order_.size() > kCacheCapacity) {
+            tags_.erase(order_.front());
+            order_.pop_front();
+        }
+        return tag;
+    }
+
+    void GetStats(uint64_t& serialized, uint64_t& reused) override
+    {
+        serialized = serialized_;
+        reused = reused_;
+    }
+};
+
+FlvTagCache* GetFlvTagCache()
+{
+    static FlvTagCacheImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+struct encoder_packet;
+
+// FLV tag body of one encoded packet: the bytes after the 11 byte tag header,
+// which are identical for every destination receiving the packet. Timestamps
+// are not part of it since each output rebases them to its own start.
+struct FlvTag {
+    std::vector<uint8_t> body;
+    int64_t sysDtsUsec = 0;
+    bool video = false;
+    bool keyframe = false;
+    int dropPriority = 0;
+};
+using FlvTagPtr = std::shared_ptr<const FlvTag>;
+
+// Outputs sharing an encoder each get their own copy of a packet, with the
+// timestamps shifted by the output's offset. The encoder and the system
+// timestamp of the frame still identify it, so the tag is serialized once.
+class FlvTagCache {
+public:
+    virtual ~FlvTagCache() {}
+    // H.264 and AAC only.
+    virtual FlvTagPtr Get(const encoder_packet* packet) = 0;
+    virtual void GetStats(uint64_t& serialized, uint64_t& reused) = 0;
+};
+
+FlvTagCache* GetFlvTagCache();
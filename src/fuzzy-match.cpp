@@ -0,0 +1,138 @@
+#include "fuzzy-match.h"
+
+#include <algorithm>
+#include <climits>
+
+std::string ToLowerAscii(std::string_view text)
+{
+    std::string result(text);
+    for (auto& c : result) {
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+    return result;
+}
+
+static int ScalarEditDistance(std::string_view s1, std::string_view s2)
+{
+    const size_t m = s1.size();
+    const size_t n = s2.size();
+    if (m == 0) return static_cast<int>(n);
+    if (n == 0) return static_cast<int>(m);
+
+    std::vector<int> costs(n + 1);
+    for (size_t i = 0; i <= n; ++i) {
+        costs[i] = static_cast<int>(i);
+    }
+
+    for (size_t i = 0; i < m; ++i) {
+        costs[0] = static_cast<int>(i + 1);
+        int corner = static_cast<int>(i);
+        for (size_t j = 0; j < n; ++j) {
+            int upper = costs[j + 1];
+            costs[j + 1] = std::min({ costs[j] + 1, upper + 1, corner + (s1[i] == s2[j] ? 0 : 1) });
+            corner = upper;
+        }
+    }
+    return costs[n];
+}
+
+int EditDistance(std::string_view pattern, std::string_view text, int maxDistance)
+{
+    const size_t m = pattern.size();
+    const size_t n = text.size();
+    if (m == 0) return static_cast<int>(n);
+    if (n == 0) return static_cast<int>(m);
+
+    auto lengthGap = static_cast<int>(m > n ? m - n : n - m);
+    if (lengthGap > maxDistance)
+        return lengthGap;
+
+    if (m > 64)
+        return ScalarEditDistance(pattern, text);
+
+    // Myers / Hyyro: column-wise bit vectors of vertical deltas, one bit per pattern char.
+    uint64_t peq[256] = {};
+    for (size_t i = 0; i < m; ++i)
+        peq[static_cast<unsigned char>(pattern[i])] |= uint64_t(1) << i;
+
+    const uint64_t highBit = uint64_t(1) << (m - 1);
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    int score = static_cast<int>(m);
+
+    for (size_t j = 0; j < n; ++j) {
+        uint64_t eq = peq[static_cast<unsigned char>(text[j])];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        if (ph & highBit)
+            ++score;
+        else if (mh & highBit)
+            --score;
+
+        // the first row grows by one per text char
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        // the score can drop by at most one per remaining char
+        auto remaining = static_cast<int>(n - j - 1);
+        if (score - remaining > maxDistance)
+            return score - remaining;
+    }
+
+    return score;
+}
+
+void FuzzyMatcher::Reserve(size_t count, size_t totalLength)
+{
+    spans_.reserve(count);
+    text_.reserve(totalLength);
+}
+
+size_t FuzzyMatcher::Add(std::string_view name)
+{
+    Span span{ static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(name.size()) };
+    for (auto c : name)
+        text_.push_back((c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c);
+    spans_.push_back(span);
+    return spans_.size() - 1;
+}
+
+void FuzzyMatcher::Clear()
+{
+    text_.clear();
+    spans_.clear();
+}
+
+std::optional<FuzzyMatcher::Match> FuzzyMatcher::Best(std::string_view query) const
+{
+    auto pattern = ToLowerAscii(query);
+
+    std::optional<Match> best;
+    size_t bestLength = 0;
+    for (size_t i = 0; i < spans_.size(); ++i) {
+        auto candidate = Candidate(i);
+        if (candidate == pattern)
+            return Match{ i, 0 };
+
+        // an equal distance only wins with a longer candidate
+        int limit = INT_MAX;
+        if (best.has_value())
+            limit = candidate.size() > bestLength ? best->distance : best->distance - 1;
+        if (limit < 0)
+            continue;
+
+        int distance = EditDistance(pattern, candidate, limit);
+        if (distance > limit)
+            continue;
+
+        best = Match{ i, distance };
+        bestLength = candidate.size();
+    }
+    return best;
+}
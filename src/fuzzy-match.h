@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+// Case-insensitive nearest-name matcher over a fixed set of candidates.
+// Candidates are lowercased once into a single buffer; distances are computed
+// with Myers' bit-parallel edit distance and pruned by length bounds.
+class FuzzyMatcher {
+public:
+    struct Match {
+        size_t index;
+        int distance;
+    };
+
+    void Reserve(size_t count, size_t totalLength);
+    // returns the index of the added candidate
+    size_t Add(std::string_view name);
+    size_t Size() const { return spans_.size(); }
+    void Clear();
+
+    // Lowest edit distance wins, ties go to the longer candidate, then to the earlier one.
+    std::optional<Match> Best(std::string_view query) const;
+
+private:
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::string text_;
+    std::vector<Span> spans_;
+
+    std::string_view Candidate(size_t index) const { return { text_.data() + spans_[index].offset, spans_[index].length }; }
+};
+
+std::string ToLowerAscii(std::string_view text);
+// Edit distance between pattern and text, or any value above maxDistance once it is certain to exceed it.
+int EditDistance(std::string_view pattern, std::string_view text, int maxDistance);
@@ -0,0 +1,127 @@
+#include "gop-cache.h"
+#include "pch.h"
+
+#include <map>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+// a GOP longer than this is not worth replaying; the pair waits for the next keyframe instead
+static const size_t kMaxGopTags = 1500;
+static const size_t kMaxGopBytes = 32 * 1024 * 1024;
+
+class GopCacheImpl : public GopCache {
+    using PairKey = std::pair<const obs_encoder_t*, const obs_encoder_t*>;
+
+    struct Gop {
+        std::deque<FlvTagPtr> tags;
+        size_t bytes = 0;
+        bool complete = false;
+        // outputs push the same packets, each tag is kept once
+        int64_t lastSysDtsUsec[2] = { INT64_MIN, INT64_MIN };
+        int attached = 0;
+    };
+
+    struct Attachment {
+        PairKey key;
+        std::shared_ptr<Gop> gop;
+        Listener listener;
+    };
+
+    std::mutex mutex_;
+    std::map<PairKey, std::shared_ptr<Gop>> gops_;
+    std::unordered_map<uint64_t, Attachment> attachments_;
+    uint64_t nextId_ = 1;
+
+public:
+    uint64_t Attach(const obs_encoder_t* video, const obs_encoder_t* audio) override
+    {
+        std::unique_lock lock(mutex_);
+        auto key = PairKey{ video, audio };
+        auto& gop = gops_[key];
+        if (!gop)
+            gop = std::make_shared<Gop>();
+        ++gop->attached;
+
+        auto id = nextId_++;
+        attachments_[id] = Attachment{ key, gop, nullptr };
+        return id;
+    }
+
+    void Detach(uint64_t id) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = attachments_.find(id);
+        if (it == attachments_.end())
+            return;
+        if (--it->second.gop->attached == 0)
+            gops_.erase(it->second.key);
+        attachments_.erase(it);
+    }
+
+    void Push(uint64_t id, const FlvTagPtr& tag) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = attachments_.find(id);
+        if (it == attachments_.end())
+            return;
+
+        auto& gop = *it->second.gop;
+        auto& last = gop.lastSysDtsUsec[tag->video ? 1 : 0];
+        if (tag->sysDtsUsec <= last)
+            return;
+        last = tag->sysDtsUsec;
+
+        if (tag->video && tag->keyframe) {
+            gop.tags.clear();
+            gop.bytes = 0;
+            gop.complete = true;
+        }
+        if (!gop.complete)
+            return;
+
+        gop.tags.push_back(tag);
+        gop.bytes += tag->body.size();
+        if (gop.tags.size() > kMaxGopTags || gop.bytes > kMaxGopBytes) {
+            gop.tags.clear();
+            gop.bytes = 0;
+            gop.complete = false;
+        }
+
+        for (auto& [otherId, attachment] : attachments_) {
+            if (otherId != id && attachment.listener && attachment.gop == it->second.gop)
+                attachment.listener(tag);
+        }
+    }
+
+    size_t Follow(uint64_t id, Listener listener) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = attachments_.find(id);
+        if (it == attachments_.end())
+            return 0;
+
+        auto& gop = *it->second.gop;
+        if (!gop.complete || gop.tags.empty())
+            return 0;
+        for (auto& tag : gop.tags)
+            listener(tag);
+        it->second.listener = std::move(listener);
+        return gop.tags.size();
+    }
+
+    void Unfollow(uint64_t id) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = attachments_.find(id);
+        if (it != attachments_.end())
+            it->second.listener = nullptr;
+    }
+};
+
+GopCache* GetGopCache()
+{
+    static GopCacheImpl impl_;
+    return &impl_;
+}
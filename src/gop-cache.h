@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "flv-tag-cache.h"
+
+typedef struct obs_encoder obs_encoder_t;
+
+// The tags of the current GOP, from the last video keyframe on, of every
+// encoder pair used by running fan-out outputs. libobs holds back video from
+// an output that starts on a running encoder until the next keyframe; such an
+// output can instead be primed with the cached GOP and follow the tags other
+// outputs receive until its own packets catch up.
+class GopCache {
+public:
+    using Listener = std::function<void(const FlvTagPtr&)>;
+
+    virtual ~GopCache() {}
+    // The GOP of the pair is kept while at least one output is attached.
+    virtual uint64_t Attach(const obs_encoder_t* video, const obs_encoder_t* audio) = 0;
+    virtual void Detach(uint64_t id) = 0;
+    virtual void Push(uint64_t id, const FlvTagPtr& tag) = 0;
+    // Hands the cached GOP to the listener, then every tag other outputs push
+    // until Unfollow. The listener runs under the cache lock and must not call
+    // back into the cache. Returns the number of cached tags handed over.
+    virtual size_t Follow(uint64_t id, Listener listener) = 0;
+    virtual void Unfollow(uint64_t id) = 0;
+};
+
+GopCache* GetGopCache();
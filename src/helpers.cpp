@@ -1 +1,14 @@
 #include "helpers.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+std::string FormatBitrate(double bps)
+{
+    static const char* units[] = { "bps", "Kbps", "Mbps", "Gbps" };
+    int unitIndex = bps >= 1 ? std::min(static_cast<int>(log10(bps) / 3), 3) : 0;
+    char text[32] = { 0 };
+    snprintf(text, sizeof(text), "%.1f %s", bps / pow(1000, unitIndex), units[unitIndex]);
+    return text;
+}
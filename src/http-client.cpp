@@ -0,0 +1,416 @@
+#include "http-client.h"
+#include "pch.h"
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+static const char* const kUserAgentHeader =
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) "
+    "AppleWebKit/537.36 (KHTML, like Gecko) "
+    "StreamlabsDesktop/1.17.0 Chrome/122.0.6261.156 "
+    "Electron/29.3.1 Safari/537.36";
+
+class HttpClientImpl : public HttpClient {
+    // A pooled easy handle keeps the header list it was last used with, so the
+    // list is only rebuilt when the next request carries a different token.
+    struct Handle {
+        CURL* curl = nullptr;
+        std::string token;
+        curl_slist* headers = nullptr;
+    };
+
+    struct Transfer {
+        HttpRequestId id = 0;
+        HttpRequest request;
+        HttpCallback callback;
+        HttpResponse response;
+        Handle handle;
+        curl_mime* mime = nullptr;
+    };
+    using TransferPtr = std::unique_ptr<Transfer>;
+
+    CURLSH* share_ = nullptr;
+    std::mutex shareLocks_[CURL_LOCK_DATA_LAST];
+
+    static constexpr size_t kInitialBufferBytes = 16 * 1024;
+    static constexpr size_t kMaxPooledBufferBytes = 1024 * 1024;
+    // also bounds the cached header lists
+    static constexpr size_t kMaxIdleHandles = 16;
+
+    // touched only by the event loop thread
+    CURLM* multi_ = nullptr;
+    std::vector<Handle> idleHandles_;
+    std::vector<std::string> idleBuffers_;
+    std::unordered_map<HttpRequestId, TransferPtr> active_;
+
+    // handed over to the event loop thread
+    std::mutex queueMutex_;
+    std::vector<TransferPtr> submitted_;
+    std::vector<HttpRequestId> cancelled_;
+    bool stopping_ = false;
+
+    std::atomic<HttpRequestId> nextId_ = 1;
+    std::once_flag startOnce_;
+    std::thread loop_;
+
+
+    std::mutex escapeMutex_;
+    CURL* escapeHandle_ = nullptr;
+
+    static void LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userp)
+    {
+        static_cast<HttpClientImpl*>(userp)->shareLocks_[data].lock();
+    }
+
+    static void UnlockShare(CURL*, curl_lock_data data, void* userp)
+    {
+        static_cast<HttpClientImpl*>(userp)->shareLocks_[data].unlock();
+    }
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+    {
+        size_t totalBytes = size * nmemb;
+        auto transfer = static_cast<Transfer*>(userp);
+        auto& body = transfer->response.body;
+        if (body.size() + totalBytes > transfer->request.maxResponseBytes)
+            return 0;
+        body.append(static_cast<char*>(contents), totalBytes);
+        return totalBytes;
+    }
+
+    std::string AcquireBuffer()
+    {
+        std::string buffer;
+        if (!idleBuffers_.empty()) {
+            buffer.swap(idleBuffers_.back());
+            idleBuffers_.pop_back();
+        } else {
+            buffer.reserve(kInitialBufferBytes);
+        }
+        return buffer;
+    }
+
+    void ReleaseBuffer(std::string& buffer)
+    {
+        if (buffer.capacity() < kInitialBufferBytes || buffer.capacity() > kMaxPooledBufferBytes)
+            return;
+        buffer.clear();
+        idleBuffers_.emplace_back(std::move(buffer));
+    }
+
+    static curl_slist* BuildHeaders(const std::string& token)
+    {
+        curl_slist* headers = nullptr;
+        if (!token.empty())
+            headers = curl_slist_append(headers, ("Authorization: Bearer " + token).c_str());
+        return curl_slist_append(headers, kUserAgentHeader);
+    }
+
+    static void FreeHandle(Handle& handle)
+    {
+        curl_easy_cleanup(handle.curl);
+        curl_slist_free_all(handle.headers);
+        handle = {};
+    }
+
+    Handle AcquireHandle(const std::string& token)
+    {
+        Handle handle;
+        if (!idleHandles_.empty()) {
+            // prefer the most recent handle that already carries this token
+            auto it = std::find_if(idleHandles_.rbegin(), idleHandles_.rend(), [&](auto& h) { return h.token == token; });
+            auto pos = it == idleHandles_.rend() ? idleHandles_.end() - 1 : std::next(it).base();
+            handle = std::move(*pos);
+            idleHandles_.erase(pos);
+        } else {
+            handle.curl = curl_easy_init();
+            if (!handle.curl)
+                return handle;
+            curl_easy_setopt(handle.curl, CURLOPT_SHARE, share_);
+        }
+
+        if (!handle.headers || handle.token != token) {
+            curl_slist_free_all(handle.headers);
+            handle.headers = BuildHeaders(token);
+            handle.token = token;
+        }
+        return handle;
+    }
+
+    void ReleaseHandle(Handle& handle)
+    {
+        if (idleHandles_.size() >= kMaxIdleHandles) {
+            FreeHandle(handle);
+            return;
+        }
+        // reset keeps live connections, session ids and the share attached
+        curl_easy_reset(handle.curl);
+        idleHandles_.emplace_back(std::move(handle));
+        handle = {};
+    }
+
+    void Complete(TransferPtr transfer, CURLcode result)
+    {
+        auto curl = transfer->handle.curl;
+        transfer->response.result = result;
+
+        if (curl) {
+            if (result == CURLE_OK) {
+                auto& response = transfer->response;
+                curl_off_t total = 0, appconnect = 0;
+                long connects = 0;
+                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+                curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+                curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+                curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+                response.totalMs = total / 1000.0;
+                response.tlsMs = appconnect / 1000.0;
+                response.cold = connects > 0;
+                blog(LOG_DEBUG, TAG "HTTP %ld in %.1f ms (%s connection, tls %.1f ms)", response.status,
+                     response.totalMs, response.cold ? "cold" : "warm", response.tlsMs);
+            }
+            ReleaseHandle(transfer->handle);
+        }
+
+        if (transfer->mime) {
+            curl_mime_free(transfer->mime);
+            transfer->mime = nullptr;
+        }
+
+        if (transfer->callback)
+            transfer->callback(transfer->response);
+
+        ReleaseBuffer(transfer->response.body);
+    }
+
+    void Start(TransferPtr transfer)
+    {
+        auto& request = transfer->request;
+
+        transfer->handle = AcquireHandle(request.bearerToken);
+        auto curl = transfer->handle.curl;
+        if (!curl) {
+            Complete(std::move(transfer), CURLE_FAILED_INIT);
+            return;
+        }
+        transfer->response.body = AcquireBuffer();
+
+        curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->handle.headers);
+        if (!request.caFile.empty())
+            curl_easy_setopt(curl, CURLOPT_CAINFO, request.caFile.c_str());
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 30L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, request.timeoutMs);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &HttpClientImpl::WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+
+        if (!request.formFields.empty()) {
+            transfer->mime = curl_mime_init(curl);
+            for (auto& [name, value] : request.formFields) {
+                curl_mimepart* part = curl_mime_addpart(transfer->mime);
+                curl_mime_name(part, name.c_str());
+                curl_mime_data(part, value.c_str(), value.size());
+            }
+            curl_easy_setopt(curl, CURLOPT_MIMEPOST, transfer->mime);
+        } else if (request.post) {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
+        }
+
+        auto mc = curl_multi_add_handle(multi_, curl);
+        if (mc != CURLM_OK) {
+            blog(LOG_WARNING, TAG "HTTP: curl_multi_add_handle failed: %s", curl_multi_strerror(mc));
+            Complete(std::move(transfer), CURLE_FAILED_INIT);
+            return;
+        }
+
+        auto id = transfer->id;
+        active_.emplace(id, std::move(transfer));
+    }
+
+    void Finish(HttpRequestId id, CURLcode result)
+    {
+        auto it = active_.find(id);
+        if (it == active_.end())
+            return;
+
+        auto transfer = std::move(it->second);
+        active_.erase(it);
+        curl_multi_remove_handle(multi_, transfer->handle.curl);
+        Complete(std::move(transfer), result);
+    }
+
+    void Run()
+    {
+        for (;;) {
+            std::vector<TransferPtr> submitted;
+            std::vector<HttpRequestId> cancelled;
+            bool stopping;
+            {
+                std::unique_lock lock(queueMutex_);
+                submitted.swap(submitted_);
+                cancelled.swap(cancelled_);
+                stopping = stopping_;
+            }
+
+            for (auto& transfer : submitted) {
+                if (stopping)
+                    Complete(std::move(transfer), CURLE_ABORTED_BY_CALLBACK);
+                else
+                    Start(std::move(transfer));
+            }
+            for (auto id : cancelled)
+                Finish(id, CURLE_ABORTED_BY_CALLBACK);
+
+            if (stopping) {
+                while (!active_.empty())
+                    Finish(active_.begin()->first, CURLE_ABORTED_BY_CALLBACK);
+                break;
+            }
+
+            int running = 0;
+            curl_multi_perform(multi_, &running);
+
+            int pending = 0;
+            while (auto msg = curl_multi_info_read(multi_, &pending)) {
+                if (msg->msg != CURLMSG_DONE)
+                    continue;
+                Transfer* transfer = nullptr;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+                if (transfer)
+                    Finish(transfer->id, msg->data.result);
+            }
+
+            curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+        }
+    }
+
+    void EnsureStarted()
+    {
+        std::call_once(startOnce_, [this]() { loop_ = std::thread([this]() { Run(); }); });
+    }
+
+public:
+    HttpClientImpl()
+    {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        share_ = curl_share_init();
+        if (share_) {
+            curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &HttpClientImpl::LockShare);
+            curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &HttpClientImpl::UnlockShare);
+            curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+            // connections are not shared, the multi handle already keeps them in its own cache
+            curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+
+        multi_ = curl_multi_init();
+        escapeHandle_ = curl_easy_init();
+    }
+
+    ~HttpClientImpl()
+    {
+        Shutdown();
+
+        for (auto& handle : idleHandles_)
+            FreeHandle(handle);
+        idleHandles_.clear();
+
+        if (escapeHandle_)
+            curl_easy_cleanup(escapeHandle_);
+        if (multi_)
+            curl_multi_cleanup(multi_);
+        if (share_)
+            curl_share_cleanup(share_);
+    }
+
+    HttpRequestId Submit(const HttpRequest& request, HttpCallback callback) override
+    {
+        auto transfer = std::make_unique<Transfer>();
+        transfer->id = nextId_++;
+        transfer->request = request;
+        transfer->callback = std::move(callback);
+        auto id = transfer->id;
+
+        {
+            std::unique_lock lock(queueMutex_);
+            if (stopping_ || !multi_) {
+                lock.unlock();
+                transfer->response.result = CURLE_ABORTED_BY_CALLBACK;
+                if (transfer->callback)
+                    transfer->callback(transfer->response);
+                return id;
+            }
+            submitted_.emplace_back(std::move(transfer));
+        }
+
+        EnsureStarted();
+        curl_multi_wakeup(multi_);
+        return id;
+    }
+
+    void Cancel(HttpRequestId id) override
+    {
+        {
+            std::unique_lock lock(queueMutex_);
+            cancelled_.push_back(id);
+        }
+        curl_multi_wakeup(multi_);
+    }
+
+    std::string Escape(const std::string& text) override
+    {
+        std::unique_lock lock(escapeMutex_);
+        if (!escapeHandle_)
+            return {};
+
+        std::string result;
+        char* escaped = curl_easy_escape(escapeHandle_, text.c_str(), static_cast<int>(text.length()));
+        if (escaped) {
+            result = escaped;
+            curl_free(escaped);
+        }
+        return result;
+    }
+
+    void Shutdown() override
+    {
+        {
+            std::unique_lock lock(queueMutex_);
+            if (stopping_)
+                return;
+            stopping_ = true;
+        }
+
+        // make sure no thread gets started after this point
+        std::call_once(startOnce_, []() {});
+        if (loop_.joinable()) {
+            curl_multi_wakeup(multi_);
+            loop_.join();
+        }
+
+        // anything submitted while the loop was never started
+        std::vector<TransferPtr> submitted;
+        {
+            std::unique_lock lock(queueMutex_);
+            submitted.swap(submitted_);
+        }
+        for (auto& transfer : submitted)
+            Complete(std::move(transfer), CURLE_ABORTED_BY_CALLBACK);
+    }
+};
+
+HttpClient* GetHttpClient()
+{
+    static HttpClientImpl impl_;
+    return &impl_;
+}
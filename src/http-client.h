@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <future>
+#include <functional>
+#include <cstdint>
+#include <curl/curl.h>
+
+struct HttpRequest {
+    std::string url;
+    std::string bearerToken;
+    bool post = false;
+    // sent as multipart/form-data, implies post
+    std::vector<std::pair<std::string, std::string>> formFields;
+    long timeoutMs = 15000;
+    // larger responses fail with CURLE_WRITE_ERROR
+    size_t maxResponseBytes = 4 * 1024 * 1024;
+    // PEM bundle to verify the server with instead of the system store, for local stand-ins
+    std::string caFile;
+};
+
+struct HttpResponse {
+    CURLcode result = CURLE_OK;
+    long status = 0;
+    std::string body;
+    // timings of a completed transfer; a cold one had to open a new connection
+    double totalMs = 0;
+    double tlsMs = 0;
+    bool cold = false;
+};
+
+using HttpRequestId = uint64_t;
+// Invoked on the client's event loop thread. Do not block in it.
+// The body buffer is recycled for later requests unless the callback moves it out.
+using HttpCallback = std::function<void(HttpResponse&)>;
+
+// Long-lived asynchronous HTTP client. A single event loop thread drives all
+// transfers through curl_multi; easy handles are pooled and kept alive between
+// calls and share the DNS / TLS session caches and the multi connection cache.
+class HttpClient {
+public:
+    virtual ~HttpClient() {}
+    virtual HttpRequestId Submit(const HttpRequest& request, HttpCallback callback) = 0;
+    // Completes the request with CURLE_ABORTED_BY_CALLBACK if it is still in flight.
+    virtual void Cancel(HttpRequestId id) = 0;
+    virtual std::string Escape(const std::string& text) = 0;
+    // Aborts everything in flight and stops the event loop thread.
+    virtual void Shutdown() = 0;
+
+    std::future<HttpResponse> PerformAsync(const HttpRequest& request)
+    {
+        auto promise = std::make_shared<std::promise<HttpResponse>>();
+        auto future = promise->get_future();
+        Submit(request, [promise](HttpResponse& response) { promise->set_value(std::move(response)); });
+        return future;
+    }
+
+    HttpResponse Perform(const HttpRequest& request) { return PerformAsync(request).get(); }
+};
+
+HttpClient* GetHttpClient();
@@ -0,0 +1,291 @@
+#include "metrics-server.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "pch.h"
+#include "stats-registry.h"
+#include "video-mix-cache.h"
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+// also how stale a scrape can be, the page is re-rendered once per tick at most
+static const int kPollIntervalMs = 100;
+static const int kRequestTimeoutMs = 1000;
+static const size_t kMaxRequestSize = 8192;
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static std::string EscapeLabel(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (auto c : value) {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+static std::string RenderMetrics(const std::vector<TargetHealth>& targets, int videoMixes)
+{
+    struct Family {
+        const char* name;
+        const char* type;
+        const char* help;
+        double (*value)(const TargetHealth&);
+    };
+    static const Family families[] = {
+        { "multi_rtmp_target_bytes_total", "counter", "Bytes sent since the target was started",
+            [](const TargetHealth& t) { return static_cast<double>(t.totalBytes); } },
+        { "multi_rtmp_target_frames_total", "counter", "Video frames sent since the target was started",
+            [](const TargetHealth& t) { return static_cast<double>(t.totalFrames); } },
+        { "multi_rtmp_target_dropped_frames_total", "counter", "Video frames dropped since the target was started",
+            [](const TargetHealth& t) { return static_cast<double>(t.droppedFrames); } },
+        { "multi_rtmp_target_reconnects_total", "counter", "Reconnect attempts since the target was started",
+            [](const TargetHealth& t) { return static_cast<double>(t.reconnects); } },
+        { "multi_rtmp_target_downtime_seconds_total", "counter", "Time spent reconnecting since the target was started",
+            [](const TargetHealth& t) { return t.downtimeMs / 1000.0; } },
+        { "multi_rtmp_target_live_seconds_total", "counter", "Connected time since the target was started",
+            [](const TargetHealth& t) { return t.liveMs / 1000.0; } },
+        { "multi_rtmp_target_congestion", "gauge", "Output congestion between 0 and 1",
+            [](const TargetHealth& t) { return static_cast<double>(t.congestion); } },
+        { "multi_rtmp_target_running", "gauge", "1 while the target's output is active",
+            [](const TargetHealth& t) { return t.running ? 1.0 : 0.0; } },
+        { "multi_rtmp_target_reconnecting", "gauge", "1 while the target is reconnecting",
+            [](const TargetHealth& t) { return t.reconnecting ? 1.0 : 0.0; } },
+        { "multi_rtmp_target_send_queue_peak_bytes", "gauge", "Peak send queue size of outputs that report it",
+            [](const TargetHealth& t) { return static_cast<double>(t.queueHighWater); } },
+        { "multi_rtmp_target_video_encoder_shared", "gauge", "1 when the video encoder also feeds other outputs",
+            [](const TargetHealth& t) { return t.videoEncoderShared ? 1.0 : 0.0; } },
+        { "multi_rtmp_target_audio_encoder_shared", "gauge", "1 when the audio encoder also feeds other outputs",
+            [](const TargetHealth& t) { return t.audioEncoderShared ? 1.0 : 0.0; } },
+    };
+
+    std::vector<std::string> labels;
+    labels.reserve(targets.size());
+    for (auto& target : targets)
+        labels.push_back("{id=\"" + EscapeLabel(target.id) + "\",name=\"" + EscapeLabel(target.name) + "\"} ");
+
+    std::string page;
+    page.reserve(256 + targets.size() * std::size(families) * 96);
+    char value[32];
+    for (auto& family : families) {
+        page += std::string("# HELP ") + family.name + " " + family.help + "\n";
+        page += std::string("# TYPE ") + family.name + " " + family.type + "\n";
+        for (size_t i = 0; i < targets.size(); ++i) {
+            snprintf(value, sizeof(value), "%.17g\n", family.value(targets[i]));
+            page += family.name;
+            page += labels[i];
+            page += value;
+        }
+    }
+
+    page += "# HELP multi_rtmp_video_mixes Scaled video mixes shared by dedicated video encoders\n"
+        "# TYPE multi_rtmp_video_mixes gauge\n"
+        "multi_rtmp_video_mixes " + std::to_string(videoMixes) + "\n";
+    return page;
+}
+
+class MetricsServerImpl : public MetricsServer {
+    std::mutex mutex_;
+    std::thread worker_;
+    std::atomic<bool> stop_ = false;
+    int port_ = 0;
+
+    SocketHandle Listen(int port)
+    {
+#ifdef _WIN32
+        static std::once_flag once;
+        std::call_once(once, []() {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        });
+#endif
+        auto s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == kInvalidSocket)
+            return kInvalidSocket;
+
+        int one = 1;
+#ifdef _WIN32
+        // SO_REUSEADDR on Windows would let bind succeed on a port another process listens on
+        setsockopt(s, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char*>(&one), sizeof(one));
+#else
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+#endif
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(s, 16) != 0) {
+            CloseSocket(s);
+            return kInvalidSocket;
+        }
+        return s;
+    }
+
+    static std::string PrepareResponse(const std::string& page)
+    {
+        return "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + std::to_string(page.size()) + "\r\nConnection: close\r\n\r\n" + page;
+    }
+
+    static void Serve(SocketHandle client, const std::string& prepared)
+    {
+#ifdef _WIN32
+        DWORD timeout = kRequestTimeoutMs;
+#else
+        timeval timeout = { kRequestTimeoutMs / 1000, (kRequestTimeoutMs % 1000) * 1000 };
+#endif
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+            auto received = ::recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                return;
+            request.append(buffer, static_cast<size_t>(received));
+        }
+
+        static const std::string notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        bool metrics = request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0;
+        auto& response = metrics ? prepared : notFound;
+
+#if defined(MSG_NOSIGNAL)
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        size_t offset = 0;
+        while (offset < response.size()) {
+            auto sent = ::send(client, response.data() + offset, static_cast<int>(response.size() - offset), flags);
+            if (sent <= 0)
+                return;
+            offset += static_cast<size_t>(sent);
+        }
+    }
+
+    void Run(SocketHandle listener)
+    {
+        uint64_t renderedVersion = UINT64_MAX;
+        int renderedMixes = -1;
+        std::string prepared;
+
+        while (!stop_) {
+            auto version = GetStatsRegistry()->Version();
+            auto mixes = GetVideoMixCache()->GetActiveMixCount();
+            if (version != renderedVersion || mixes != renderedMixes) {
+                prepared = PrepareResponse(RenderMetrics(GetStatsRegistry()->Snapshot(), mixes));
+                renderedVersion = version;
+                renderedMixes = mixes;
+            }
+
+#ifdef _WIN32
+            WSAPOLLFD pfd = { listener, POLLRDNORM, 0 };
+            int ret = WSAPoll(&pfd, 1, kPollIntervalMs);
+#else
+            pollfd pfd = { listener, POLLIN, 0 };
+            int ret = poll(&pfd, 1, kPollIntervalMs);
+            if (ret < 0 && errno == EINTR)
+                ret = 0;
+#endif
+            if (ret < 0)
+                break;
+            if (ret == 0)
+                continue;
+
+            auto client = ::accept(listener, nullptr, nullptr);
+            if (client == kInvalidSocket)
+                continue;
+            Serve(client, prepared);
+            CloseSocket(client);
+        }
+
+        CloseSocket(listener);
+    }
+
+    void StopLocked()
+    {
+        if (!worker_.joinable())
+            return;
+        stop_ = true;
+        worker_.join();
+        stop_ = false;
+        blog(LOG_INFO, TAG "Metrics endpoint on port %d stopped", port_);
+        port_ = 0;
+    }
+
+public:
+    ~MetricsServerImpl()
+    {
+        Stop();
+    }
+
+    bool Start(int port) override
+    {
+        std::unique_lock lock(mutex_);
+        if (worker_.joinable() && port_ == port)
+            return true;
+        StopLocked();
+
+        auto listener = Listen(port);
+        if (listener == kInvalidSocket) {
+            blog(LOG_WARNING, TAG "Cannot serve metrics on 127.0.0.1:%d", port);
+            return false;
+        }
+
+        port_ = port;
+        worker_ = std::thread([this, listener]() { Run(listener); });
+        blog(LOG_INFO, TAG "Serving metrics on http://127.0.0.1:%d/metrics", port);
+        return true;
+    }
+
+    void Stop() override
+    {
+        std::unique_lock lock(mutex_);
+        StopLocked();
+    }
+};
+
+MetricsServer* GetMetricsServer()
+{
+    static MetricsServerImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Serves the stats registry in the Prometheus text format on
+// http://127.0.0.1:<port>/metrics. The page is rebuilt on the server thread's
+// poll tick when the registry changed, so a scrape only sends the prepared text.
+class MetricsServer {
+public:
+    virtual ~MetricsServer() {}
+    // Restarts on a different port, no-op when already serving on this one.
+    virtual bool Start(int port) = 0;
+    virtual void Stop() = 0;
+};
+
+MetricsServer* GetMetricsServer();
@@ -0,0 +1,100 @@
+#include "null-output.h"
+#include "pch.h"
+
+#include <util/platform.h>
+
+#include <atomic>
+
+class NullOutput {
+    obs_output_t* output_;
+    std::atomic<bool> active_ = false;
+    std::atomic<uint64_t> totalBytes_ = 0;
+    std::atomic<uint64_t> videoPackets_ = 0;
+    std::atomic<uint64_t> audioPackets_ = 0;
+    uint64_t startNs_ = 0;
+
+public:
+    NullOutput(obs_output_t* output)
+        : output_(output)
+    {
+    }
+
+    bool Start()
+    {
+        if (!obs_output_can_begin_data_capture(output_, 0))
+            return false;
+        if (!obs_output_initialize_encoders(output_, 0))
+            return false;
+
+        totalBytes_ = 0;
+        videoPackets_ = 0;
+        audioPackets_ = 0;
+        startNs_ = os_gettime_ns();
+        active_ = true;
+        obs_output_begin_data_capture(output_, 0);
+        return true;
+    }
+
+    void Stop(uint64_t)
+    {
+        // nothing is buffered, so there is nothing to drain up to the stop timestamp
+        if (!active_.exchange(false))
+            return;
+
+        auto seconds = (os_gettime_ns() - startNs_) / 1000000000.0;
+        blog(LOG_INFO, TAG "Null output \"%s\" discarded %llu video and %llu audio packets, %llu bytes in %.1f s",
+            obs_output_get_name(output_),
+            (unsigned long long)videoPackets_.load(), (unsigned long long)audioPackets_.load(),
+            (unsigned long long)totalBytes_.load(), seconds);
+        obs_output_end_data_capture(output_);
+    }
+
+    void OnPacket(encoder_packet* packet)
+    {
+        if (!packet) {
+            obs_output_signal_stop(output_, OBS_OUTPUT_ENCODE_ERROR);
+            return;
+        }
+        if (!active_)
+            return;
+
+        totalBytes_.fetch_add(packet->size, std::memory_order_relaxed);
+        if (packet->type == OBS_ENCODER_VIDEO)
+            videoPackets_.fetch_add(1, std::memory_order_relaxed);
+        else
+            audioPackets_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t TotalBytes() const { return totalBytes_; }
+};
+
+void RegisterNullOutput()
+{
+    obs_output_info info = {};
+    info.id = NULL_OUTPUT_ID;
+    info.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+    info.encoded_video_codecs = "h264;hevc;av1";
+    info.encoded_audio_codecs = "aac;opus";
+    info.get_name = [](void*) -> const char* {
+        return obs_module_text("Output.Null");
+    };
+    info.create = [](obs_data_t*, obs_output_t* output) -> void* {
+        return new NullOutput(output);
+    };
+    info.destroy = [](void* data) {
+        delete static_cast<NullOutput*>(data);
+    };
+    info.start = [](void* data) -> bool {
+        return static_cast<NullOutput*>(data)->Start();
+    };
+    info.stop = [](void* data, uint64_t ts) {
+        static_cast<NullOutput*>(data)->Stop(ts);
+    };
+    info.encoded_packet = [](void* data, encoder_packet* packet) {
+        static_cast<NullOutput*>(data)->OnPacket(packet);
+    };
+    info.get_total_bytes = [](void* data) -> uint64_t {
+        return static_cast<NullOutput*>(data)->TotalBytes();
+    };
+    obs_register_output(&info);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Output that takes encoded packets and discards them, counting what it got.
+// Used to measure the encoding cost of N targets without a server.
+#define NULL_OUTPUT_ID "multi_rtmp_null_output"
+
+void RegisterNullOutput();
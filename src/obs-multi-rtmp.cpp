@@ -4,11 +4,32 @@
 #include <regex>
 #include <filesystem>
 #include <unordered_map>
+#include <QMenu>
+#include <QFileDialog>
+#include <QInputDialog>
+#include <util/platform.h>
 
 #include "push-widget.h"
+#include "helpers.h"
+#include "json-util.hpp"
+#include "burst-meter.h"
+#include "trace.h"
+#include "soak-collector.h"
+#include "metrics-server.h"
+#include "stats-shm.h"
+#include "control-socket.h"
+#include "control-api.h"
+#include "egress-widget.h"
 #include "plugin-support.h"
 
 #include "output-config.h"
+#include "http-client.h"
+#include "category-cache.h"
+#include "end-stream-queue.h"
+#include "fanout-output.h"
+#include "null-output.h"
+#include "egress-manager.h"
+#include "video-mix-cache.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -16,6 +37,9 @@
 
 #define ConfigSection "obs-multi-rtmp"
 
+// soak targets publish with this prefix followed by their id as the stream key
+static const char* kSoakKeyPrefix = "soak-";
+
 static class GlobalServiceImpl : public GlobalService
 {
 public:
@@ -95,7 +119,7 @@ private:
 };
 
 
-class MultiOutputWidget : public QWidget
+class MultiOutputWidget : public QWidget, public ControlHost
 {
 public:
     MultiOutputWidget(QWidget* parent = 0)
@@ -135,15 +159,105 @@ public:
         allBtnContainer->setLayout(allBtnLayout);
         layout_->addWidget(allBtnContainer);
 
+        staggerCheck_ = new QCheckBox(obs_module_text("StaggerKeyframes"), container_);
+        staggerCheck_->setToolTip(obs_module_text("StaggerKeyframes.Tip"));
+        layout_->addWidget(staggerCheck_);
+        QObject::connect(staggerCheck_, &QCheckBox::toggled, [this](bool checked) {
+            GlobalMultiOutputConfig().staggerKeyframes = checked;
+            SaveConfig();
+        });
+
+        burstLabel_ = new QLabel(container_);
+        burstLabel_->setToolTip(obs_module_text("Burst.Tip"));
+        layout_->addWidget(burstLabel_);
+        auto burstTimer = new QTimer(this);
+        burstTimer->setInterval(std::chrono::milliseconds(1000));
+        QObject::connect(burstTimer, &QTimer::timeout, [this]() {
+            UpdateBurstMeter();
+        });
+        burstTimer->start();
+        UpdateBurstMeter();
+
         QObject::connect(startAllButton, &QPushButton::clicked, [this]() {
+            TRACE_SCOPE(GetTracer()->Lane("dock"), "Start All");
+            if (GlobalMultiOutputConfig().staggerKeyframes) {
+                StartAllStaggered();
+                return;
+            }
             for (auto x : GetAllPushWidgets())
                 x->StartStreaming();
         });
         QObject::connect(stopAllButton, &QPushButton::clicked, [this]() {
+            TRACE_SCOPE(GetTracer()->Lane("dock"), "Stop All");
             for (auto x : GetAllPushWidgets())
                 x->StopStreaming();
         });
  
+        soakTimer_ = new QTimer(this);
+        soakTimer_->setInterval(std::chrono::seconds(10));
+        QObject::connect(soakTimer_, &QTimer::timeout, [this]() {
+            std::vector<TargetHealth> targets;
+            for (auto x : GetAllPushWidgets())
+                targets.push_back(x->GetHealth());
+            GetSoakCollector()->Sample(targets);
+        });
+
+        container_->setContextMenuPolicy(Qt::CustomContextMenu);
+        QObject::connect(container_, &QWidget::customContextMenuRequested, [this](const QPoint& pos) {
+            QMenu menu(container_);
+            QObject::connect(menu.addAction(obs_module_text("Trace.Export")), &QAction::triggered, [this]() {
+                ExportTrace();
+            });
+            QObject::connect(menu.addAction(obs_module_text("Trace.Clear")), &QAction::triggered, []() {
+                GetTracer()->Clear();
+            });
+            menu.addSeparator();
+            auto& global = GlobalMultiOutputConfig();
+            auto metrics = menu.addAction(QString(obs_module_text("Metrics.Serve")).arg(global.metricsPort));
+            metrics->setCheckable(true);
+            metrics->setChecked(global.metricsEnabled);
+            QObject::connect(metrics, &QAction::toggled, [this](bool checked) {
+                GlobalMultiOutputConfig().metricsEnabled = checked;
+                SaveConfig();
+                ApplyMetricsServer(true);
+            });
+            auto shm = menu.addAction(obs_module_text("StatsShm.Publish"));
+            shm->setCheckable(true);
+            shm->setChecked(global.statsShmEnabled);
+            QObject::connect(shm, &QAction::toggled, [this](bool checked) {
+                GlobalMultiOutputConfig().statsShmEnabled = checked;
+                SaveConfig();
+                ApplyStatsShm();
+            });
+            auto control = menu.addAction(obs_module_text("ControlSocket.Serve"));
+            control->setCheckable(true);
+            control->setChecked(global.controlSocketEnabled);
+            QObject::connect(control, &QAction::toggled, [this](bool checked) {
+                GlobalMultiOutputConfig().controlSocketEnabled = checked;
+                SaveConfig();
+                ApplyControlSocket(true);
+            });
+            auto soak = menu.addAction(obs_module_text("Soak.Log"));
+            soak->setCheckable(true);
+            soak->setChecked(GetSoakCollector()->IsRunning());
+            QObject::connect(soak, &QAction::toggled, [this](bool checked) {
+                if (checked) {
+                    GetSoakCollector()->Start();
+                    soakTimer_->start();
+                } else {
+                    soakTimer_->stop();
+                    GetSoakCollector()->Stop();
+                }
+            });
+            QObject::connect(menu.addAction(obs_module_text("Soak.AddTargets")), &QAction::triggered, [this]() {
+                AddSoakTargets();
+            });
+            QObject::connect(menu.addAction(obs_module_text("Soak.RemoveTargets")), &QAction::triggered, [this]() {
+                RemoveSoakTargets();
+            });
+            menu.exec(container_->mapToGlobal(pos));
+        });
+
         // load and show outputs
         outputsContainer_ = new OutputsListWidget(container_);
         outputsContainer_->setDragDropMode(QAbstractItemView::InternalMove);
@@ -178,6 +292,7 @@ public:
             &MultiOutputWidget::OnOutputMoved
         );
         layout_->addWidget(outputsContainer_);
+        layout_->addWidget(createEgressWidget(container_));
 
         // donate
         if (std::string("\xe5\xa4\x9a\xe8\xb7\xaf\xe6\x8e\xa8\xe6\xb5\x81") == obs_module_text("Title"))
@@ -272,6 +387,11 @@ public:
         fullLayout->addWidget(&scroll_, 0, 0);
     }
 
+    ~MultiOutputWidget()
+    {
+        GetControlApi()->SetHost(nullptr);
+    }
+
     std::list<PushWidget*> GetAllPushWidgets()
     {
         std::list<PushWidget*> result;
@@ -295,6 +415,232 @@ public:
         SaveMultiOutputConfig();
     }
 
+    PushWidget* FindPushWidget(const std::string& targetId)
+    {
+        auto id = QString::fromStdString(targetId);
+        for (int row = 0; row < outputsContainer_->count(); ++row) {
+            auto item = outputsContainer_->item(row);
+            if (item && item->data(Qt::UserRole).toString() == id)
+                return dynamic_cast<PushWidget*>(outputsContainer_->itemWidget(item));
+        }
+        return nullptr;
+    }
+
+    void StartTargets(const std::vector<std::string>& ids) override
+    {
+        TRACE_SCOPE(GetTracer()->Lane("dock"), "Control start");
+        for (auto& id : ids) {
+            if (auto pushWidget = FindPushWidget(id))
+                pushWidget->StartStreaming();
+        }
+    }
+
+    void StopTargets(const std::vector<std::string>& ids) override
+    {
+        TRACE_SCOPE(GetTracer()->Lane("dock"), "Control stop");
+        for (auto& id : ids) {
+            if (auto pushWidget = FindPushWidget(id))
+                pushWidget->StopStreaming();
+        }
+    }
+
+    // Running targets keep their output until the next start.
+    void PatchTargets(const std::vector<std::string>& ids, const nlohmann::json& patch) override
+    {
+        auto& global = GlobalMultiOutputConfig();
+        int patched = 0;
+        for (auto& id : ids) {
+            auto target = FindById(global.targets, id);
+            if (!target)
+                continue;
+            std::string error;
+            if (!PatchTargetConfig(*target, patch, error)) {
+                blog(LOG_WARNING, TAG "Patching target %s failed: %s", id.c_str(), error.c_str());
+                continue;
+            }
+            ++patched;
+            if (auto pushWidget = FindPushWidget(id))
+                pushWidget->LoadConfig();
+        }
+        if (patched > 0)
+            SaveConfig();
+        blog(LOG_INFO, TAG "Patched %d of %d targets", patched, static_cast<int>(ids.size()));
+    }
+
+    // Failures are only logged unless the user just asked for the endpoint.
+    void ApplyMetricsServer(bool interactive = false)
+    {
+        auto& global = GlobalMultiOutputConfig();
+        if (!global.metricsEnabled) {
+            GetMetricsServer()->Stop();
+            return;
+        }
+        if (!GetMetricsServer()->Start(global.metricsPort) && interactive)
+            QMessageBox::warning(this, obs_module_text("Title"), QString(obs_module_text("Error.Metrics")).arg(global.metricsPort));
+    }
+
+    void ApplyStatsShm()
+    {
+        if (GlobalMultiOutputConfig().statsShmEnabled)
+            GetStatsShm()->Open();
+        else
+            GetStatsShm()->Close();
+    }
+
+    void ApplyControlSocket(bool interactive = false)
+    {
+        if (!GlobalMultiOutputConfig().controlSocketEnabled) {
+            GetControlSocket()->Stop();
+            return;
+        }
+        if (!GetControlSocket()->Start() && interactive)
+            QMessageBox::warning(this, obs_module_text("Title"), obs_module_text("Error.ControlSocket"));
+    }
+
+    static bool IsSoakTarget(OutputTargetConfig& target)
+    {
+        return GetJsonField<std::string>(target.serviceParam, "key") == kSoakKeyPrefix + target.id;
+    }
+
+    // Load test driver: adds targets tagged "soak" that publish to a local sink,
+    // such as multi-rtmp-sink from the tools directory.
+    void AddSoakTargets()
+    {
+        bool ok = false;
+        int count = QInputDialog::getInt(this, obs_module_text("Soak.AddTargets"), obs_module_text("Soak.TargetCount"),
+            10, 1, 200, 1, &ok);
+        if (!ok)
+            return;
+        auto url = QInputDialog::getText(this, obs_module_text("Soak.AddTargets"), obs_module_text("Soak.SinkUrl"),
+            QLineEdit::Normal, "rtmp://127.0.0.1:1935/live", &ok).trimmed();
+        if (!ok || url.isEmpty())
+            return;
+
+        auto& global = GlobalMultiOutputConfig();
+        for (int i = 0; i < count; ++i) {
+            auto target = std::make_shared<OutputTargetConfig>();
+            target->id = GenerateId(global);
+            target->name = "Soak " + std::to_string(i + 1);
+            target->protocol = "RTMP";
+            target->tags = { "soak" };
+            target->serviceParam = { { "server", url.toStdString() }, { "key", kSoakKeyPrefix + target->id } };
+            target->outputParam = nlohmann::json::object();
+            global.targets.emplace_back(target);
+            AddPushWidget(target->id);
+        }
+        SaveConfig();
+        blog(LOG_INFO, TAG "Added %d soak targets publishing to %s", count, url.toUtf8().constData());
+    }
+
+    // Running soak targets are kept.
+    void RemoveSoakTargets()
+    {
+        auto& global = GlobalMultiOutputConfig();
+        std::vector<std::string> ids;
+        for (int row = 0; row < outputsContainer_->count(); ++row) {
+            auto item = outputsContainer_->item(row);
+            if (!item)
+                continue;
+            auto target = FindById(global.targets, item->data(Qt::UserRole).toString().toStdString());
+            if (!target || !IsSoakTarget(*target))
+                continue;
+            auto pushWidget = dynamic_cast<PushWidget*>(outputsContainer_->itemWidget(item));
+            if (!pushWidget || !pushWidget->IsRunning())
+                ids.push_back(target->id);
+        }
+        for (auto& id : ids)
+            DeletePushWidget(id);
+        SaveConfig();
+        blog(LOG_INFO, TAG "Removed %d soak targets", static_cast<int>(ids.size()));
+    }
+
+    void ExportTrace()
+    {
+        auto filename = QFileDialog::getSaveFileName(this, obs_module_text("Trace.Export"), "multi-rtmp-trace.json", "Trace (*.json)");
+        if (filename.isEmpty())
+            return;
+
+        auto content = GetTracer()->ExportChromeJson();
+        if (!os_quick_write_utf8_file(filename.toUtf8().constData(), content.c_str(), content.size(), false))
+            QMessageBox::warning(this, obs_module_text("Trace.Export"), obs_module_text("Error.TraceExport"));
+    }
+
+    // Dedicated video encoders start their GOP when their first target starts. Targets are started
+    // so that each encoder's keyframes fall at an even offset within one keyframe interval,
+    // instead of all encoders sending their keyframes in the same instant.
+    void StartAllStaggered()
+    {
+        auto& global = GlobalMultiOutputConfig();
+        std::vector<std::string> encoders;
+        std::vector<std::pair<PushWidget*, int>> starts;
+        int keyintMs = 0;
+
+        // encoders of running targets are already producing, their keyframe phase is fixed
+        std::vector<std::string> activeEncoders;
+        for (int row = 0; row < outputsContainer_->count(); ++row) {
+            auto item = outputsContainer_->item(row);
+            auto pushWidget = item ? dynamic_cast<PushWidget*>(outputsContainer_->itemWidget(item)) : nullptr;
+            if (!pushWidget || !pushWidget->IsRunning())
+                continue;
+            auto target = FindById(global.targets, item->data(Qt::UserRole).toString().toStdString());
+            if (target && target->videoConfig.has_value())
+                activeEncoders.push_back(*target->videoConfig);
+        }
+
+        for (int row = 0; row < outputsContainer_->count(); ++row) {
+            auto item = outputsContainer_->item(row);
+            auto pushWidget = item ? dynamic_cast<PushWidget*>(outputsContainer_->itemWidget(item)) : nullptr;
+            if (!pushWidget || pushWidget->IsRunning())
+                continue;
+
+            int slot = -1;
+            auto target = FindById(global.targets, item->data(Qt::UserRole).toString().toStdString());
+            if (target && target->videoConfig.has_value() && !IsSpecialEncoder(*target->videoConfig)
+                && std::find(activeEncoders.begin(), activeEncoders.end(), *target->videoConfig) == activeEncoders.end()) {
+                auto it = std::find(encoders.begin(), encoders.end(), *target->videoConfig);
+                slot = static_cast<int>(it - encoders.begin());
+                if (it == encoders.end()) {
+                    encoders.push_back(*target->videoConfig);
+                    auto videoConfig = FindById(global.videoConfig, *target->videoConfig);
+                    auto keyintSec = videoConfig ? GetJsonField<int>(videoConfig->encoderParams, "keyint_sec").value_or(0) : 0;
+                    // 0 leaves it to the encoder, assume the usual 2 seconds
+                    auto ms = (keyintSec > 0 ? keyintSec : 2) * 1000;
+                    keyintMs = keyintMs == 0 ? ms : (std::min)(keyintMs, ms);
+                }
+            }
+            starts.emplace_back(pushWidget, slot);
+        }
+
+        for (auto& [pushWidget, slot] : starts) {
+            int delay = slot > 0 ? keyintMs * slot / static_cast<int>(encoders.size()) : 0;
+            // stopping the target before its turn cancels the start
+            if (delay == 0)
+                pushWidget->StartStreaming();
+            else
+                pushWidget->StartStreamingAfter(delay);
+        }
+
+        blog(LOG_INFO, TAG "Starting %d targets, keyframes of %d encoders staggered by %d ms",
+            static_cast<int>(starts.size()), static_cast<int>(encoders.size()),
+            encoders.empty() ? 0 : keyintMs / static_cast<int>(encoders.size()));
+    }
+
+    void UpdateBurstMeter()
+    {
+        double peak = 0, mean = 0;
+        if (!GetBurstMeter()->GetStats(peak, mean) || mean <= 0) {
+            burstLabel_->setVisible(false);
+            return;
+        }
+
+        char ratio[16] = { 0 };
+        snprintf(ratio, sizeof(ratio), "%.1fx", peak / mean);
+        auto text = std::string(obs_module_text("Burst.Peak")) + " " + FormatBitrate(peak) + "  "
+            + obs_module_text("Burst.Mean") + " " + FormatBitrate(mean) + "  (" + ratio + ")";
+        burstLabel_->setText(QString::fromUtf8(text));
+        burstLabel_->setVisible(true);
+    }
+
     void OnOutputMoved(
         const QModelIndex &parent,
         int start,
@@ -365,7 +711,16 @@ public:
         outputsContainer_->clear();
 
         GlobalMultiOutputConfig() = {};
-        if (!LoadMultiOutputConfig()) {
+        GetCategoryCache()->Load();
+        bool loaded = LoadMultiOutputConfig();
+        {
+            QSignalBlocker blocker(staggerCheck_);
+            staggerCheck_->setChecked(GlobalMultiOutputConfig().staggerKeyframes);
+        }
+        ApplyMetricsServer();
+        ApplyStatsShm();
+        ApplyControlSocket();
+        if (!loaded) {
             return;
         }
 
@@ -378,12 +733,15 @@ public:
 private:
     // Main widget of this module's dock
     QWidget* container_ = 0;
+    QTimer* soakTimer_ = 0;
     // The layout of the root widget
     QVBoxLayout* layout_ = 0;
     // Scrollable area in case of overflows of content
     QScrollArea scroll_;
     // Widget, that contains output source widgets
     QListWidget* outputsContainer_ = 0;
+    QCheckBox* staggerCheck_ = 0;
+    QLabel* burstLabel_ = 0;
 
     void DeletePushWidget(const std::string& targetId)
     {
@@ -453,6 +811,9 @@ bool obs_module_load()
         s_service.uiThread_ = QThread::currentThread();
     });
 
+    RegisterFanoutOutput();
+    RegisterNullOutput();
+
     auto dock = new MultiOutputWidget();
     dock->setObjectName("obs-multi-rtmp-dock");
     if (!obs_frontend_add_dock_by_id("obs-multi-rtmp-dock", obs_module_text("Title"), dock))
@@ -461,6 +822,11 @@ bool obs_module_load()
         return false;
     }
 
+    GetEndStreamQueue()->Load();
+    GetEgressManager()->Load();
+    GetControlApi()->Register();
+    GetControlApi()->SetHost(dock);
+
     blog(LOG_INFO, TAG "version: %s by SoraYuki https://github.com/sorayuki/obs-multi-rtmp/", PLUGIN_VERSION);
 
     obs_frontend_add_event_callback(
@@ -473,17 +839,32 @@ bool obs_module_load()
             if (event == obs_frontend_event::OBS_FRONTEND_EVENT_EXIT)
             {   
                 dock->SaveConfig();
+                GetEndStreamQueue()->Flush(3000);
             }
             else if (event == obs_frontend_event::OBS_FRONTEND_EVENT_PROFILE_CHANGED)
             {
                 dock->LoadConfig();
             }
+            else if (event == obs_frontend_event::OBS_FRONTEND_EVENT_TRANSITION_CHANGED
+                || event == obs_frontend_event::OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED)
+            {
+                GetVideoMixCache()->SyncProgramChannels();
+            }
         }, dock
     );
 
     return true;
 }
 
+void obs_module_unload()
+{
+    GetMetricsServer()->Stop();
+    GetStatsShm()->Close();
+    GetControlSocket()->Stop();
+    GetEndStreamQueue()->Shutdown();
+    GetHttpClient()->Shutdown();
+}
+
 const char *obs_module_description(void)
 {
     return "Multiple RTMP Output Plugin";
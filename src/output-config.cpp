@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <util/platform.h>
 #include "json-util.hpp"
+#include "helpers.h"
 
 
 MultiOutputConfig& GlobalMultiOutputConfig()
@@ -31,6 +32,11 @@ static nlohmann::json SaveTarget(OutputTargetConfig& config) {
     json["streamlabs-title"] = config.streamlabsTitle;
     json["streamlabs-category"] = config.streamlabsCategory;
     json["streamlabs-mature-content"] = config.streamlabsMatureContent;
+    if (!config.tuningProfile.empty())
+        json["tuning-profile"] = config.tuningProfile;
+    json["auto-egress"] = config.autoEgress;
+    if (!config.tags.empty())
+        json["tags"] = config.tags;
     if (config.videoConfig.has_value())
         json["video-config"] = *config.videoConfig;
     if (config.audioConfig.has_value())
@@ -48,6 +54,7 @@ static nlohmann::json SaveVideoConfig(VideoEncoderConfig& config) {
     if (config.resolution.has_value())
         json["resolution"] = *config.resolution;
     json["fps-denumerator"] = config.fpsDenumerator;
+    json["scale-type"] = config.scaleType;
     return json;
 }
 
@@ -111,6 +118,11 @@ static std::string SaveMultiOutputConfig(MultiOutputConfig& config) {
     json["targets"] = targets;
     json["video_configs"] = video_configs;
     json["audio_configs"] = audio_configs;
+    json["stagger-keyframes"] = config.staggerKeyframes;
+    json["metrics-enabled"] = config.metricsEnabled;
+    json["metrics-port"] = config.metricsPort;
+    json["stats-shm-enabled"] = config.statsShmEnabled;
+    json["control-socket-enabled"] = config.controlSocketEnabled;
 
     blog(LOG_INFO, TAG "Save %d targets, %d video configs, %d audio configs", target_count, videocfg_count, audiocfg_count);
 
@@ -135,6 +147,14 @@ static OutputTargetConfigPtr LoadTargetConfig(nlohmann::json& json) {
     config->streamlabsTitle = GetJsonField<std::string>(json, "streamlabs-title").value_or("");
     config->streamlabsCategory = GetJsonField<std::string>(json, "streamlabs-category").value_or("");
     config->streamlabsMatureContent = GetJsonField<bool>(json, "streamlabs-mature-content").value_or(false);
+    config->tuningProfile = GetJsonField<std::string>(json, "tuning-profile").value_or("");
+    config->autoEgress = GetJsonField<bool>(json, "auto-egress").value_or(false);
+    if (auto tags = json.find("tags"); tags != json.end() && tags->is_array()) {
+        for (auto& tag : *tags) {
+            if (tag.is_string())
+                config->tags.push_back(tag.get<std::string>());
+        }
+    }
     config->serviceParam = GetJsonField<nlohmann::json>(json, "service-param").value_or(nlohmann::json{});
     config->outputParam = GetJsonField<nlohmann::json>(json, "output-param").value_or(nlohmann::json{});
     config->videoConfig = GetJsonField<std::string>(json, "video-config");
@@ -154,6 +174,7 @@ static VideoEncoderConfigPtr LoadVideoConfig(nlohmann::json& json) {
     config->outputScene = GetJsonField<std::string>(json, "scene");
     config->resolution = GetJsonField<std::string>(json, "resolution");
     config->fpsDenumerator = GetJsonField<int>(json, "fps-denumerator").value_or(1);
+    config->scaleType = GetJsonField<std::string>(json, "scale-type").value_or("bicubic");
     config->encoderParams = GetJsonField<nlohmann::json>(json, "param").value_or(nlohmann::json{});
 
     return config;
@@ -236,6 +257,12 @@ static MultiOutputConfig LoadMultiOutputConfig(const std::string& content) {
             }
         }
 
+        config.staggerKeyframes = GetJsonField<bool>(json, "stagger-keyframes").value_or(false);
+        config.metricsEnabled = GetJsonField<bool>(json, "metrics-enabled").value_or(false);
+        config.metricsPort = GetJsonField<int>(json, "metrics-port").value_or(9464);
+        config.statsShmEnabled = GetJsonField<bool>(json, "stats-shm-enabled").value_or(false);
+        config.controlSocketEnabled = GetJsonField<bool>(json, "control-socket-enabled").value_or(false);
+
         blog(LOG_INFO, TAG "Load %d targets, %d video configs, %d audio configs", target_count, videocfg_count, audiocfg_count);
         
         return config;
@@ -303,3 +330,40 @@ std::string GenerateId(MultiOutputConfig& config) {
         return newid;
     }
 }
+
+
+bool PatchTargetConfig(OutputTargetConfig& target, const nlohmann::json& patch, std::string& error) {
+    if (!patch.is_object()) {
+        error = "patch is not an object";
+        return false;
+    }
+    if (patch.contains("id")) {
+        error = "id cannot be patched";
+        return false;
+    }
+
+    auto json = SaveTarget(target);
+    json.merge_patch(patch);
+    auto patched = LoadTargetConfig(json);
+    if (!patched) {
+        error = "patched config is invalid";
+        return false;
+    }
+
+    // empty and placeholder ids share the OBS encoders
+    auto isDangling = [](const std::optional<std::string>& id, auto& configs) {
+        return id.has_value() && !id->empty() && !IsSpecialEncoder(*id) && !FindById(configs, *id);
+    };
+    auto& global = GlobalMultiOutputConfig();
+    if (isDangling(patched->videoConfig, global.videoConfig)) {
+        error = "unknown video-config " + *patched->videoConfig;
+        return false;
+    }
+    if (isDangling(patched->audioConfig, global.audioConfig)) {
+        error = "unknown audio-config " + *patched->audioConfig;
+        return false;
+    }
+
+    target = *patched;
+    return true;
+}
@@ -16,6 +16,8 @@ struct VideoEncoderConfig {
     nlohmann::json encoderParams;
     std::optional<std::string> outputScene;
     std::optional<std::string> resolution;
+    // GPU filter used when scaling to resolution: bilinear, bicubic, lanczos or area
+    std::string scaleType = "bicubic";
 };
 using VideoEncoderConfigPtr = std::shared_ptr<VideoEncoderConfig>;
 
@@ -41,10 +43,16 @@ struct OutputTargetConfig {
     std::string protocol;
     std::string streamlabsTitle;
     std::string streamlabsCategory;
+    // id of a TuningProfile of the protocol, empty when tuned by hand
+    std::string tuningProfile;
     bool syncStart = false;
     bool syncStop = false;
     bool streamlabsToken = false;
     bool streamlabsMatureContent = false;
+    // bind_ip is chosen by the egress manager
+    bool autoEgress = false;
+    // free-form labels for selecting targets through the control API
+    std::vector<std::string> tags;
 
     nlohmann::json serviceParam;
     nlohmann::json outputParam;
@@ -60,6 +68,15 @@ public:
     std::list<OutputTargetConfigPtr> targets;
     std::list<VideoEncoderConfigPtr> videoConfig;
     std::list<AudioEncoderConfigPtr> audioConfig;
+    // Start All spreads the keyframes of dedicated video encoders over one keyframe interval
+    bool staggerKeyframes = false;
+    // Prometheus endpoint on 127.0.0.1
+    bool metricsEnabled = false;
+    int metricsPort = 9464;
+    // shared-memory segment for local watchdogs, see stats-shm-layout.h
+    bool statsShmEnabled = false;
+    // event and stats feed on a Unix-domain socket, see control-socket.h
+    bool controlSocketEnabled = false;
 };
 
 template<class T, class S>
@@ -79,3 +96,6 @@ void SaveMultiOutputConfig();
 bool LoadMultiOutputConfig();
 
 std::string GenerateId(MultiOutputConfig& config);
+
+// Applies an RFC 7386 merge patch to the saved form of the target. The id cannot be changed.
+bool PatchTargetConfig(OutputTargetConfig& target, const nlohmann::json& patch, std::string& error);
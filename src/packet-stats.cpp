@@ -0,0 +1,191 @@
+#include "packet-stats.h"
+#include "pch.h"
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <util/platform.h>
+
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(31, 0, 0)
+#define HAVE_PACKET_CALLBACK 1
+#else
+#define HAVE_PACKET_CALLBACK 0
+#endif
+
+namespace {
+
+// Power-of-two buckets: bucket i counts values in [2^(i-1), 2^i), bucket 0 counts zero.
+class Log2Histogram {
+    static const size_t kBuckets = 40;
+    std::array<std::atomic<uint64_t>, kBuckets> counts_{};
+    std::atomic<uint64_t> max_ = 0;
+    std::atomic<uint64_t> total_ = 0;
+    std::atomic<uint64_t> samples_ = 0;
+
+public:
+    void Add(uint64_t value)
+    {
+        size_t index = 0;
+        for (auto v = value; v != 0 && index < kBuckets - 1; v >>= 1)
+            ++index;
+        counts_[index].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(value, std::memory_order_relaxed);
+        samples_.fetch_add(1, std::memory_order_relaxed);
+
+        auto max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    void Clear()
+    {
+        for (auto& count : counts_)
+            count.store(0, std::memory_order_relaxed);
+        max_ = 0;
+        total_ = 0;
+        samples_ = 0;
+    }
+
+    uint64_t Samples() const { return samples_.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+
+    double Mean() const
+    {
+        auto samples = Samples();
+        return samples ? static_cast<double>(total_.load(std::memory_order_relaxed)) / samples : 0;
+    }
+
+    // Upper bound of the bucket holding the given quantile, capped by the exact maximum.
+    uint64_t Percentile(double q) const
+    {
+        auto samples = Samples();
+        if (samples == 0)
+            return 0;
+        auto rank = static_cast<uint64_t>(q * samples);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+                return std::min<uint64_t>(i == 0 ? 0 : (uint64_t(1) << i) - 1, Max());
+        }
+        return Max();
+    }
+};
+
+}
+
+class PacketStatsImpl : public PacketStats {
+    Log2Histogram videoSize_;
+    Log2Histogram audioSize_;
+    Log2Histogram keyintMs_;
+    Log2Histogram jitterUsec_;
+    std::atomic<uint64_t> videoBytes_ = 0;
+    std::atomic<uint64_t> audioBytes_ = 0;
+    std::atomic<int64_t> lastKeyframeUsec_ = -1;
+    std::atomic<int64_t> lastVideoLagUsec_ = INT64_MIN;
+
+#if HAVE_PACKET_CALLBACK
+    static void OnPacket(obs_output_t*, encoder_packet* packet, encoder_packet_time*, void* param)
+    {
+        static_cast<PacketStatsImpl*>(param)->Record(*packet);
+    }
+#endif
+
+public:
+    void Attach(obs_output_t* output) override
+    {
+        videoSize_.Clear();
+        audioSize_.Clear();
+        keyintMs_.Clear();
+        jitterUsec_.Clear();
+        videoBytes_ = 0;
+        audioBytes_ = 0;
+        lastKeyframeUsec_ = -1;
+        lastVideoLagUsec_ = INT64_MIN;
+
+#if HAVE_PACKET_CALLBACK
+        obs_output_add_packet_callback(output, &PacketStatsImpl::OnPacket, this);
+#else
+        (void)output;
+#endif
+    }
+
+    void Detach(obs_output_t* output) override
+    {
+#if HAVE_PACKET_CALLBACK
+        obs_output_remove_packet_callback(output, &PacketStatsImpl::OnPacket, this);
+#else
+        (void)output;
+#endif
+    }
+
+    void Record(const encoder_packet& packet) override
+    {
+        if (packet.type == OBS_ENCODER_AUDIO) {
+            audioBytes_.fetch_add(packet.size, std::memory_order_relaxed);
+            audioSize_.Add(packet.size);
+            return;
+        }
+
+        videoBytes_.fetch_add(packet.size, std::memory_order_relaxed);
+        videoSize_.Add(packet.size);
+        // spacing and jitter only make sense on one rendition
+        if (packet.track_idx != 0)
+            return;
+
+        if (packet.keyframe) {
+            auto previous = lastKeyframeUsec_.exchange(packet.sys_dts_usec, std::memory_order_relaxed);
+            if (previous >= 0 && packet.sys_dts_usec > previous)
+                keyintMs_.Add(static_cast<uint64_t>((packet.sys_dts_usec - previous) / 1000));
+        }
+
+        // how late the packet reaches the output relative to its frame time; the
+        // change of that lag from one packet to the next is the delivery jitter
+        auto lag = static_cast<int64_t>(os_gettime_ns() / 1000) - packet.sys_dts_usec;
+        auto previousLag = lastVideoLagUsec_.exchange(lag, std::memory_order_relaxed);
+        if (previousLag != INT64_MIN)
+            jitterUsec_.Add(static_cast<uint64_t>(lag > previousLag ? lag - previousLag : previousLag - lag));
+    }
+
+    std::string Describe() override
+    {
+        if (videoSize_.Samples() == 0 && audioSize_.Samples() == 0)
+            return {};
+
+        char line[256];
+        std::string text;
+
+        auto videoBytes = videoBytes_.load(std::memory_order_relaxed);
+        auto audioBytes = audioBytes_.load(std::memory_order_relaxed);
+        auto allBytes = videoBytes + audioBytes;
+        snprintf(line, sizeof(line), "%s: %.1f%% / %.1f%%", obs_module_text("PacketStats.Split"),
+            allBytes ? 100.0 * videoBytes / allBytes : 0.0, allBytes ? 100.0 * audioBytes / allBytes : 0.0);
+        text += line;
+
+        if (videoSize_.Samples()) {
+            snprintf(line, sizeof(line), "\n%s: p50 %llu B, p95 %llu B, max %llu B", obs_module_text("PacketStats.VideoSize"),
+                (unsigned long long)videoSize_.Percentile(0.5), (unsigned long long)videoSize_.Percentile(0.95),
+                (unsigned long long)videoSize_.Max());
+            text += line;
+        }
+        if (audioSize_.Samples()) {
+            snprintf(line, sizeof(line), "\n%s: %.0f B", obs_module_text("PacketStats.AudioSize"), audioSize_.Mean());
+            text += line;
+        }
+        if (keyintMs_.Samples()) {
+            snprintf(line, sizeof(line), "\n%s: %.0f ms, max %llu ms", obs_module_text("PacketStats.Keyint"),
+                keyintMs_.Mean(), (unsigned long long)keyintMs_.Max());
+            text += line;
+        }
+        if (jitterUsec_.Samples()) {
+            snprintf(line, sizeof(line), "\n%s: p50 %.1f ms, p95 %.1f ms, max %.1f ms", obs_module_text("PacketStats.Jitter"),
+                jitterUsec_.Percentile(0.5) / 1000.0, jitterUsec_.Percentile(0.95) / 1000.0, jitterUsec_.Max() / 1000.0);
+            text += line;
+        }
+        return text;
+    }
+};
+
+std::unique_ptr<PacketStats> CreatePacketStats()
+{
+    return std::make_unique<PacketStatsImpl>();
+}
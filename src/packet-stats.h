@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+typedef struct obs_output obs_output_t;
+struct encoder_packet;
+
+// Per-target view of the encoded packets an output sends: packet sizes,
+// keyframe spacing, delivery jitter and the audio / video byte split.
+// Record runs on the output's packet path and only touches fixed-size atomic
+// counters, so it never allocates or blocks.
+class PacketStats {
+public:
+    virtual ~PacketStats() {}
+    // Clears the counters and hooks the output's packet callback.
+    virtual void Attach(obs_output_t* output) = 0;
+    virtual void Detach(obs_output_t* output) = 0;
+    virtual void Record(const encoder_packet& packet) = 0;
+    // Multi-line summary for the stats tooltip. Empty when nothing was recorded.
+    virtual std::string Describe() = 0;
+};
+
+std::unique_ptr<PacketStats> CreatePacketStats();
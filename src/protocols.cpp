@@ -1,14 +1,143 @@
 #include "protocols.h"
+#include "fanout-output.h"
+#include "null-output.h"
+#include "output-config.h"
+#include "json-util.hpp"
 #include <string>
+#include <regex>
 
-static ProtocolInfo s_infoList[] = {
-    // protocol, label, output_id, service_id
-    { "RTMP", "RTMP", "rtmp_output", "rtmp_custom" },
-    { "SRT_RIST", "SRT/RIST", "ffmpeg_mpegts_muxer", "rtmp_custom" },
-    { "WHIP", "WebRTC (WHIP)", "whip_output", "whip_custom" },
+static const TuningProfile s_rtmpProfiles[] = {
+    // id, label, output params, url params
+    { "throughput", "Tuning.Throughput",
+        R"({"new_socket_loop_enabled": true, "low_latency_mode_enabled": false, "drop_threshold_ms": 700, "pframe_drop_threshold_ms": 900})", nullptr },
+    { "low_latency", "Tuning.LowLatency",
+        R"({"new_socket_loop_enabled": true, "low_latency_mode_enabled": true, "drop_threshold_ms": 300, "pframe_drop_threshold_ms": 500})", nullptr },
+    { "lossy_link", "Tuning.LossyLink",
+        R"({"new_socket_loop_enabled": true, "low_latency_mode_enabled": false, "drop_threshold_ms": 2000, "pframe_drop_threshold_ms": 2500})", nullptr },
+    { nullptr, nullptr, nullptr, nullptr }
+};
+
+static const TuningProfile s_fanoutProfiles[] = {
+    { "throughput", "Tuning.Throughput", R"({"max_queue_mb": 32, "drop_policy": "keyframe"})", nullptr },
+    { "low_latency", "Tuning.LowLatency", R"({"max_queue_mb": 4, "drop_policy": "nonref"})", nullptr },
+    { "lossy_link", "Tuning.LossyLink", R"({"max_queue_mb": 64, "drop_policy": "keyframe"})", nullptr },
     { nullptr, nullptr, nullptr, nullptr }
 };
 
+// SRT latency is in microseconds, RIST buffer in milliseconds. Profiles are
+// merged into the URL, so every profile sets the same keys.
+static const TuningProfile s_srtRistProfiles[] = {
+    { "throughput", "Tuning.Throughput", nullptr,
+        R"({"srt": {"latency": 500000, "sndbuf": 8388608}, "rist": {"buffer": 1000}})" },
+    { "low_latency", "Tuning.LowLatency", nullptr,
+        R"({"srt": {"latency": 120000, "sndbuf": 2097152}, "rist": {"buffer": 200}})" },
+    { "lossy_link", "Tuning.LossyLink", nullptr,
+        R"({"srt": {"latency": 2000000, "sndbuf": 16777216}, "rist": {"buffer": 2000}})" },
+    { nullptr, nullptr, nullptr, nullptr }
+};
+
+static ProtocolInfo s_infoList[] = {
+    // protocol, label, output_id, service_id, tuning profiles
+    { "RTMP", "RTMP", "rtmp_output", "rtmp_custom", s_rtmpProfiles },
+    { "RTMP_FANOUT", "RTMP (shared mux)", FANOUT_OUTPUT_ID, "rtmp_custom", s_fanoutProfiles },
+    { "SRT_RIST", "SRT/RIST", "ffmpeg_mpegts_muxer", "rtmp_custom", s_srtRistProfiles },
+    { "WHIP", "WebRTC (WHIP)", "whip_output", "whip_custom", nullptr },
+    { "FILE", "File", "ffmpeg_muxer", nullptr, nullptr },
+    { "NULL", "Null (benchmark)", NULL_OUTPUT_ID, nullptr, nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+struct ParsedUrl {
+    std::string scheme;
+    std::string base;
+    std::vector<std::pair<std::string, std::string>> query;
+
+    explicit ParsedUrl(const std::string& url)
+    {
+        auto colon = url.find("://");
+        if (colon != std::string::npos) {
+            scheme = url.substr(0, colon);
+            for (auto& c : scheme)
+                c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+        }
+
+        auto mark = url.find('?');
+        base = url.substr(0, mark);
+        if (mark == std::string::npos)
+            return;
+
+        size_t pos = mark + 1;
+        while (pos <= url.size()) {
+            auto amp = url.find('&', pos);
+            auto item = url.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+            if (!item.empty()) {
+                auto eq = item.find('=');
+                if (eq == std::string::npos)
+                    query.emplace_back(item, "");
+                else
+                    query.emplace_back(item.substr(0, eq), item.substr(eq + 1));
+            }
+            if (amp == std::string::npos)
+                break;
+            pos = amp + 1;
+        }
+    }
+
+    const std::string* Find(const std::string& key) const
+    {
+        for (auto& [k, v] : query) {
+            if (k == key)
+                return &v;
+        }
+        return nullptr;
+    }
+
+    void Set(const std::string& key, const std::string& value)
+    {
+        for (auto& [k, v] : query) {
+            if (k == key) {
+                v = value;
+                return;
+            }
+        }
+        query.emplace_back(key, value);
+    }
+
+    std::string ToString() const
+    {
+        auto url = base;
+        char sep = '?';
+        for (auto& [k, v] : query) {
+            url += sep + k + (v.empty() ? "" : "=" + v);
+            sep = '&';
+        }
+        return url;
+    }
+};
+
+static std::optional<long long> ParseInteger(const std::string& text)
+{
+    static const std::regex pattern(R"(\s*-?\d{1,18}\s*)");
+    if (!std::regex_match(text, pattern))
+        return std::nullopt;
+    return std::stoll(text);
+}
+
+static bool IsIpAddress(const std::string& text)
+{
+    static const std::regex v4(R"((\d{1,3})\.(\d{1,3})\.(\d{1,3})\.(\d{1,3}))");
+    static const std::regex v6(R"([0-9A-Fa-f:.]+(%[0-9A-Za-z_.-]+)?)");
+    std::smatch match;
+    if (std::regex_match(text, match, v4)) {
+        for (int i = 1; i <= 4; ++i) {
+            if (std::stoi(match[i].str()) > 255)
+                return false;
+        }
+        return true;
+    }
+    return text.find(':') != std::string::npos && std::regex_match(text, v6);
+}
+
 class ProtocolInfosImpl: public ProtocolInfos {
 public:
     const ProtocolInfo* GetInfo(const char* protocol) override {
@@ -23,6 +152,101 @@ public:
     const ProtocolInfo* GetList() override {
         return s_infoList;
     }
+
+    const TuningProfile* GetTuningProfile(const char* protocol, const char* profile) override {
+        auto info = GetInfo(protocol);
+        if (!info || !info->tuningProfiles || !profile || !*profile)
+            return nullptr;
+
+        std::string_view to_find{ profile };
+        for(auto p = info->tuningProfiles; p->id; ++p) {
+            if (to_find == p->id)
+                return p;
+        }
+        return nullptr;
+    }
+
+    void ApplyTuningProfile(OutputTargetConfig& target) override {
+        auto profile = GetTuningProfile(target.protocol.c_str(), target.tuningProfile.c_str());
+        if (!profile)
+            return;
+
+        if (profile->outputParam) {
+            if (!target.outputParam.is_object())
+                target.outputParam = nlohmann::json::object();
+            target.outputParam.merge_patch(nlohmann::json::parse(profile->outputParam));
+        }
+
+        if (profile->urlParams) {
+            auto server = GetJsonField<std::string>(target.serviceParam, "server");
+            if (!server.has_value() || server->empty())
+                return;
+
+            ParsedUrl url(*server);
+            auto params = nlohmann::json::parse(profile->urlParams);
+            auto it = params.find(url.scheme);
+            if (it == params.end())
+                return;
+
+            for (auto& [key, value] : it->items())
+                url.Set(key, value.is_string() ? value.get<std::string>() : value.dump());
+            target.serviceParam["server"] = url.ToString();
+        }
+    }
+
+    std::vector<std::string> CheckTuning(const OutputTargetConfig& target) override {
+        std::vector<std::string> problems;
+        auto outputParam = target.outputParam;
+        auto serviceParam = target.serviceParam;
+
+        auto bindIp = GetJsonField<std::string>(outputParam, "bind_ip");
+        if (bindIp.has_value() && !bindIp->empty() && *bindIp != "default" && !IsIpAddress(*bindIp))
+            problems.push_back("bind_ip \"" + *bindIp + "\" is not an IP address");
+
+        for (auto key : { "drop_threshold_ms", "pframe_drop_threshold_ms", "max_queue_mb" }) {
+            auto value = GetJsonField<int>(outputParam, key);
+            if (value.has_value() && *value <= 0)
+                problems.push_back(std::string(key) + " must be positive");
+        }
+
+        auto server = GetJsonField<std::string>(serviceParam, "server");
+        if (!server.has_value())
+            return problems;
+
+        ParsedUrl url(*server);
+        auto checkPositive = [&](const char* key) {
+            auto value = url.Find(key);
+            if (!value)
+                return;
+            auto number = ParseInteger(*value);
+            if (!number.has_value() || *number <= 0)
+                problems.push_back(url.scheme + " " + key + " must be a positive integer");
+        };
+
+        if (url.scheme == "srt") {
+            checkPositive("latency");
+            checkPositive("sndbuf");
+            checkPositive("rcvbuf");
+
+            long long keyLength = 0;
+            if (auto pbkeylen = url.Find("pbkeylen")) {
+                auto number = ParseInteger(*pbkeylen);
+                keyLength = number.value_or(-1);
+                if (keyLength != 0 && keyLength != 16 && keyLength != 24 && keyLength != 32)
+                    problems.push_back("srt pbkeylen must be 0, 16, 24 or 32");
+            }
+            auto passphrase = url.Find("passphrase");
+            if (passphrase && (passphrase->size() < 10 || passphrase->size() > 79))
+                problems.push_back("srt passphrase must be 10 to 79 characters");
+            if (keyLength > 0 && !passphrase)
+                problems.push_back("srt pbkeylen requires a passphrase");
+        } else if (url.scheme == "rist") {
+            checkPositive("buffer");
+            checkPositive("bandwidth");
+        }
+
+        return problems;
+    }
 };
 
 ProtocolInfos* GetProtocolInfos() {
@@ -2,18 +2,40 @@
 
 #include <string>
 #include <string_view>
+#include <vector>
+
+struct OutputTargetConfig;
+
+// Network tuning applied on top of a target's output and service settings.
+struct TuningProfile {
+    const char* id;
+    // locale key
+    const char* label;
+    // JSON object merged into the output settings
+    const char* outputParam;
+    // JSON object of { "<url scheme>": { "<query key>": value } } merged into the server URL
+    const char* urlParams;
+};
 
 struct ProtocolInfo {
     const char* protocol;
     const char* label;
     const char* outputId;
+    // nullptr for outputs that do not stream to a service
     const char* serviceId;
+    // terminated by an entry with a null id, nullptr if the protocol has none
+    const TuningProfile* tuningProfiles;
 };
 
 class ProtocolInfos {
 public:
     virtual const ProtocolInfo* GetInfo(const char* protocol) = 0;
     virtual const ProtocolInfo* GetList() = 0;
+    virtual const TuningProfile* GetTuningProfile(const char* protocol, const char* profile) = 0;
+    // Writes the target's tuning profile into its outputParam / serviceParam. No-op without a profile.
+    virtual void ApplyTuningProfile(OutputTargetConfig& target) = 0;
+    // Returns a description of every invalid network setting of the target.
+    virtual std::vector<std::string> CheckTuning(const OutputTargetConfig& target) = 0;
 };
 
 ProtocolInfos* GetProtocolInfos();
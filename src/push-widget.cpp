@@ -3,13 +3,28 @@
 #include <regex>
 #include <optional>
 #include <tuple>
+#include <ctime>
+#include <algorithm>
 #include "push-widget.h"
 #include "edit-widget.h"
 #include "output-config.h"
 #include "protocols.h"
 #include "streamlabs-api.h"
+#include "category-cache.h"
+#include "egress-manager.h"
+#include "video-mix-cache.h"
+#include "burst-meter.h"
+#include "trace.h"
+#include "packet-stats.h"
+#include "stats-registry.h"
+#include "control-socket.h"
+#include "session-history.h"
+#include "end-stream-queue.h"
 
 #include "obs.hpp"
+#include <QPointer>
+#include <atomic>
+#include <util/platform.h>
 
 class IOBSOutputEventHanlder
 {
@@ -95,6 +110,27 @@ public:
 };
 
 
+// File targets without a path record next to the regular OBS recordings.
+static std::string MakeRecordingPath(const std::string& targetName)
+{
+    std::string dir;
+    if (auto recordPath = obs_frontend_get_current_record_output_path()) {
+        dir = recordPath;
+        bfree(recordPath);
+    }
+
+    std::string name = targetName.empty() ? "multi-rtmp" : targetName;
+    for (auto& c : name) {
+        if (strchr("\\/:*?\"<>|", c))
+            c = '_';
+    }
+
+    auto stamp = os_generate_formatted_filename("mkv", true, "%CCYY-%MM-%DD %hh-%mm-%ss");
+    auto path = (dir.empty() ? std::string() : dir + "/") + name + " " + (stamp ? stamp : "recording.mkv");
+    bfree(stamp);
+    return path;
+}
+
 class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
 {
     std::string targetid_;
@@ -105,11 +141,11 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
     QLabel* msg_ = 0;
 
     using clock = std::chrono::steady_clock;
-    clock::time_point begin_time_;
     clock::time_point last_info_time_;
     uint64_t total_frames_ = 0;
     uint64_t total_bytes_ = 0;
     QTimer* timer_ = 0;
+    QTimer* delayedStart_ = 0;
 
     QPushButton* edit_btn_ = 0;
     QPushButton* remove_btn_ = 0;
@@ -117,8 +153,43 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
     obs_output_t* output_ = 0;
     bool using_main_video_encoder_ = false;
     bool using_main_audio_encoder_ = false;
-    obs_view_t* scene_view_ = 0;
+    video_t* shared_video_ = 0;
     bool isUseDelay_ = false;
+    std::atomic<bool> egressManaged_ = false;
+    std::string egressAddress_;
+    std::atomic<int> traceLane_ = 0;
+    std::atomic<uint64_t> startPressedNs_ = 0;
+    std::unique_ptr<PacketStats> packetStats_ = CreatePacketStats();
+    std::atomic<int> reconnects_ = 0;
+    std::atomic<uint64_t> reconnectBeganNs_ = 0;
+    std::atomic<int64_t> lastReconnectMs_ = -1;
+    std::atomic<int64_t> maxReconnectMs_ = 0;
+    std::atomic<int64_t> downtimeMs_ = 0;
+
+    // The output counters restart with every connection. Base keeps what the
+    // earlier connections of the run added up to.
+    struct SessionCounter {
+        uint64_t base = 0;
+        uint64_t last = 0;
+
+        void Update(uint64_t current) { last = current; }
+        void Restart() { base += last; last = 0; }
+        uint64_t Total() const { return base + last; }
+    };
+    // run accounting, UI thread only
+    SessionCounter sessionBytes_;
+    SessionCounter sessionFrames_;
+    SessionCounter sessionDropped_;
+    int64_t sessionStartedAt_ = 0;
+    int64_t liveMs_ = 0;
+    // 0 while not connected
+    uint64_t liveSinceNs_ = 0;
+
+    struct PendingStreamlabsStart {
+        std::atomic<HttpRequestId> request = 0;
+        std::atomic<bool> cancelled = false;
+    };
+    std::shared_ptr<PendingStreamlabsStart> pendingStart_;
 
     QPushButton* GetDeleteButton() {
         return remove_btn_;
@@ -142,6 +213,10 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
         	return false;
         }
         auto service_id = protocolInfo->serviceId;
+        if (!service_id) {
+            obs_data_release(conf);
+            return true;
+        }
 
         if (!conf)
             return false;
@@ -188,23 +263,34 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
                 return false;
             }
             auto videoConfig = FindById(GlobalMultiOutputConfig().videoConfig, config_->videoConfig.value_or(""));
+            auto wh = videoConfig ? ParseResolution(videoConfig->resolution) : std::nullopt;
+            bool hasScene = videoConfig && videoConfig->outputScene.has_value();
 
-            if (!videoConfig || !videoConfig->outputScene.has_value()) {
+            ReleaseOutputSceneView();
+            if (!hasScene && !wh.has_value()) {
+                if (videoConfig)
+                    obs_encoder_set_frame_rate_divisor(venc, videoConfig->fpsDenumerator);
                 obs_encoder_set_video(venc, obs_get_video());
             } else {
-                auto sceneName = *videoConfig->outputScene;
-                OBSSourceAutoRelease scene = obs_get_source_by_name(sceneName.c_str());
-                if (scene == nullptr) {
+                VideoMixSpec spec;
+                if (hasScene)
+                    spec.scene = *videoConfig->outputScene;
+                if (wh.has_value()) {
+                    spec.width = std::get<0>(*wh);
+                    spec.height = std::get<1>(*wh);
+                }
+                spec.scaleType = videoConfig->scaleType;
+                spec.fpsDivisor = videoConfig->fpsDenumerator;
+
+                uint32_t encoderDivisor = 1;
+                shared_video_ = GetVideoMixCache()->Acquire(spec, encoderDivisor);
+                if (!shared_video_) {
                     blog(LOG_ERROR, TAG "Output scene is not found.");
                     return false;
                 }
-                ReleaseOutputSceneView();
-
-                scene_view_ = obs_view_create();
-                obs_view_set_source(scene_view_, 0, scene);
-                obs_source_inc_active(scene);
-                auto scene_video = obs_view_add(scene_view_);
-                obs_encoder_set_video(venc, scene_video);
+                // the divisor goes into the encoder timebase computed by set_video
+                obs_encoder_set_frame_rate_divisor(venc, encoderDivisor);
+                obs_encoder_set_video(venc, shared_video_);
             }
         }
 
@@ -233,17 +319,11 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
 
 
     bool ReleaseOutputSceneView() {
-        if (!scene_view_)
+        if (!shared_video_)
             return true;
 
-        obs_view_remove(scene_view_);
-        OBSSourceAutoRelease source = obs_view_get_source(scene_view_, 0);
-        if (source) {
-            obs_source_dec_active(source);
-        }
-        obs_view_set_source(scene_view_, 0, nullptr);
-        obs_view_destroy(scene_view_);
-        scene_view_ = nullptr;
+        GetVideoMixCache()->Release(shared_video_);
+        shared_video_ = nullptr;
 
         return true;
     }
@@ -293,12 +373,7 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
                     OBSDataAutoRelease settings = obs_data_create_from_json(videoConfig->encoderParams.dump().c_str());
                     enc = obs_video_encoder_create(videoConfig->encoderId.c_str(), VideoEncoderName().c_str(), settings, nullptr);
                     if (enc) {
-                        auto wh = ParseResolution(videoConfig->resolution);
-                        if (wh.has_value()) {
-                            obs_encoder_set_gpu_scale_type(enc, obs_scale_type::OBS_SCALE_BICUBIC);
-                            auto [w, h] = *wh;
-                            obs_encoder_set_scaled_size(enc, w, h);
-                        }
+                        // scaling happens in the shared video mix, see PrepareEncoderSource
                         obs_encoder_set_frame_rate_divisor(enc, videoConfig->fpsDenumerator);
                     }
                 } else {
@@ -454,6 +529,13 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
     {
         if (output_) {
             DisconnectSignals(output_);
+            GetBurstMeter()->Detach(output_);
+            packetStats_->Detach(output_);
+        }
+
+        if (egressManaged_) {
+            GetEgressManager()->Release(targetid_);
+            egressManaged_ = false;
         }
 
         if (output_ && obs_output_active(output_)) {
@@ -499,10 +581,13 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
         auto new_frames = obs_output_get_total_frames(output_);
         auto now = clock::now();
 
+        if (egressManaged_)
+            GetEgressManager()->Report(targetid_, new_bytes, obs_output_get_congestion(output_));
+
         auto interval = std::chrono::duration_cast<std::chrono::duration<double>>(now - last_info_time_).count();
         if (interval > 0)
         {
-            auto duration = now - begin_time_;
+            auto duration = std::chrono::milliseconds(SessionLiveMs());
             auto hh = duration_cast<hours>(duration);
             duration -= hh;
             auto mm = duration_cast<minutes>(duration);
@@ -535,7 +620,15 @@ class PushWidgetImpl : public PushWidget, public IOBSOutputEventHanlder
                 }
             }();
             
-            msg_->setText((std::string(strDuration) + "  " + strBps + "  " + strFps).c_str());
+            auto status = std::string(strDuration) + "  " + strBps + "  " + strFps;
+            auto health = GetHealth();
+            if (health.droppedFrames > 0)
+                status += "  " + std::to_string(health.droppedFrames) + " " + obs_module_text("Status.Dropped");
+            if (health.reconnects > 0)
+                status += "  " + std::to_string(health.reconnects) + " " + obs_module_text("Status.Reconnects");
+            msg_->setText(status.c_str());
+            msg_->setToolTip(QString::fromStdString(packetStats_->Describe()));
+            GetStatsRegistry()->Publish(health);
         }
 
         total_frames_ = new_frames;
@@ -561,6 +654,12 @@ public:
             UpdateStreamStatus();
         });
 
+        delayedStart_ = new QTimer(this);
+        delayedStart_->setSingleShot(true);
+        QObject::connect(delayedStart_, &QTimer::timeout, [this]() {
+            StartStreaming();
+        });
+
         auto layout = new QGridLayout(this);
         layout->addWidget(name_ = new QLabel(obs_module_text("NewStreaming"), this), 0, 0, 1, 3);
         layout->addWidget(btn_ = new QPushButton(obs_module_text("Btn.Start"), this), 1, 0);
@@ -585,16 +684,42 @@ public:
     
     ~PushWidgetImpl()
     {
+        GetStatsRegistry()->Remove(targetid_);
+        if (pendingStart_) {
+            pendingStart_->cancelled = true;
+            GetHttpClient()->Cancel(pendingStart_->request);
+        }
         ReleaseOutput();
     }
 
 
     void StartStreaming() override {
-        if (IsRunning())
+        delayedStart_->stop();
+        if (IsRunning() || pendingStart_)
             return;
 
+        // the name can change between runs, the lane follows it
+        int lane = GetTracer()->Lane(config_->name + " (" + targetid_ + ")");
+        traceLane_ = lane;
+        startPressedNs_ = TraceNow();
+        reconnects_ = 0;
+        reconnectBeganNs_ = 0;
+        lastReconnectMs_ = -1;
+        maxReconnectMs_ = 0;
+        downtimeMs_ = 0;
+        sessionBytes_ = {};
+        sessionFrames_ = {};
+        sessionDropped_ = {};
+        sessionStartedAt_ = static_cast<int64_t>(time(nullptr));
+        liveMs_ = 0;
+        liveSinceNs_ = 0;
+        TRACE_SCOPE(lane, "StartStreaming");
+
         // recreate output
-        ReleaseOutput();
+        {
+            TRACE_SCOPE(lane, "ReleaseOutput");
+            ReleaseOutput();
+        }
 
         if (output_ == nullptr)
         {
@@ -610,23 +735,54 @@ public:
 
             blog(LOG_DEBUG, "Streaming to output: %s", output_id);
 
-            output_ = obs_output_create(output_id, "multi-output", output_settings, nullptr);
+            if (config_->protocol == "FILE") {
+                auto path = obs_data_get_string(output_settings, "path");
+                if (!path || !*path)
+                    obs_data_set_string(output_settings, "path", MakeRecordingPath(config_->name).c_str());
+            }
+
+            egressManaged_ = config_->autoEgress && EgressSupportsOutput(output_id);
+            if (egressManaged_) {
+                egressAddress_ = GetEgressManager()->Assign(targetid_);
+                if (!egressAddress_.empty())
+                    obs_data_set_string(output_settings, "bind_ip", egressAddress_.c_str());
+            }
+
+            {
+                TRACE_SCOPE(lane, "obs_output_create");
+                output_ = obs_output_create(output_id, "multi-output", output_settings, nullptr);
+            }
             SetMeAsHandler(output_);
+            GetBurstMeter()->Attach(output_);
+            packetStats_->Attach(output_);
         }    
 
-        if (!PrepareOutputService())
+        bool prepared;
+        {
+            TRACE_SCOPE(lane, "PrepareOutputService");
+            prepared = PrepareOutputService();
+        }
+        if (!prepared)
         {
             SetMsg(obs_module_text("Error.CreateRtmpService"));
             return;
         }
 
-        if (!PrepareOutputEncoders())
+        {
+            TRACE_SCOPE(lane, "PrepareOutputEncoders");
+            prepared = PrepareOutputEncoders();
+        }
+        if (!prepared)
         {
             SetMsg(obs_module_text("Error.CreateEncoder"));
             return;
         }
 
-        if (!PrepareEncoderSource())
+        {
+            TRACE_SCOPE(lane, "PrepareEncoderSource");
+            prepared = PrepareEncoderSource();
+        }
+        if (!prepared)
         {
             SetMsg(obs_module_text("Error.SceneNotExist"));
             return;
@@ -649,46 +805,31 @@ public:
                 if (useDelay && delaySec > 0)
                     isUseDelay_ = true;
             }
-            if (config_->streamlabsToken) {
-                obs_service_t *service = obs_output_get_service(output_);
-                obs_data_t *servSettings = obs_service_get_settings(service);
-                bool use_auth = obs_data_get_bool(servSettings, "use_auth");
-                const char *pass = obs_data_get_string(servSettings, "password");
-
-                if (use_auth) {
-                    if (pass && strlen(pass) > 0) {
-                        std::string token = pass;
-                        auto [success, errorMessage, newServer, newKey] = StreamlabsAPI::StartStream(token, config_->streamlabsTitle, StreamlabsAPI::CategorySearch(token, config_->streamlabsCategory), config_->streamlabsMatureContent ? 1 : 0);
-                        if (success) {
-                            // Update the service with the new server and key
-                            obs_service_t* service = obs_output_get_service(output_);
-                            if (service) {
-                                obs_data_t* servSettings = obs_service_get_settings(service);
-                                if (servSettings) {
-                                    obs_data_set_string(servSettings, "key", newKey.c_str());
-                                    obs_data_set_string(servSettings, "server", newServer.c_str());
-                                    obs_service_update(service, servSettings);
-                                    obs_data_release(servSettings);
-                                }
-                            }
-                        } else {
-                            SetMsg(QString::fromStdString(errorMessage));
-                            return;
-                        }
-        
-
-
-                    } else {
+            if (config_->streamlabsToken && obs_output_get_service(output_)) {
+                std::string token;
+                OBSDataAutoRelease servSettings = obs_service_get_settings(obs_output_get_service(output_));
+                if (obs_data_get_bool(servSettings, "use_auth")) {
+                    const char *pass = obs_data_get_string(servSettings, "password");
+                    if (!pass || strlen(pass) == 0) {
                         SetMsg(obs_module_text("Error.StreamlabsToken"));
                         return;
                     }
+                    token = pass;
                 }
-                obs_data_release(servSettings);
 
+                if (!token.empty()) {
+                    RequestStreamlabsStream(token);
+                    return;
+                }
             }
-
         }
 
+        StartOutput();
+    }
+
+    void StartOutput()
+    {
+        TRACE_SCOPE(traceLane_, "obs_output_start");
         if (!obs_output_start(output_))
         {
             SetMsg(obs_module_text("Error.StartOutput"));
@@ -696,7 +837,115 @@ public:
         }
     }
 
+    // The stream key is requested in the background, the output is started once it arrives.
+    void RequestStreamlabsStream(const std::string& token)
+    {
+        auto pending = std::make_shared<PendingStreamlabsStart>();
+        pendingStart_ = pending;
+
+        remove_btn_->setEnabled(false);
+        btn_->setText(obs_module_text("Status.Stop"));
+        SetMsg(obs_module_text("Status.RequestingStreamKey"));
+
+        QPointer<QObject> guard(this);
+        auto title = config_->streamlabsTitle;
+        auto audienceType = config_->streamlabsMatureContent ? 1 : 0;
+
+        int lane = traceLane_;
+        auto requestedNs = TraceNow();
+        auto onStarted = [this, guard, pending, token, lane, requestedNs](StartStreamResult result) {
+            GetTracer()->Complete(lane, "Streamlabs start request", requestedNs, TraceNow());
+            GetGlobalService().RunInUIThread([this, guard, pending, token, result]() {
+                auto [success, errorMessage, newServer, newKey] = result;
+                if (!guard || pendingStart_ != pending) {
+                    // cancelled while the request was in flight
+                    if (success)
+                        GetEndStreamQueue()->Enqueue(token, StreamlabsAPI::ExtractStreamId(newKey));
+                    return;
+                }
+                pendingStart_.reset();
+                OnStreamlabsStreamStarted(success, errorMessage, newServer, newKey);
+            });
+        };
+
+        auto& category = config_->streamlabsCategory;
+        if (auto cached = GetCategoryCache()->Lookup(category)) {
+            pending->request = StreamlabsAPI::StartStream(token, title, *cached, audienceType, onStarted);
+            return;
+        }
+
+        auto searchId = StreamlabsAPI::CategorySearch(token, category, [pending, token, title, category, audienceType, onStarted](std::string gameMaskId) {
+            GetCategoryCache()->Store(category, gameMaskId);
+            if (pending->cancelled)
+                return;
+            pending->request = StreamlabsAPI::StartStream(token, title, gameMaskId, audienceType, onStarted);
+        });
+        HttpRequestId none = 0;
+        pending->request.compare_exchange_strong(none, searchId);
+    }
+
+    void OnStreamlabsStreamStarted(bool success, const std::string& errorMessage, const std::string& newServer, const std::string& newKey)
+    {
+        if (!success || !output_) {
+            ResetButtons();
+            SetMsg(QString::fromStdString(errorMessage));
+            ReleaseOutputEncoder();
+            ReleaseOutputSceneView();
+            return;
+        }
+
+        // Update the service with the new server and key
+        obs_service_t* service = obs_output_get_service(output_);
+        if (service) {
+            obs_data_t* servSettings = obs_service_get_settings(service);
+            if (servSettings) {
+                obs_data_set_string(servSettings, "key", newKey.c_str());
+                obs_data_set_string(servSettings, "server", newServer.c_str());
+                obs_service_update(service, servSettings);
+                obs_data_release(servSettings);
+            }
+        }
+
+        StartOutput();
+    }
+
+    void CancelPendingStart()
+    {
+        if (!pendingStart_)
+            return;
+
+        pendingStart_->cancelled = true;
+        GetHttpClient()->Cancel(pendingStart_->request);
+        pendingStart_.reset();
+
+        ResetButtons();
+        SetMsg(u8"");
+        ReleaseOutputEncoder();
+        ReleaseOutputSceneView();
+    }
+
+    void ResetButtons()
+    {
+        remove_btn_->setEnabled(true);
+        btn_->setText(obs_module_text("Btn.Start"));
+        btn_->setEnabled(true);
+    }
+
+    void StartStreamingAfter(int delayMs) override {
+        delayedStart_->start(delayMs);
+    }
+
     void StopStreaming() override {
+        TRACE_SCOPE(traceLane_, "StopStreaming");
+        if (delayedStart_->isActive()) {
+            delayedStart_->stop();
+            return;
+        }
+        if (pendingStart_) {
+            CancelPendingStart();
+            return;
+        }
+
         if (!IsRunning())
             return;
         
@@ -717,7 +966,7 @@ public:
         else
             obs_output_force_stop(output_);
         
-        if (config_->streamlabsToken) {
+        if (config_->streamlabsToken && obs_output_get_service(output_)) {
             obs_service_t *service = obs_output_get_service(output_);
             obs_data_t *servSettings = obs_service_get_settings(service);
             bool use_auth = obs_data_get_bool(servSettings, "use_auth");
@@ -727,7 +976,7 @@ public:
             if (use_auth) {
                 if (pass && strlen(pass) > 0) {
                     std::string token = pass;
-                    StreamlabsAPI::EndStream(token, StreamlabsAPI::ExtractStreamId(key));
+                    GetEndStreamQueue()->Enqueue(token, StreamlabsAPI::ExtractStreamId(key));
                 }
             }
             obs_data_release(servSettings);
@@ -752,11 +1001,13 @@ public:
         }
     }
 
-    void LoadConfig()
+    void LoadConfig() override
     {
         name_->setText(QString::fromUtf8(config_->name));
+        GetStatsRegistry()->Publish(GetHealth());
     }
 
+    // Only resets the rate baselines, the run totals live in the session counters.
     void ResetInfo()
     {
         total_frames_ = 0;
@@ -765,14 +1016,112 @@ public:
         msg_->setText("");
     }
 
-    bool IsRunning()
+    bool IsRunning() override
     {
         return output_ != nullptr && obs_output_active(output_); 
     }
 
+    // Queued bytes peak of outputs that keep their own send queue, 0 for the others.
+    uint64_t QueryQueueHighWater()
+    {
+        if (!output_)
+            return 0;
+        calldata_t cd;
+        calldata_init(&cd);
+        uint64_t bytes = 0;
+        if (proc_handler_call(obs_output_get_proc_handler(output_), "get_queue_high_water", &cd))
+            bytes = static_cast<uint64_t>(calldata_int(&cd, "bytes"));
+        calldata_free(&cd);
+        return bytes;
+    }
+
+    int64_t SessionLiveMs() const
+    {
+        if (!liveSinceNs_)
+            return liveMs_;
+        return liveMs_ + static_cast<int64_t>((os_gettime_ns() - liveSinceNs_) / 1000000);
+    }
+
+    void PauseLiveTime(uint64_t nowNs)
+    {
+        if (liveSinceNs_) {
+            liveMs_ += static_cast<int64_t>((nowNs - liveSinceNs_) / 1000000);
+            liveSinceNs_ = 0;
+        }
+    }
+
+    void FinishSession(int code, uint64_t stoppedNs)
+    {
+        // samples the counters of the last connection before live time stops
+        auto health = GetHealth();
+        PauseLiveTime(stoppedNs);
+        health.liveMs = liveMs_;
+        blog(LOG_INFO, TAG "\"%s\" stopped with code %d after %lld ms live: %d reconnects, longest %lld ms, "
+            "down %lld ms, %llu bytes, %d frames dropped, send queue peak %llu bytes",
+            health.name.c_str(), code, (long long)health.liveMs, health.reconnects, (long long)health.maxReconnectMs,
+            (long long)health.downtimeMs, (unsigned long long)health.totalBytes, health.droppedFrames,
+            (unsigned long long)health.queueHighWater);
+
+        SessionSummary session;
+        session.targetId = targetid_;
+        session.name = config_->name;
+        session.protocol = config_->protocol;
+        session.startedAt = sessionStartedAt_;
+        session.endedAt = static_cast<int64_t>(time(nullptr));
+        session.stopCode = code;
+        session.liveMs = health.liveMs;
+        session.downtimeMs = health.downtimeMs;
+        session.reconnects = health.reconnects;
+        session.maxReconnectMs = health.maxReconnectMs;
+        session.totalBytes = health.totalBytes;
+        session.totalFrames = health.totalFrames;
+        session.droppedFrames = static_cast<uint64_t>(std::max(health.droppedFrames, 0));
+        GetSessionHistory()->Append(session);
+    }
+
+    TargetHealth GetHealth() override
+    {
+        TargetHealth health;
+        health.id = targetid_;
+        health.name = config_->name;
+        health.tags = config_->tags;
+        health.running = IsRunning();
+        health.reconnecting = reconnectBeganNs_ != 0;
+        health.reconnects = reconnects_;
+        health.lastReconnectMs = lastReconnectMs_;
+        health.maxReconnectMs = maxReconnectMs_;
+        health.downtimeMs = downtimeMs_;
+        health.queueHighWater = QueryQueueHighWater();
+        if (output_) {
+            // counters are frozen during an outage and restart with the next connection
+            if (liveSinceNs_) {
+                sessionBytes_.Update(obs_output_get_total_bytes(output_));
+                sessionFrames_.Update(static_cast<uint64_t>(std::max(obs_output_get_total_frames(output_), 0)));
+                sessionDropped_.Update(static_cast<uint64_t>(std::max(obs_output_get_frames_dropped(output_), 0)));
+            }
+            health.congestion = obs_output_get_congestion(output_);
+        }
+        health.totalBytes = sessionBytes_.Total();
+        health.totalFrames = sessionFrames_.Total();
+        health.droppedFrames = static_cast<int>(sessionDropped_.Total());
+        health.liveMs = SessionLiveMs();
+
+        health.videoEncoderShared = using_main_video_encoder_;
+        health.audioEncoderShared = using_main_audio_encoder_;
+        for (auto& target : GlobalMultiOutputConfig().targets) {
+            if (target->id == targetid_)
+                continue;
+            if (config_->videoConfig.has_value() && target->videoConfig == config_->videoConfig)
+                health.videoEncoderShared = true;
+            if (config_->audioConfig.has_value() && target->audioConfig == config_->audioConfig)
+                health.audioEncoderShared = true;
+        }
+        return health;
+    }
+
     void StartStop()
     {
-        if (IsRunning())
+        if (IsRunning() || pendingStart_)
         {
             StopStreaming();
             return;
@@ -783,6 +1132,8 @@ public:
 
     void Stop()
     {
+        CancelPendingStart();
+
         if (IsRunning())
         {
             obs_output_force_stop(output_);
@@ -812,8 +1163,9 @@ public:
     // obs logical
     void OnStarting() override
     {
+        GetTracer()->Instant(traceLane_, "starting");
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Starting);
         GetGlobalService().RunInUIThread([this]() {
-            begin_time_ = clock::now();
             remove_btn_->setEnabled(false);
             btn_->setText(obs_module_text("Status.Stop"));
             btn_->setEnabled(true);
@@ -824,11 +1176,16 @@ public:
 
     void OnStarted() override
     {
-        GetGlobalService().RunInUIThread([this]() {
+        GetTracer()->Complete(traceLane_, "start to started", startPressedNs_, TraceNow());
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Started);
+        auto startedNs = os_gettime_ns();
+        GetGlobalService().RunInUIThread([this, startedNs]() {
+            liveSinceNs_ = startedNs;
             remove_btn_->setEnabled(false);
             btn_->setText(obs_module_text("Status.Stop"));
             btn_->setEnabled(true);
             SetMsg(obs_module_text("Status.Streaming"));
+            GetStatsRegistry()->Publish(GetHealth());
 
             ResetInfo();
             timer_->start();
@@ -837,23 +1194,71 @@ public:
 
     void OnReconnect() override
     {
-        GetGlobalService().RunInUIThread([this]() {
+        ++reconnects_;
+        // libobs signals every retry, the outage starts with the first one
+        uint64_t none = 0;
+        reconnectBeganNs_.compare_exchange_strong(none, os_gettime_ns());
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Reconnecting);
+        // the new bind_ip is picked up when the output connects again
+        if (egressManaged_) {
+            auto address = GetEgressManager()->Reassign(targetid_);
+            if (address != egressAddress_) {
+                egressAddress_ = address;
+                OBSDataAutoRelease settings = obs_data_create();
+                obs_data_set_string(settings, "bind_ip", address.empty() ? "default" : address.c_str());
+                obs_output_update(output_, settings);
+            }
+        }
+
+        // the counters still belong to the lost connection until the next one starts
+        auto lostNs = os_gettime_ns();
+        uint64_t bytes = obs_output_get_total_bytes(output_);
+        int frames = obs_output_get_total_frames(output_);
+        int dropped = obs_output_get_frames_dropped(output_);
+        GetGlobalService().RunInUIThread([this, lostNs, bytes, frames, dropped]() {
+            // later retries find live time already paused
+            if (liveSinceNs_) {
+                sessionBytes_.Update(bytes);
+                sessionFrames_.Update(static_cast<uint64_t>(std::max(frames, 0)));
+                sessionDropped_.Update(static_cast<uint64_t>(std::max(dropped, 0)));
+                PauseLiveTime(lostNs);
+            }
             timer_->stop();
 
             remove_btn_->setEnabled(false);
             btn_->setText(obs_module_text("Status.Stop"));
             btn_->setEnabled(true);
             SetMsg(obs_module_text("Status.Reconnecting"));
+            GetStatsRegistry()->Publish(GetHealth());
         });
     }
 
     void OnReconnected() override
     {
-        GetGlobalService().RunInUIThread([this]() {
+        int64_t outageMs = -1;
+        if (auto began = reconnectBeganNs_.exchange(0)) {
+            outageMs = static_cast<int64_t>((os_gettime_ns() - began) / 1000000);
+            lastReconnectMs_ = outageMs;
+            if (outageMs > maxReconnectMs_)
+                maxReconnectMs_ = outageMs;
+            downtimeMs_ += outageMs;
+        }
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Reconnected);
+
+        auto reconnectedNs = os_gettime_ns();
+        GetGlobalService().RunInUIThread([this, outageMs, reconnectedNs]() {
+            if (outageMs >= 0)
+                blog(LOG_INFO, TAG "\"%s\" reconnected after %lld ms", config_->name.c_str(), (long long)outageMs);
+            sessionBytes_.Restart();
+            sessionFrames_.Restart();
+            sessionDropped_.Restart();
+            liveSinceNs_ = reconnectedNs;
+
             remove_btn_->setEnabled(false);
             btn_->setText(obs_module_text("Status.Stop"));
             btn_->setEnabled(true);
             SetMsg(obs_module_text("Status.Streaming"));
+            GetStatsRegistry()->Publish(GetHealth());
 
             ResetInfo();
             timer_->start();
@@ -862,6 +1267,7 @@ public:
 
     void OnStopping() override
     {
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Stopping);
         GetGlobalService().RunInUIThread([this]() {
             timer_->stop();
 
@@ -874,7 +1280,16 @@ public:
 
     void OnStopped(int code) override
     {
-        GetGlobalService().RunInUIThread([this, code]() {
+        GetTracer()->Instant(traceLane_, "stopped");
+        GetControlSocket()->PostEvent(targetid_, ControlEvent::Stopped, code);
+        // still set when the output gave up reconnecting
+        if (auto began = reconnectBeganNs_.exchange(0))
+            downtimeMs_ += static_cast<int64_t>((os_gettime_ns() - began) / 1000000);
+
+        auto stoppedNs = os_gettime_ns();
+        GetGlobalService().RunInUIThread([this, code, stoppedNs]() {
+            FinishSession(code, stoppedNs);
+            GetStatsRegistry()->Publish(GetHealth());
             ResetInfo();
             timer_->stop();
 
@@ -906,6 +1321,11 @@ public:
             }
         });
 
+        if (egressManaged_) {
+            GetEgressManager()->Release(targetid_);
+            egressManaged_ = false;
+        }
+
         ReleaseOutputEncoder();
         ReleaseOutputSceneView();
     }
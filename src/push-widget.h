@@ -1,11 +1,18 @@
 #include "pch.h"
+#include "stats-registry.h"
 
 class PushWidget : virtual public QWidget {
 public:
     virtual ~PushWidget() {}
     virtual bool ShowEditDlg() = 0;
     virtual void StartStreaming() = 0;
+    // Starts after delayMs unless StopStreaming comes first.
+    virtual void StartStreamingAfter(int delayMs) = 0;
     virtual void StopStreaming() = 0;
+    virtual bool IsRunning() = 0;
+    virtual TargetHealth GetHealth() = 0;
+    // Refreshes the widget after its target config was changed elsewhere.
+    virtual void LoadConfig() = 0;
     virtual void OnOBSEvent(obs_frontend_event ev) = 0;
     virtual QPushButton* GetDeleteButton() = 0;
 };
@@ -0,0 +1,1028 @@
+#include "rtmp-publisher.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "pch.h"
+
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+static const size_t kHandshakeSize = 1536;
+static const uint32_t kOutChunkSize = 4096;
+static const uint32_t kControlCsid = 2;
+static const uint32_t kCommandCsid = 3;
+static const uint32_t kAudioCsid = 4;
+static const uint32_t kDataCsid = 5;
+static const uint32_t kVideoCsid = 6;
+// a blocking send fails after this long without progress
+static const int kSendTimeoutMs = 5000;
+
+enum RtmpControlType : uint8_t {
+    SetChunkSize = 1,
+    AbortMessage = 2,
+    Acknowledgement = 3,
+    UserControl = 4,
+    WindowAckSize = 5,
+    SetPeerBandwidth = 6,
+    CommandAmf3 = 17,
+    CommandAmf0 = 20,
+};
+
+static void PutBE16(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+static void PutBE24(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+static void PutBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    PutBE24(out, v);
+}
+
+static void PutLE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 24));
+}
+
+static uint32_t BE16(const uint8_t* p) { return (uint32_t(p[0]) << 8) | p[1]; }
+static uint32_t BE24(const uint8_t* p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+static uint32_t BE32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | BE24(p + 1); }
+static uint32_t LE32(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+
+class AmfWriter {
+public:
+    std::vector<uint8_t> data;
+
+    void Number(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        data.push_back(0x00);
+        for (int i = 7; i >= 0; --i)
+            data.push_back(uint8_t(bits >> (i * 8)));
+    }
+
+    void String(const std::string& value)
+    {
+        data.push_back(0x02);
+        Key(value);
+    }
+
+    void Key(const std::string& key)
+    {
+        auto size = std::min<size_t>(key.size(), 0xFFFF);
+        PutBE16(data, uint32_t(size));
+        data.insert(data.end(), key.begin(), key.begin() + size);
+    }
+
+    void Null() { data.push_back(0x05); }
+    void BeginObject() { data.push_back(0x03); }
+
+    void BeginEcmaArray(uint32_t count)
+    {
+        data.push_back(0x08);
+        PutBE32(data, count);
+    }
+
+    void EndObject() { PutBE24(data, 0x000009); }
+};
+
+struct AmfValue {
+    enum class Type { Number, Boolean, String, Object, Null, Other } type = Type::Null;
+    double number = 0;
+    std::string string;
+    std::vector<std::pair<std::string, AmfValue>> properties;
+
+    const AmfValue* Find(const char* key) const
+    {
+        for (auto& [name, value] : properties) {
+            if (name == key)
+                return &value;
+        }
+        return nullptr;
+    }
+
+    std::string StringOf(const char* key) const
+    {
+        auto value = Find(key);
+        return value && value->type == Type::String ? value->string : std::string();
+    }
+};
+
+class AmfReader {
+    const uint8_t* p_;
+    const uint8_t* end_;
+
+    bool Need(size_t n) const { return size_t(end_ - p_) >= n; }
+
+    bool ReadString(std::string& out, size_t lengthBytes)
+    {
+        if (!Need(lengthBytes))
+            return false;
+        size_t length = lengthBytes == 2 ? BE16(p_) : BE32(p_);
+        p_ += lengthBytes;
+        if (!Need(length))
+            return false;
+        out.assign(reinterpret_cast<const char*>(p_), length);
+        p_ += length;
+        return true;
+    }
+
+    bool ReadProperties(AmfValue& value, int depth)
+    {
+        for (;;) {
+            if (Need(3) && BE24(p_) == 0x000009) {
+                p_ += 3;
+                return true;
+            }
+            std::string key;
+            AmfValue item;
+            if (!ReadString(key, 2) || !Read(item, depth + 1))
+                return false;
+            value.properties.emplace_back(std::move(key), std::move(item));
+        }
+    }
+
+public:
+    AmfReader(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+    bool AtEnd() const { return p_ >= end_; }
+
+    bool Read(AmfValue& value, int depth = 0)
+    {
+        if (depth > 16 || !Need(1))
+            return false;
+
+        auto marker = *p_++;
+        switch (marker) {
+        case 0x00: {
+            if (!Need(8))
+                return false;
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; ++i)
+                bits = (bits << 8) | p_[i];
+            p_ += 8;
+            memcpy(&value.number, &bits, sizeof(bits));
+            value.type = AmfValue::Type::Number;
+            return true;
+        }
+        case 0x01:
+            if (!Need(1))
+                return false;
+            value.type = AmfValue::Type::Boolean;
+            value.number = *p_++ ? 1 : 0;
+            return true;
+        case 0x02:
+            value.type = AmfValue::Type::String;
+            return ReadString(value.string, 2);
+        case 0x0C:
+            value.type = AmfValue::Type::String;
+            return ReadString(value.string, 4);
+        case 0x03:
+            value.type = AmfValue::Type::Object;
+            return ReadProperties(value, depth);
+        case 0x08:
+            if (!Need(4))
+                return false;
+            p_ += 4;
+            value.type = AmfValue::Type::Object;
+            return ReadProperties(value, depth);
+        case 0x0A: {
+            if (!Need(4))
+                return false;
+            auto count = BE32(p_);
+            p_ += 4;
+            value.type = AmfValue::Type::Other;
+            for (uint32_t i = 0; i < count; ++i) {
+                AmfValue item;
+                if (!Read(item, depth + 1))
+                    return false;
+                value.properties.emplace_back(std::string(), std::move(item));
+            }
+            return true;
+        }
+        case 0x0B:
+            if (!Need(10))
+                return false;
+            p_ += 10;
+            value.type = AmfValue::Type::Other;
+            return true;
+        case 0x05:
+        case 0x06:
+            value.type = AmfValue::Type::Null;
+            return true;
+        default:
+            return false;
+        }
+    }
+};
+
+static void InitSockets()
+{
+#ifdef _WIN32
+    static std::once_flag once;
+    std::call_once(once, []() {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    });
+#endif
+}
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void SetNonBlocking(SocketHandle socket, bool enable)
+{
+#ifdef _WIN32
+    u_long mode = enable ? 1 : 0;
+    ioctlsocket(socket, FIONBIO, &mode);
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+static void SetSendTimeout(SocketHandle socket, int timeoutMs)
+{
+#ifdef _WIN32
+    DWORD timeout = static_cast<DWORD>(timeoutMs);
+#else
+    timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+#endif
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+static bool ConnectInProgress()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS;
+#endif
+}
+
+static bool ParseRtmpUrl(const std::string& url, std::string& host, std::string& port, std::string& app, std::string& tcUrl, std::string& error)
+{
+    std::string lower = url;
+    for (auto& c : lower)
+        c = static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+
+    const std::string scheme = "rtmp://";
+    if (lower.compare(0, scheme.size(), scheme) != 0) {
+        error = "Only rtmp:// URLs are supported: " + url;
+        return false;
+    }
+
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto hostPort = rest.substr(0, slash);
+    app = slash == std::string::npos ? std::string() : rest.substr(slash + 1);
+    while (!app.empty() && app.back() == '/')
+        app.pop_back();
+
+    port = "1935";
+    if (!hostPort.empty() && hostPort[0] == '[') {
+        auto close = hostPort.find(']');
+        if (close == std::string::npos) {
+            error = "Invalid server address: " + url;
+            return false;
+        }
+        host = hostPort.substr(1, close - 1);
+        if (close + 1 < hostPort.size() && hostPort[close + 1] == ':')
+            port = hostPort.substr(close + 2);
+    } else {
+        auto colon = hostPort.rfind(':');
+        host = hostPort.substr(0, colon);
+        if (colon != std::string::npos)
+            port = hostPort.substr(colon + 1);
+    }
+
+    if (host.empty() || app.empty() || port.empty()) {
+        error = "Invalid server address: " + url;
+        return false;
+    }
+    tcUrl = scheme + hostPort + "/" + app;
+    return true;
+}
+
+class RtmpPublisherImpl : public RtmpPublisher {
+    using Clock = std::chrono::steady_clock;
+
+    struct InboundChunkStream {
+        uint32_t length = 0;
+        uint32_t streamId = 0;
+        uint8_t type = 0;
+        bool extended = false;
+        std::vector<uint8_t> payload;
+    };
+
+    struct Message {
+        uint8_t type = 0;
+        uint32_t streamId = 0;
+        std::vector<uint8_t> payload;
+    };
+
+    std::mutex socketMutex_;
+    SocketHandle socket_ = kInvalidSocket;
+    std::atomic<bool> aborted_ = false;
+
+    std::string streamKey_;
+    std::string bindAddress_;
+    uint32_t streamId_ = 0;
+    double transaction_ = 0;
+
+    uint32_t inChunkSize_ = 128;
+    uint32_t ackWindow_ = 2500000;
+    uint64_t bytesReceived_ = 0;
+    uint64_t lastAck_ = 0;
+    std::atomic<uint64_t> bytesSent_ = 0;
+
+    std::vector<uint8_t> in_;
+    size_t inPos_ = 0;
+    std::unordered_map<uint32_t, InboundChunkStream> inbound_;
+    std::vector<uint8_t> out_;
+
+    // Waits for the socket in short slices so that Abort is noticed. 1 ready, 0 timeout, -1 error.
+    int WaitSocket(short events, int timeoutMs)
+    {
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (;;) {
+            if (aborted_)
+                return -1;
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            int slice = static_cast<int>(std::clamp<int64_t>(remaining, 0, 100));
+#ifdef _WIN32
+            WSAPOLLFD pfd = { socket_, events, 0 };
+            int ret = WSAPoll(&pfd, 1, slice);
+#else
+            pollfd pfd = { socket_, events, 0 };
+            int ret = poll(&pfd, 1, slice);
+            if (ret < 0 && errno == EINTR)
+                ret = 0;
+#endif
+            if (ret < 0)
+                return -1;
+            if (ret > 0) {
+                if ((pfd.revents & events) == 0)
+                    return -1;
+                return 1;
+            }
+            if (remaining <= 0)
+                return 0;
+        }
+    }
+
+    bool SendAll(const uint8_t* data, size_t size)
+    {
+#if defined(MSG_NOSIGNAL)
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while (size > 0) {
+            auto sent = ::send(socket_, reinterpret_cast<const char*>(data), static_cast<int>(std::min<size_t>(size, 1 << 20)), flags);
+            if (sent <= 0) {
+#ifndef _WIN32
+                if (sent < 0 && errno == EINTR)
+                    continue;
+#endif
+                return false;
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+            bytesSent_ += static_cast<uint64_t>(sent);
+        }
+        return true;
+    }
+
+    bool WriteMessage(uint32_t csid, uint8_t type, uint32_t streamId, uint32_t timestamp, const uint8_t* data, size_t size)
+    {
+        if (size > 0xFFFFFF)
+            return false;
+
+        bool extended = timestamp >= 0xFFFFFF;
+        out_.clear();
+        out_.reserve(size + (size / kOutChunkSize + 1) * 8 + 16);
+
+        out_.push_back(uint8_t(csid));
+        PutBE24(out_, extended ? 0xFFFFFF : timestamp);
+        PutBE24(out_, static_cast<uint32_t>(size));
+        out_.push_back(type);
+        PutLE32(out_, streamId);
+        if (extended)
+            PutBE32(out_, timestamp);
+
+        size_t offset = 0;
+        do {
+            if (offset > 0) {
+                out_.push_back(uint8_t(0xC0 | csid));
+                if (extended)
+                    PutBE32(out_, timestamp);
+            }
+            auto n = std::min<size_t>(size - offset, kOutChunkSize);
+            out_.insert(out_.end(), data + offset, data + offset + n);
+            offset += n;
+        } while (offset < size);
+
+        return SendAll(out_.data(), out_.size());
+    }
+
+    bool SendControl(uint8_t type, const std::vector<uint8_t>& payload)
+    {
+        return WriteMessage(kControlCsid, type, 0, 0, payload.data(), payload.size());
+    }
+
+    bool SendCommand(const AmfWriter& command, uint32_t streamId = 0)
+    {
+        return WriteMessage(kCommandCsid, CommandAmf0, streamId, 0, command.data.data(), command.data.size());
+    }
+
+    // Reads whatever arrives within timeoutMs. Bytes read, 0 on timeout, -1 once the connection is gone.
+    int ReceiveSome(int timeoutMs)
+    {
+        auto ready = WaitSocket(POLLIN, timeoutMs);
+        if (ready <= 0)
+            return ready;
+
+        uint8_t buffer[16384];
+        auto received = ::recv(socket_, reinterpret_cast<char*>(buffer), sizeof(buffer), 0);
+        if (received <= 0)
+            return -1;
+
+        if (inPos_ == in_.size()) {
+            in_.clear();
+            inPos_ = 0;
+        } else if (inPos_ > 65536) {
+            in_.erase(in_.begin(), in_.begin() + inPos_);
+            inPos_ = 0;
+        }
+        in_.insert(in_.end(), buffer, buffer + received);
+        bytesReceived_ += static_cast<uint64_t>(received);
+
+        if (bytesReceived_ - lastAck_ >= ackWindow_ / 2) {
+            std::vector<uint8_t> ack;
+            PutBE32(ack, static_cast<uint32_t>(bytesReceived_));
+            lastAck_ = bytesReceived_;
+            if (!SendControl(Acknowledgement, ack))
+                return -1;
+        }
+        return static_cast<int>(received);
+    }
+
+    bool ReceiveExactly(size_t size, Clock::time_point deadline)
+    {
+        while (in_.size() - inPos_ < size) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0 || ReceiveSome(static_cast<int>(remaining)) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    // 1 when a message is complete, 0 when more data is needed, -1 on protocol error.
+    int NextMessage(Message& message)
+    {
+        static const size_t kHeaderSizes[] = { 11, 7, 3, 0 };
+
+        for (;;) {
+            auto p = in_.data() + inPos_;
+            auto avail = in_.size() - inPos_;
+            if (avail < 1)
+                return 0;
+
+            uint8_t fmt = p[0] >> 6;
+            uint32_t csid = p[0] & 0x3F;
+            size_t pos = 1;
+            if (csid == 0) {
+                if (avail < 2)
+                    return 0;
+                csid = 64 + p[1];
+                pos = 2;
+            } else if (csid == 1) {
+                if (avail < 3)
+                    return 0;
+                csid = 64 + p[1] + p[2] * 256;
+                pos = 3;
+            }
+
+            if (avail < pos + kHeaderSizes[fmt])
+                return 0;
+
+            auto& stream = inbound_[csid];
+            uint32_t timestampField = fmt < 3 ? BE24(p + pos) : 0;
+            uint32_t length = fmt < 2 ? BE24(p + pos + 3) : stream.length;
+            uint8_t type = fmt < 2 ? p[pos + 6] : stream.type;
+            uint32_t streamId = fmt == 0 ? LE32(p + pos + 7) : stream.streamId;
+            pos += kHeaderSizes[fmt];
+
+            bool extended = fmt < 3 ? timestampField == 0xFFFFFF : stream.extended;
+            if (extended) {
+                if (avail < pos + 4)
+                    return 0;
+                pos += 4;
+            }
+
+            size_t have = fmt < 2 ? 0 : stream.payload.size();
+            if (have > length)
+                return -1;
+            auto need = std::min<size_t>(length - have, inChunkSize_);
+            if (avail < pos + need)
+                return 0;
+
+            stream.extended = extended;
+            stream.length = length;
+            stream.type = type;
+            stream.streamId = streamId;
+            if (fmt < 2)
+                stream.payload.clear();
+            stream.payload.insert(stream.payload.end(), p + pos, p + pos + need);
+            inPos_ += pos + need;
+
+            if (stream.payload.size() == stream.length) {
+                message.type = stream.type;
+                message.streamId = stream.streamId;
+                message.payload.swap(stream.payload);
+                stream.payload.clear();
+                return 1;
+            }
+        }
+    }
+
+    // Handles protocol control messages. False if the connection must be dropped.
+    bool HandleControl(const Message& message)
+    {
+        auto& payload = message.payload;
+        switch (message.type) {
+        case SetChunkSize:
+            if (payload.size() >= 4) {
+                inChunkSize_ = BE32(payload.data()) & 0x7FFFFFFF;
+                if (inChunkSize_ == 0)
+                    return false;
+            }
+            break;
+        case AbortMessage:
+            if (payload.size() >= 4)
+                inbound_[BE32(payload.data())].payload.clear();
+            break;
+        case WindowAckSize:
+            if (payload.size() >= 4)
+                ackWindow_ = std::max<uint32_t>(BE32(payload.data()), 1);
+            break;
+        case UserControl:
+            // ping request, answer with the same timestamp
+            if (payload.size() >= 6 && BE16(payload.data()) == 6) {
+                std::vector<uint8_t> pong;
+                PutBE16(pong, 7);
+                pong.insert(pong.end(), payload.begin() + 2, payload.begin() + 6);
+                return SendControl(UserControl, pong);
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    static bool DecodeCommand(const Message& message, std::vector<AmfValue>& values)
+    {
+        values.clear();
+        if (message.type != CommandAmf0 && message.type != CommandAmf3)
+            return false;
+
+        size_t skip = message.type == CommandAmf3 ? 1 : 0;
+        if (message.payload.size() < skip)
+            return false;
+        AmfReader reader(message.payload.data() + skip, message.payload.size() - skip);
+        while (!reader.AtEnd()) {
+            AmfValue value;
+            if (!reader.Read(value))
+                break;
+            values.push_back(std::move(value));
+        }
+        return values.size() >= 2 && values[0].type == AmfValue::Type::String;
+    }
+
+    bool ReadCommand(std::vector<AmfValue>& values, Clock::time_point deadline, std::string& error)
+    {
+        Message message;
+        for (;;) {
+            auto ret = NextMessage(message);
+            if (ret < 0) {
+                error = "RTMP protocol error";
+                return false;
+            }
+            if (ret > 0) {
+                if (!HandleControl(message)) {
+                    error = "RTMP protocol error";
+                    return false;
+                }
+                if (DecodeCommand(message, values))
+                    return true;
+                continue;
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) {
+                error = "Timed out waiting for the RTMP server";
+                return false;
+            }
+            if (ReceiveSome(static_cast<int>(remaining)) < 0) {
+                error = "Connection closed by the RTMP server";
+                return false;
+            }
+        }
+    }
+
+    static std::string DescribeStatus(const std::vector<AmfValue>& values)
+    {
+        for (auto& value : values) {
+            if (value.type != AmfValue::Type::Object)
+                continue;
+            auto code = value.StringOf("code");
+            auto description = value.StringOf("description");
+            if (!code.empty() || !description.empty())
+                return code + (description.empty() ? "" : ": " + description);
+        }
+        return "rejected by the RTMP server";
+    }
+
+    bool WaitForResult(double transaction, std::vector<AmfValue>& values, Clock::time_point deadline, std::string& error)
+    {
+        for (;;) {
+            if (!ReadCommand(values, deadline, error))
+                return false;
+            if (values[1].type != AmfValue::Type::Number || values[1].number != transaction)
+                continue;
+            if (values[0].string == "_result")
+                return true;
+            if (values[0].string == "_error") {
+                error = DescribeStatus(values);
+                return false;
+            }
+        }
+    }
+
+    bool OpenSocket(const std::string& host, const std::string& port, Clock::time_point deadline, std::string& error)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0 || !addresses) {
+            error = "Could not resolve " + host;
+            return false;
+        }
+
+        addrinfo* local = nullptr;
+        if (!bindAddress_.empty()) {
+            addrinfo localHints = {};
+            localHints.ai_family = AF_UNSPEC;
+            localHints.ai_socktype = SOCK_STREAM;
+            localHints.ai_flags = AI_NUMERICHOST | AI_PASSIVE;
+            if (getaddrinfo(bindAddress_.c_str(), nullptr, &localHints, &local) != 0 || !local) {
+                freeaddrinfo(addresses);
+                error = "Invalid bind address " + bindAddress_;
+                return false;
+            }
+        }
+
+        error = "Could not connect to " + host + ":" + port;
+        bool connected = false;
+        for (auto addr = addresses; addr && !connected; addr = addr->ai_next) {
+            if (local && local->ai_family != addr->ai_family)
+                continue;
+            auto s = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+            if (s == kInvalidSocket)
+                continue;
+            if (local && ::bind(s, local->ai_addr, static_cast<int>(local->ai_addrlen)) != 0) {
+                CloseSocket(s);
+                error = "Could not bind to " + bindAddress_;
+                continue;
+            }
+            {
+                std::unique_lock lock(socketMutex_);
+                if (aborted_) {
+                    CloseSocket(s);
+                    break;
+                }
+                socket_ = s;
+            }
+#ifdef SO_NOSIGPIPE
+            int one = 1;
+            setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            SetNonBlocking(s, true);
+            if (::connect(s, addr->ai_addr, static_cast<int>(addr->ai_addrlen)) == 0) {
+                connected = true;
+            } else if (ConnectInProgress()) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                if (remaining > 0 && WaitSocket(POLLOUT, static_cast<int>(remaining)) > 0) {
+                    int soError = 0;
+                    socklen_t len = sizeof(soError);
+                    getsockopt(s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&soError), &len);
+                    connected = soError == 0;
+                }
+            }
+
+            if (connected) {
+                SetNonBlocking(s, false);
+                SetSendTimeout(s, kSendTimeoutMs);
+            } else {
+                std::unique_lock lock(socketMutex_);
+                CloseSocket(s);
+                socket_ = kInvalidSocket;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (local)
+            freeaddrinfo(local);
+        return connected;
+    }
+
+    bool Handshake(Clock::time_point deadline)
+    {
+        std::vector<uint8_t> c0c1(1 + kHandshakeSize, 0);
+        c0c1[0] = 0x03;
+        std::mt19937 random{ std::random_device{}() };
+        for (size_t i = 9; i < c0c1.size(); ++i)
+            c0c1[i] = static_cast<uint8_t>(random());
+        if (!SendAll(c0c1.data(), c0c1.size()))
+            return false;
+
+        if (!ReceiveExactly(1 + kHandshakeSize, deadline) || in_[inPos_] != 0x03)
+            return false;
+        // C2 echoes S1
+        std::vector<uint8_t> c2(in_.begin() + inPos_ + 1, in_.begin() + inPos_ + 1 + kHandshakeSize);
+        inPos_ += 1 + kHandshakeSize;
+        if (!SendAll(c2.data(), c2.size()))
+            return false;
+
+        if (!ReceiveExactly(kHandshakeSize, deadline))
+            return false;
+        inPos_ += kHandshakeSize;
+        return true;
+    }
+
+public:
+    ~RtmpPublisherImpl()
+    {
+        Close();
+    }
+
+    void SetBindAddress(const std::string& address) override
+    {
+        bindAddress_ = address;
+    }
+
+    bool Connect(const std::string& url, const std::string& streamKey, int timeoutMs, std::string& error) override
+    {
+        InitSockets();
+
+        std::string host, port, app, tcUrl;
+        if (!ParseRtmpUrl(url, host, port, app, tcUrl, error))
+            return false;
+        if (streamKey.empty()) {
+            error = "Stream key is empty";
+            return false;
+        }
+        streamKey_ = streamKey;
+
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        if (!OpenSocket(host, port, deadline, error))
+            return false;
+
+        if (!Handshake(deadline)) {
+            error = "RTMP handshake failed with " + host;
+            return false;
+        }
+
+        std::vector<uint8_t> chunkSize;
+        PutBE32(chunkSize, kOutChunkSize);
+        if (!SendControl(SetChunkSize, chunkSize)) {
+            error = "Connection closed by the RTMP server";
+            return false;
+        }
+
+        AmfWriter connect;
+        connect.String("connect");
+        connect.Number(++transaction_);
+        connect.BeginObject();
+        connect.Key("app");
+        connect.String(app);
+        connect.Key("type");
+        connect.String("nonprivate");
+        connect.Key("flashVer");
+        connect.String("FMLE/3.0 (compatible; FMSc/1.0)");
+        connect.Key("swfUrl");
+        connect.String(tcUrl);
+        connect.Key("tcUrl");
+        connect.String(tcUrl);
+        connect.EndObject();
+
+        std::vector<AmfValue> values;
+        if (!SendCommand(connect) || !WaitForResult(transaction_, values, deadline, error))
+            return false;
+
+        AmfWriter releaseStream;
+        releaseStream.String("releaseStream");
+        releaseStream.Number(++transaction_);
+        releaseStream.Null();
+        releaseStream.String(streamKey_);
+
+        AmfWriter fcPublish;
+        fcPublish.String("FCPublish");
+        fcPublish.Number(++transaction_);
+        fcPublish.Null();
+        fcPublish.String(streamKey_);
+
+        AmfWriter createStream;
+        createStream.String("createStream");
+        createStream.Number(++transaction_);
+        createStream.Null();
+
+        if (!SendCommand(releaseStream) || !SendCommand(fcPublish) || !SendCommand(createStream)
+            || !WaitForResult(transaction_, values, deadline, error))
+            return false;
+        if (values.size() < 4 || values[3].type != AmfValue::Type::Number) {
+            error = "RTMP server did not create a stream";
+            return false;
+        }
+        streamId_ = static_cast<uint32_t>(values[3].number);
+
+        AmfWriter publish;
+        publish.String("publish");
+        publish.Number(0);
+        publish.Null();
+        publish.String(streamKey_);
+        publish.String("live");
+        if (!SendCommand(publish, streamId_)) {
+            error = "Connection closed by the RTMP server";
+            return false;
+        }
+
+        for (;;) {
+            if (!ReadCommand(values, deadline, error))
+                return false;
+            if (values[0].string != "onStatus")
+                continue;
+            auto status = values.size() >= 4 ? &values[3] : nullptr;
+            if (!status)
+                continue;
+            if (status->StringOf("code") == "NetStream.Publish.Start")
+                return true;
+            if (status->StringOf("level") == "error") {
+                error = DescribeStatus(values);
+                return false;
+            }
+        }
+    }
+
+    bool SendMetadata(const std::vector<std::pair<std::string, double>>& fields) override
+    {
+        AmfWriter metadata;
+        metadata.String("@setDataFrame");
+        metadata.String("onMetaData");
+        metadata.BeginEcmaArray(static_cast<uint32_t>(fields.size()));
+        for (auto& [key, value] : fields) {
+            metadata.Key(key);
+            metadata.Number(value);
+        }
+        metadata.EndObject();
+        return Send(DataAmf0, 0, metadata.data.data(), metadata.data.size());
+    }
+
+    bool Send(MessageType type, uint32_t timestamp, const uint8_t* data, size_t size) override
+    {
+        if (aborted_ || socket_ == kInvalidSocket)
+            return false;
+        auto csid = type == Audio ? kAudioCsid : type == Video ? kVideoCsid : kDataCsid;
+        return WriteMessage(csid, type, streamId_, timestamp, data, size);
+    }
+
+    bool Poll() override
+    {
+        if (aborted_ || socket_ == kInvalidSocket)
+            return false;
+
+        for (;;) {
+            auto ret = ReceiveSome(0);
+            if (ret < 0)
+                return false;
+            if (ret == 0)
+                break;
+        }
+
+        Message message;
+        std::vector<AmfValue> values;
+        for (;;) {
+            auto ret = NextMessage(message);
+            if (ret < 0)
+                return false;
+            if (ret == 0)
+                return true;
+            if (!HandleControl(message))
+                return false;
+            if (DecodeCommand(message, values) && values[0].string == "onStatus" && values.size() >= 4) {
+                auto& status = values[3];
+                blog(LOG_INFO, TAG "RTMP status: %s", DescribeStatus(values).c_str());
+                if (status.StringOf("level") == "error")
+                    return false;
+            }
+        }
+    }
+
+    void Abort() override
+    {
+        std::unique_lock lock(socketMutex_);
+        aborted_ = true;
+        if (socket_ != kInvalidSocket) {
+#ifdef _WIN32
+            shutdown(socket_, SD_BOTH);
+#else
+            shutdown(socket_, SHUT_RDWR);
+#endif
+        }
+    }
+
+    void Close() override
+    {
+        if (socket_ == kInvalidSocket)
+            return;
+
+        if (!aborted_ && streamId_ != 0) {
+            AmfWriter fcUnpublish;
+            fcUnpublish.String("FCUnpublish");
+            fcUnpublish.Number(++transaction_);
+            fcUnpublish.Null();
+            fcUnpublish.String(streamKey_);
+
+            AmfWriter deleteStream;
+            deleteStream.String("deleteStream");
+            deleteStream.Number(++transaction_);
+            deleteStream.Null();
+            deleteStream.Number(streamId_);
+
+            if (SendCommand(fcUnpublish))
+                SendCommand(deleteStream);
+        }
+
+        std::unique_lock lock(socketMutex_);
+        CloseSocket(socket_);
+        socket_ = kInvalidSocket;
+        streamId_ = 0;
+    }
+
+    uint64_t BytesSent() const override
+    {
+        return bytesSent_;
+    }
+};
+
+std::unique_ptr<RtmpPublisher> CreateRtmpPublisher()
+{
+    return std::make_unique<RtmpPublisherImpl>();
+}
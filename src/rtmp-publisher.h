@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+// Minimal RTMP client for publishing: plain handshake, connect / createStream /
+// publish, and chunked sending of FLV tag bodies. Only rtmp:// is supported.
+// One thread drives a connection; Abort may be called from any thread.
+class RtmpPublisher {
+public:
+    enum MessageType : uint8_t {
+        Audio = 8,
+        Video = 9,
+        DataAmf0 = 18,
+    };
+
+    virtual ~RtmpPublisher() {}
+    // Local address to connect from, numeric IPv4 or IPv6. Empty lets the OS choose.
+    virtual void SetBindAddress(const std::string& address) = 0;
+    // Blocks until the server accepted the publish, failed, or timed out.
+    virtual bool Connect(const std::string& url, const std::string& streamKey, int timeoutMs, std::string& error) = 0;
+    // Sends @setDataFrame onMetaData with numeric properties.
+    virtual bool SendMetadata(const std::vector<std::pair<std::string, double>>& fields) = 0;
+    // Fails when the server takes no data for 5 seconds.
+    virtual bool Send(MessageType type, uint32_t timestamp, const uint8_t* data, size_t size) = 0;
+    // Handles pending server messages without blocking. False once the connection is gone.
+    virtual bool Poll() = 0;
+    // Unblocks Connect or Send running on another thread. The connection is unusable afterwards.
+    virtual void Abort() = 0;
+    // Unpublishes and closes the socket.
+    virtual void Close() = 0;
+    virtual uint64_t BytesSent() const = 0;
+};
+
+std::unique_ptr<RtmpPublisher> CreateRtmpPublisher();
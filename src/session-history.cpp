@@ -0,0 +1,80 @@
+#include "session-history.h"
+#include "pch.h"
+
+#include <mutex>
+#include <ctime>
+#include <cstdio>
+#include <util/platform.h>
+
+static std::string CsvField(const std::string& value)
+{
+    if (value.find_first_of(",\"\r\n") == std::string::npos)
+        return value;
+    std::string quoted = "\"";
+    for (auto c : value) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+class SessionHistoryImpl : public SessionHistory {
+    std::mutex mutex_;
+
+    static std::string FileName(int64_t endedAt)
+    {
+        auto time = static_cast<time_t>(endedAt);
+        tm local = {};
+#ifdef _WIN32
+        localtime_s(&local, &time);
+#else
+        localtime_r(&time, &local);
+#endif
+        char name[64] = { 0 };
+        strftime(name, sizeof(name), "sessions/%Y-%m-%d.csv", &local);
+        return name;
+    }
+
+public:
+    void Append(const SessionSummary& session) override
+    {
+        auto path = obs_module_config_path(FileName(session.endedAt).c_str());
+        auto dir = obs_module_config_path("sessions");
+        if (!path || !dir) {
+            bfree(path);
+            bfree(dir);
+            return;
+        }
+        std::string filename = path;
+        bfree(path);
+
+        std::unique_lock lock(mutex_);
+        os_mkdirs(dir);
+        bfree(dir);
+
+        auto file = os_fopen(filename.c_str(), "ab");
+        if (!file) {
+            blog(LOG_WARNING, TAG "Cannot write session history %s", filename.c_str());
+            return;
+        }
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0) {
+            fputs("target_id,name,protocol,started_at,ended_at,stop_code,live_ms,downtime_ms,"
+                "reconnects,max_reconnect_ms,bytes,frames,dropped_frames\n", file);
+        }
+        fprintf(file, "%s,%s,%s,%lld,%lld,%d,%lld,%lld,%d,%lld,%llu,%llu,%llu\n",
+            CsvField(session.targetId).c_str(), CsvField(session.name).c_str(), CsvField(session.protocol).c_str(),
+            (long long)session.startedAt, (long long)session.endedAt, session.stopCode,
+            (long long)session.liveMs, (long long)session.downtimeMs, session.reconnects,
+            (long long)session.maxReconnectMs, (unsigned long long)session.totalBytes,
+            (unsigned long long)session.totalFrames, (unsigned long long)session.droppedFrames);
+        fclose(file);
+    }
+};
+
+SessionHistory* GetSessionHistory()
+{
+    static SessionHistoryImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// One run of a target, from Start to the final stop, across its reconnects.
+struct SessionSummary {
+    std::string targetId;
+    std::string name;
+    std::string protocol;
+    // unix seconds
+    int64_t startedAt = 0;
+    int64_t endedAt = 0;
+    int stopCode = 0;
+    // connected time, excluding reconnect outages
+    int64_t liveMs = 0;
+    int64_t downtimeMs = 0;
+    int reconnects = 0;
+    int64_t maxReconnectMs = 0;
+    uint64_t totalBytes = 0;
+    uint64_t totalFrames = 0;
+    uint64_t droppedFrames = 0;
+};
+
+// Appends finished sessions to sessions/YYYY-MM-DD.csv in the module config
+// directory, one file per local day of the session end.
+class SessionHistory {
+public:
+    virtual ~SessionHistory() {}
+    virtual void Append(const SessionSummary& session) = 0;
+};
+
+SessionHistory* GetSessionHistory();
@@ -0,0 +1,115 @@
+#include "soak-collector.h"
+#include "pch.h"
+
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <util/platform.h>
+
+class SoakCollectorImpl : public SoakCollector {
+    struct Previous {
+        int droppedFrames = 0;
+        int reconnects = 0;
+        uint64_t totalBytes = 0;
+        bool running = false;
+    };
+
+    std::mutex mutex_;
+    os_cpu_usage_info_t* cpu_ = nullptr;
+    uint64_t startNs_ = 0;
+    uint64_t lastNs_ = 0;
+    uint64_t peakRss_ = 0;
+    std::map<std::string, Previous> previous_;
+
+public:
+    ~SoakCollectorImpl()
+    {
+        if (cpu_)
+            os_cpu_usage_info_destroy(cpu_);
+    }
+
+    void Start() override
+    {
+        std::unique_lock lock(mutex_);
+        if (cpu_)
+            return;
+        cpu_ = os_cpu_usage_info_start();
+        startNs_ = lastNs_ = os_gettime_ns();
+        peakRss_ = 0;
+        previous_.clear();
+        blog(LOG_INFO, TAG "Soak statistics started");
+    }
+
+    void Stop() override
+    {
+        std::unique_lock lock(mutex_);
+        if (!cpu_)
+            return;
+        os_cpu_usage_info_destroy(cpu_);
+        cpu_ = nullptr;
+        blog(LOG_INFO, TAG "Soak statistics stopped after %.0f s, peak RSS %.1f MB",
+            (os_gettime_ns() - startNs_) / 1e9, peakRss_ / 1048576.0);
+    }
+
+    bool IsRunning() override
+    {
+        std::unique_lock lock(mutex_);
+        return cpu_ != nullptr;
+    }
+
+    void Sample(const std::vector<TargetHealth>& targets) override
+    {
+        std::unique_lock lock(mutex_);
+        if (!cpu_)
+            return;
+
+        auto now = os_gettime_ns();
+        auto interval = (now - lastNs_) / 1e9;
+        lastNs_ = now;
+        auto cpu = os_cpu_usage_info_query(cpu_);
+        auto rss = os_get_proc_resident_size();
+        if (rss > peakRss_)
+            peakRss_ = rss;
+
+        int running = 0, dropped = 0, reconnects = 0;
+        double bps = 0;
+        std::map<std::string, Previous> current;
+        for (auto& target : targets) {
+            auto found = previous_.find(target.id);
+            bool known = found != previous_.end();
+            auto prev = known ? found->second : Previous{};
+            auto& cur = current[target.id];
+            cur = { target.droppedFrames, target.reconnects, target.totalBytes, target.running };
+
+            running += target.running ? 1 : 0;
+            dropped += target.droppedFrames;
+            reconnects += target.reconnects;
+            // counters restart with a new output, and a new target has no rate yet
+            if (known && interval > 0 && target.totalBytes >= prev.totalBytes)
+                bps += (target.totalBytes - prev.totalBytes) * 8 / interval;
+
+            if (target.droppedFrames > prev.droppedFrames || target.reconnects > prev.reconnects
+                || target.running != prev.running) {
+                blog(LOG_INFO, TAG "Soak: \"%s\" %s, dropped %d (+%d), reconnects %d (+%d), "
+                    "last reconnect %lld ms, longest %lld ms, down %lld ms, send queue peak %llu bytes",
+                    target.name.c_str(), target.running ? "running" : "stopped",
+                    target.droppedFrames, std::max(target.droppedFrames - prev.droppedFrames, 0),
+                    target.reconnects, std::max(target.reconnects - prev.reconnects, 0),
+                    (long long)target.lastReconnectMs, (long long)target.maxReconnectMs,
+                    (long long)target.downtimeMs, (unsigned long long)target.queueHighWater);
+            }
+        }
+        previous_ = std::move(current);
+
+        blog(LOG_INFO, TAG "Soak: %.0f s, CPU %.1f%%, RSS %.1f MB (peak %.1f MB), %d/%d targets running, "
+            "%.2f Mbps, dropped %d, reconnects %d",
+            (now - startNs_) / 1e9, cpu, rss / 1048576.0, peakRss_ / 1048576.0,
+            running, static_cast<int>(targets.size()), bps / 1e6, dropped, reconnects);
+    }
+};
+
+SoakCollector* GetSoakCollector()
+{
+    static SoakCollectorImpl impl_;
+    return &impl_;
+}
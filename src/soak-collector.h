@@ -0,0 +1,19 @@
+#pragma once
+
+#include "stats-registry.h"
+
+#include <vector>
+
+// Periodic log of process CPU and memory next to the health of every target,
+// for long runs with many targets. Each Sample writes one summary line, plus
+// a line for every target whose drops or reconnects grew since the last one.
+class SoakCollector {
+public:
+    virtual ~SoakCollector() {}
+    virtual void Start() = 0;
+    virtual void Stop() = 0;
+    virtual bool IsRunning() = 0;
+    virtual void Sample(const std::vector<TargetHealth>& targets) = 0;
+};
+
+SoakCollector* GetSoakCollector();
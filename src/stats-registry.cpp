@@ -0,0 +1,55 @@
+#include "stats-registry.h"
+#include "pch.h"
+#include "stats-shm.h"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+
+class StatsRegistryImpl : public StatsRegistry {
+    std::mutex mutex_;
+    std::map<std::string, TargetHealth> targets_;
+    std::atomic<uint64_t> version_ = 0;
+
+public:
+    void Publish(const TargetHealth& health) override
+    {
+        {
+            std::unique_lock lock(mutex_);
+            targets_[health.id] = health;
+            ++version_;
+        }
+        GetStatsShm()->Update(health);
+    }
+
+    void Remove(const std::string& targetId) override
+    {
+        {
+            std::unique_lock lock(mutex_);
+            if (targets_.erase(targetId))
+                ++version_;
+        }
+        GetStatsShm()->Remove(targetId);
+    }
+
+    uint64_t Version() override
+    {
+        return version_;
+    }
+
+    std::vector<TargetHealth> Snapshot() override
+    {
+        std::unique_lock lock(mutex_);
+        std::vector<TargetHealth> result;
+        result.reserve(targets_.size());
+        for (auto& [id, health] : targets_)
+            result.push_back(health);
+        return result;
+    }
+};
+
+StatsRegistry* GetStatsRegistry()
+{
+    static StatsRegistryImpl impl_;
+    return &impl_;
+}
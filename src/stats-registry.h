@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Snapshot of one target, taken on the UI thread.
+struct TargetHealth {
+    std::string id;
+    std::string name;
+    std::vector<std::string> tags;
+    bool running = false;
+    bool reconnecting = false;
+    int droppedFrames = 0;
+    int reconnects = 0;
+    // -1 before the first successful reconnect
+    int64_t lastReconnectMs = -1;
+    int64_t maxReconnectMs = 0;
+    // time spent reconnecting, including an outage the output gave up on
+    int64_t downtimeMs = 0;
+    // peak of the output's own send queue, 0 when the output does not report it
+    uint64_t queueHighWater = 0;
+    // bytes, frames and dropped frames add up over the reconnects of the run
+    uint64_t totalBytes = 0;
+    uint64_t totalFrames = 0;
+    // connected time of the run, excluding reconnect outages
+    int64_t liveMs = 0;
+    float congestion = 0;
+    // encoders also feeding the OBS stream or other targets
+    bool videoEncoderShared = false;
+    bool audioEncoderShared = false;
+};
+
+// Latest snapshot of every target, published from the UI thread and read by
+// exporters on their own threads, so that they never call into widgets.
+class StatsRegistry {
+public:
+    virtual ~StatsRegistry() {}
+    virtual void Publish(const TargetHealth& health) = 0;
+    virtual void Remove(const std::string& targetId) = 0;
+    // Bumped by every Publish and Remove, lets readers skip unchanged data.
+    virtual uint64_t Version() = 0;
+    virtual std::vector<TargetHealth> Snapshot() = 0;
+};
+
+StatsRegistry* GetStatsRegistry();
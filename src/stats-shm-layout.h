@@ -0,0 +1,70 @@
+#pragma once
+
+// Layout of the shared-memory stats segment. Shared with the external reader,
+// so this header must not depend on OBS or Qt.
+//
+// The segment is a header followed by a fixed array of records. Every record
+// is a seqlock: the writer makes seq odd, updates the fields and makes seq
+// even again. A reader copies the record between two loads of seq and keeps
+// the copy only if both loads returned the same even value.
+
+#include <atomic>
+#include <cstdint>
+
+#define STATS_SHM_POSIX_NAME "/obs-multi-rtmp-stats"
+#define STATS_SHM_WIN32_NAME L"Local\\obs-multi-rtmp-stats"
+
+static const uint32_t kStatsShmMagic = 0x5453524d; // "MRST"
+static const uint32_t kStatsShmVersion = 1;
+static const uint32_t kStatsShmCapacity = 256;
+
+enum StatsShmState : uint32_t {
+    StatsShmFree = 0,
+    StatsShmStopped = 1,
+    StatsShmRunning = 2,
+    StatsShmReconnecting = 3,
+};
+
+struct StatsShmRecord {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> state;
+    char id[48];
+    char name[128];
+    std::atomic<uint64_t> totalBytes;
+    std::atomic<uint64_t> totalFrames;
+    std::atomic<uint64_t> droppedFrames;
+    std::atomic<uint64_t> reconnects;
+    // over the interval between the last two updates
+    std::atomic<uint64_t> bitsPerSec;
+    std::atomic<uint64_t> framesPerSecMilli;
+    // congestion scaled to 0..1000000
+    std::atomic<uint32_t> congestionMicro;
+    std::atomic<uint32_t> flags;
+    std::atomic<int64_t> downtimeMs;
+    std::atomic<int64_t> maxReconnectMs;
+    // bytes, 0 when the output does not report its send queue
+    std::atomic<uint64_t> sendQueuePeak;
+    // microseconds since the Unix epoch
+    std::atomic<int64_t> updatedUsec;
+};
+
+enum StatsShmFlags : uint32_t {
+    StatsShmVideoShared = 1 << 0,
+    StatsShmAudioShared = 1 << 1,
+};
+
+struct StatsShmHeader {
+    // written last, once the rest of the header is valid
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;
+    // records at and after this index are free
+    std::atomic<uint32_t> used;
+    uint32_t writerPid;
+};
+
+struct StatsShmSegment {
+    StatsShmHeader header;
+    StatsShmRecord records[kStatsShmCapacity];
+};
@@ -0,0 +1,317 @@
+#include "stats-shm.h"
+#include "stats-shm-layout.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+#include "pch.h"
+#include "stats-registry.h"
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <util/platform.h>
+
+class StatsShmImpl : public StatsShm {
+    struct Slot {
+        uint32_t index = 0;
+        uint64_t lastBytes = 0;
+        uint64_t lastFrames = 0;
+        uint64_t lastNs = 0;
+    };
+
+    std::mutex mutex_;
+    StatsShmSegment* segment_ = nullptr;
+#ifdef _WIN32
+    HANDLE mapping_ = nullptr;
+#else
+    // identifies the segment this process created, so Close never unlinks another one
+    dev_t device_ = 0;
+    ino_t inode_ = 0;
+#endif
+    std::map<std::string, Slot> slots_;
+    std::vector<uint32_t> freeSlots_;
+    uint32_t used_ = 0;
+
+    static void CopyString(char* dst, size_t size, const std::string& src)
+    {
+        auto n = std::min(src.size(), size - 1);
+        memcpy(dst, src.data(), n);
+        memset(dst + n, 0, size - n);
+    }
+
+    static uint32_t CurrentPid()
+    {
+#ifdef _WIN32
+        return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    static bool IsAlive(uint32_t pid)
+    {
+        if (pid == 0 || pid == CurrentPid())
+            return false;
+#ifdef _WIN32
+        auto process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+        if (!process)
+            return GetLastError() == ERROR_ACCESS_DENIED;
+        bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+        CloseHandle(process);
+        return alive;
+#else
+        return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+    }
+
+    bool MapSegment()
+    {
+        auto size = sizeof(StatsShmSegment);
+#ifdef _WIN32
+        mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), STATS_SHM_WIN32_NAME);
+        if (!mapping_)
+            return false;
+        bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        auto view = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!view) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+            return false;
+        }
+        segment_ = static_cast<StatsShmSegment*>(view);
+        // the mapping outlives its writer only while a reader holds it, which is then safe to take over
+        if (existed && IsAlive(segment_->header.writerPid)) {
+            blog(LOG_WARNING, TAG "Shared-memory stats are already published by process %u", segment_->header.writerPid);
+            UnmapViewOfFile(segment_);
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+            segment_ = nullptr;
+            return false;
+        }
+#else
+        int fd = shm_open(STATS_SHM_POSIX_NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            // left behind by a crashed instance unless its writer is still running
+            int existing = shm_open(STATS_SHM_POSIX_NAME, O_RDONLY, 0);
+            if (existing >= 0) {
+                uint32_t writerPid = 0;
+                struct stat info;
+                if (fstat(existing, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(StatsShmHeader)) {
+                    auto header = mmap(nullptr, sizeof(StatsShmHeader), PROT_READ, MAP_SHARED, existing, 0);
+                    if (header != MAP_FAILED) {
+                        writerPid = static_cast<StatsShmHeader*>(header)->writerPid;
+                        munmap(header, sizeof(StatsShmHeader));
+                    }
+                }
+                close(existing);
+                if (IsAlive(writerPid)) {
+                    blog(LOG_WARNING, TAG "Shared-memory stats are already published by process %u", writerPid);
+                    return false;
+                }
+            }
+            shm_unlink(STATS_SHM_POSIX_NAME);
+            fd = shm_open(STATS_SHM_POSIX_NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0 || fstat(fd, &info) != 0) {
+            close(fd);
+            shm_unlink(STATS_SHM_POSIX_NAME);
+            return false;
+        }
+        auto view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED) {
+            shm_unlink(STATS_SHM_POSIX_NAME);
+            return false;
+        }
+        segment_ = static_cast<StatsShmSegment*>(view);
+        device_ = info.st_dev;
+        inode_ = info.st_ino;
+#endif
+        // claim the segment before Open() fills in the rest of the header
+        segment_->header.writerPid = CurrentPid();
+        return true;
+    }
+
+    void UnmapSegment()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(segment_);
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+#else
+        munmap(segment_, sizeof(StatsShmSegment));
+        // only unlink the name while it still refers to the segment created here
+        int fd = shm_open(STATS_SHM_POSIX_NAME, O_RDONLY, 0);
+        if (fd >= 0) {
+            struct stat info;
+            bool ours = fstat(fd, &info) == 0 && info.st_dev == device_ && info.st_ino == inode_;
+            close(fd);
+            if (ours)
+                shm_unlink(STATS_SHM_POSIX_NAME);
+        }
+        device_ = 0;
+        inode_ = 0;
+#endif
+        segment_ = nullptr;
+    }
+
+    void WriteLocked(const TargetHealth& health)
+    {
+        auto it = slots_.find(health.id);
+        if (it == slots_.end()) {
+            uint32_t index;
+            if (!freeSlots_.empty()) {
+                index = freeSlots_.back();
+                freeSlots_.pop_back();
+            } else if (used_ < kStatsShmCapacity) {
+                index = used_++;
+            } else {
+                return;
+            }
+            it = slots_.emplace(health.id, Slot{ index }).first;
+            segment_->header.used.store(used_, std::memory_order_release);
+        }
+
+        auto& slot = it->second;
+        auto now = os_gettime_ns();
+        uint64_t bps = 0, fpsMilli = 0;
+        if (slot.lastNs && now > slot.lastNs && health.totalBytes >= slot.lastBytes && health.totalFrames >= slot.lastFrames) {
+            auto seconds = (now - slot.lastNs) / 1e9;
+            bps = static_cast<uint64_t>((health.totalBytes - slot.lastBytes) * 8 / seconds);
+            fpsMilli = static_cast<uint64_t>((health.totalFrames - slot.lastFrames) * 1000 / seconds);
+        }
+        slot.lastBytes = health.totalBytes;
+        slot.lastFrames = health.totalFrames;
+        slot.lastNs = now;
+
+        uint32_t state = health.reconnecting ? StatsShmReconnecting : health.running ? StatsShmRunning : StatsShmStopped;
+        uint32_t flags = 0;
+        if (health.videoEncoderShared)
+            flags |= StatsShmVideoShared;
+        if (health.audioEncoderShared)
+            flags |= StatsShmAudioShared;
+        auto updated = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        auto& record = segment_->records[slot.index];
+        auto seq = record.seq.load(std::memory_order_relaxed);
+        record.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.state.store(state, std::memory_order_relaxed);
+        CopyString(record.id, sizeof(record.id), health.id);
+        CopyString(record.name, sizeof(record.name), health.name);
+        record.totalBytes.store(health.totalBytes, std::memory_order_relaxed);
+        record.totalFrames.store(health.totalFrames, std::memory_order_relaxed);
+        record.droppedFrames.store(static_cast<uint64_t>(std::max(health.droppedFrames, 0)), std::memory_order_relaxed);
+        record.reconnects.store(static_cast<uint64_t>(std::max(health.reconnects, 0)), std::memory_order_relaxed);
+        record.bitsPerSec.store(bps, std::memory_order_relaxed);
+        record.framesPerSecMilli.store(fpsMilli, std::memory_order_relaxed);
+        record.congestionMicro.store(static_cast<uint32_t>(std::clamp(health.congestion, 0.0f, 1.0f) * 1000000), std::memory_order_relaxed);
+        record.flags.store(flags, std::memory_order_relaxed);
+        record.downtimeMs.store(health.downtimeMs, std::memory_order_relaxed);
+        record.maxReconnectMs.store(health.maxReconnectMs, std::memory_order_relaxed);
+        record.sendQueuePeak.store(health.queueHighWater, std::memory_order_relaxed);
+        record.updatedUsec.store(updated, std::memory_order_relaxed);
+        record.seq.store(seq + 2, std::memory_order_release);
+    }
+
+public:
+    ~StatsShmImpl()
+    {
+        Close();
+    }
+
+    bool Open() override
+    {
+        std::unique_lock lock(mutex_);
+        if (segment_)
+            return true;
+        if (!MapSegment()) {
+            blog(LOG_WARNING, TAG "Cannot create the shared-memory stats segment");
+            return false;
+        }
+
+        auto& header = segment_->header;
+        header.magic.store(0, std::memory_order_relaxed);
+        for (auto& record : segment_->records) {
+            record.seq.store(0, std::memory_order_relaxed);
+            record.state.store(StatsShmFree, std::memory_order_relaxed);
+        }
+        header.version = kStatsShmVersion;
+        header.recordSize = sizeof(StatsShmRecord);
+        header.capacity = kStatsShmCapacity;
+        header.used.store(0, std::memory_order_relaxed);
+        header.writerPid = CurrentPid();
+        header.magic.store(kStatsShmMagic, std::memory_order_release);
+
+        slots_.clear();
+        freeSlots_.clear();
+        used_ = 0;
+        for (auto& health : GetStatsRegistry()->Snapshot())
+            WriteLocked(health);
+
+        blog(LOG_INFO, TAG "Publishing stats in shared memory, %u records of %u bytes",
+            kStatsShmCapacity, static_cast<unsigned>(sizeof(StatsShmRecord)));
+        return true;
+    }
+
+    void Close() override
+    {
+        std::unique_lock lock(mutex_);
+        if (!segment_)
+            return;
+        segment_->header.magic.store(0, std::memory_order_release);
+        UnmapSegment();
+        slots_.clear();
+        freeSlots_.clear();
+        used_ = 0;
+    }
+
+    void Update(const TargetHealth& health) override
+    {
+        std::unique_lock lock(mutex_);
+        if (segment_)
+            WriteLocked(health);
+    }
+
+    void Remove(const std::string& targetId) override
+    {
+        std::unique_lock lock(mutex_);
+        if (!segment_)
+            return;
+        auto it = slots_.find(targetId);
+        if (it == slots_.end())
+            return;
+
+        auto& record = segment_->records[it->second.index];
+        auto seq = record.seq.load(std::memory_order_relaxed);
+        record.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.state.store(StatsShmFree, std::memory_order_relaxed);
+        record.seq.store(seq + 2, std::memory_order_release);
+
+        freeSlots_.push_back(it->second.index);
+        slots_.erase(it);
+    }
+};
+
+StatsShm* GetStatsShm()
+{
+    static StatsShmImpl impl_;
+    return &impl_;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+struct TargetHealth;
+
+// Mirrors the stats registry into a named shared-memory segment (see
+// stats-shm-layout.h), so that a local watchdog can poll every target without
+// syscalls. Writes happen on the thread publishing to the registry.
+class StatsShm {
+public:
+    virtual ~StatsShm() {}
+    virtual bool Open() = 0;
+    // Unmaps and removes the segment.
+    virtual void Close() = 0;
+    virtual void Update(const TargetHealth& health) = 0;
+    virtual void Remove(const std::string& targetId) = 0;
+};
+
+StatsShm* GetStatsShm();
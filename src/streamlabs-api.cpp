@@ -1,18 +1,40 @@
 #include "streamlabs-api.h"
+#include "http-client.h"
+#include "fuzzy-match.h"
 #include <vector>
-#include <algorithm>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include "obs.hpp"
+#include <optional>
+#include <cstdlib>
+#include "json.hpp"
 #include "pch.h"
 
-size_t StreamlabsAPI::WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+#define ConfigSection "obs-multi-rtmp"
+#define DefaultApiBaseUrl "https://streamlabs.com/api/v5/slobs/tiktok"
+
+static std::string LoadApiBaseUrl()
+{
+    std::string url;
+    // The environment wins so a local stand-in can be used without touching user settings.
+    if (auto env = std::getenv("OBS_MULTI_RTMP_STREAMLABS_API")) {
+        url = env;
+    } else if (auto config = obs_frontend_get_user_config()) {
+        if (auto value = config_get_string(config, ConfigSection, "StreamlabsApiBaseUrl"))
+            url = value;
+    }
+
+    while (!url.empty() && url.back() == '/')
+        url.pop_back();
+    if (url.empty())
+        return DefaultApiBaseUrl;
+
+    if (url != DefaultApiBaseUrl)
+        blog(LOG_INFO, TAG "Using Streamlabs API base URL %s", url.c_str());
+    return url;
+}
+
+const std::string& StreamlabsAPI::BaseUrl()
 {
-    size_t totalBytes = size * nmemb;
-    std::string* buf = static_cast<std::string*>(userp);
-    buf->append(static_cast<char*>(contents), totalBytes);
-    return totalBytes;
+    static const std::string url = LoadApiBaseUrl();
+    return url;
 }
 
 std::string StreamlabsAPI::ExtractStreamId(const std::string &key)
@@ -34,326 +56,296 @@ std::string StreamlabsAPI::ExtractStreamId(const std::string &key)
     return id;
 }
 
-bool StreamlabsAPI::EndStream(const std::string &token, const std::string &streamID)
-{
-    if (streamID.empty()) {
-        blog(LOG_WARNING, TAG "EndStream: streamID is empty");
-        return false;
+// Picks the few fields the Streamlabs endpoints return straight from the token
+// stream, without building a document.
+class StreamlabsResponseReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+    struct Category {
+        std::string fullName;
+        std::optional<std::string> gameMaskId;
+    };
+
+    std::optional<std::string> rtmp;
+    std::optional<std::string> streamKey;
+    std::optional<std::string> message;
+    std::optional<std::string> dataMessage;
+    std::optional<bool> success;
+    bool hasCategories = false;
+    std::vector<Category> categories;
+    std::string error;
+
+    bool Parse(const std::string& body)
+    {
+        return nlohmann::json::sax_parse(body.begin(), body.end(), this);
     }
 
-    std::string url = "https://streamlabs.com/api/v5/slobs/tiktok/stream/" + streamID + "/end";
+    bool null() override { return true; }
+    bool boolean(bool val) override
+    {
+        if (Current() == Scope::Root && key_ == "success")
+            success = val;
+        return true;
+    }
+    bool number_integer(number_integer_t) override { return true; }
+    bool number_unsigned(number_unsigned_t) override { return true; }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        blog(LOG_WARNING, TAG "EndStream: curl_easy_init failed");
-        return false;
+    bool string(string_t& val) override
+    {
+        switch (Current()) {
+        case Scope::Root:
+            if (key_ == "rtmp")
+                rtmp = std::move(val);
+            else if (key_ == "key")
+                streamKey = std::move(val);
+            else if (key_ == "message")
+                message = std::move(val);
+            break;
+        case Scope::Data:
+            if (key_ == "message")
+                dataMessage = std::move(val);
+            break;
+        case Scope::Category:
+            if (key_ == "full_name") {
+                current_.fullName = std::move(val);
+                hasName_ = true;
+            } else if (key_ == "game_mask_id") {
+                current_.gameMaskId = std::move(val);
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    bool key(string_t& val) override
+    {
+        key_.assign(val);
+        return true;
+    }
+
+    bool start_object(std::size_t) override
+    {
+        auto parent = Current();
+        if (scopes_.empty())
+            scopes_.push_back(Scope::Root);
+        else if (parent == Scope::Root && key_ == "data")
+            scopes_.push_back(Scope::Data);
+        else if (parent == Scope::Categories) {
+            scopes_.push_back(Scope::Category);
+            current_ = {};
+            hasName_ = false;
+        }
+        else
+            scopes_.push_back(Scope::Other);
+        return true;
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    bool end_object() override
+    {
+        if (Current() == Scope::Category && hasName_)
+            categories.emplace_back(std::move(current_));
+        scopes_.pop_back();
+        return true;
+    }
 
-    struct curl_slist* headers = nullptr;
+    bool start_array(std::size_t) override
     {
-        std::string authHeader = "Authorization: Bearer " + token;
-        headers = curl_slist_append(headers, authHeader.c_str());
-        headers = curl_slist_append(
-            headers,
-            "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) "
-            "AppleWebKit/537.36 (KHTML, like Gecko) "
-            "StreamlabsDesktop/1.17.0 Chrome/122.0.6261.156 "
-            "Electron/29.3.1 Safari/537.36"
-        );
+        if (Current() == Scope::Root && key_ == "categories") {
+            hasCategories = true;
+            scopes_.push_back(Scope::Categories);
+        }
+        else
+            scopes_.push_back(Scope::Other);
+        return true;
     }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-    std::string responseData;
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseData);
+    bool end_array() override
+    {
+        scopes_.pop_back();
+        return true;
+    }
 
-    CURLcode res = curl_easy_perform(curl);
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        error = "at offset " + std::to_string(position) + ": " + ex.what();
+        return false;
+    }
+
+private:
+    enum class Scope { Root, Data, Categories, Category, Other };
+    std::vector<Scope> scopes_;
+    std::string key_;
+    Category current_;
+    bool hasName_ = false;
+
+    Scope Current() const { return scopes_.empty() ? Scope::Other : scopes_.back(); }
+};
 
+static bool ParseEndStreamResponse(HttpResponse& response)
+{
     bool success = false;
-    if (res == CURLE_OK) {
-        QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromStdString(responseData));
-        if (!doc.isNull()) {
-            QJsonObject obj = doc.object();
-            success = obj.value("success").toBool(false);
+    if (response.result == CURLE_OK) {
+        StreamlabsResponseReader reader;
+        if (reader.Parse(response.body)) {
+            success = reader.success.value_or(false);
             if (!success) {
                 blog(LOG_WARNING, TAG "EndStream: JSON 'success' was false or missing");
             }
         } else {
-            blog(LOG_WARNING, TAG "EndStream: Invalid JSON response: %s", responseData.c_str());
+            blog(LOG_WARNING, TAG "EndStream: Invalid JSON response: %s", response.body.c_str());
         }
     } else {
-        blog(LOG_WARNING, TAG "EndStream: cURL error: %s", curl_easy_strerror(res));
+        blog(LOG_WARNING, TAG "EndStream: cURL error: %s", curl_easy_strerror(response.result));
     }
 
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-
     return success;
 }
 
-std::tuple<bool, std::string, std::string, std::string> StreamlabsAPI::StartStream(const std::string& token, const std::string& title, const std::string& category, const int audienceType)
+HttpRequestId StreamlabsAPI::EndStream(const std::string &token, const std::string &streamID, std::function<void(bool)> callback)
 {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return {false, "Failed to initialize CURL", "", ""};
+    if (streamID.empty()) {
+        blog(LOG_WARNING, TAG "EndStream: streamID is empty");
+        if (callback)
+            callback(false);
+        return 0;
     }
-    
-    curl_easy_setopt(curl, CURLOPT_URL, "https://streamlabs.com/api/v5/slobs/tiktok/stream/start");
-    
-    struct curl_slist* headers = nullptr;
-    std::string authHeader = "Authorization: Bearer " + token;
-    headers = curl_slist_append(headers, authHeader.c_str());
-    headers = curl_slist_append(headers, 
-        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) "
-        "AppleWebKit/537.36 (KHTML, like Gecko) "
-        "StreamlabsDesktop/1.17.0 Chrome/122.0.6261.156 "
-        "Electron/29.3.1 Safari/537.36"
-    );
-    
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    
-    curl_mime* mime = curl_mime_init(curl);
-    auto addPart = [&](const char* fieldName, const char* value) {
-        curl_mimepart* part = curl_mime_addpart(mime);
-        curl_mime_name(part, fieldName);
-        curl_mime_data(part, value, CURL_ZERO_TERMINATED);
-    };
-    
-    addPart("title", title.c_str());
-    addPart("category", category.c_str());
-    addPart("audience_type", std::to_string(audienceType).c_str());
-    addPart("device_platform", "win32");
-    
-    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
-    
-    std::string responseData;
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseData);
-    
-    CURLcode res = curl_easy_perform(curl);
-    
+
+    HttpRequest request;
+    request.url = BaseUrl() + "/stream/" + streamID + "/end";
+    request.bearerToken = token;
+    request.post = true;
+
+    return GetHttpClient()->Submit(request, [callback](HttpResponse& response) {
+        bool success = ParseEndStreamResponse(response);
+        if (callback)
+            callback(success);
+    });
+}
+
+static StartStreamResult ParseStartStreamResponse(HttpResponse& response)
+{
     bool success = false;
     std::string newServer, newKey, errorMessage;
     
-    if (res == CURLE_OK) {
-        QJsonDocument responseDoc = QJsonDocument::fromJson(
-            QByteArray::fromStdString(responseData)
-        );
-        QJsonObject responseObj = responseDoc.object();
-
-        if (responseObj.contains("rtmp") && responseObj.contains("key")) {
-            newServer = responseObj["rtmp"].toString().toStdString();
-            newKey = responseObj["key"].toString().toStdString();
+    if (response.result == CURLE_OK) {
+        StreamlabsResponseReader reader;
+        reader.Parse(response.body);
+
+        if (reader.rtmp.has_value() && reader.streamKey.has_value()) {
+            newServer = std::move(*reader.rtmp);
+            newKey = std::move(*reader.streamKey);
             success = true;
         } else {
-            if (responseObj.contains("data")) {
-                QJsonObject dataObj = responseObj["data"].toObject();
-                if (dataObj.contains("message")) {
-                    blog(LOG_INFO, "Streamlabs API detailed error: %s", 
-                        dataObj["message"].toString().toStdString().c_str());
-                }
+            if (reader.dataMessage.has_value()) {
+                blog(LOG_INFO, "Streamlabs API detailed error: %s", reader.dataMessage->c_str());
             }
             
-            if (responseObj.contains("message")) {
-                errorMessage = responseObj["message"].toString().toStdString();
+            if (reader.message.has_value()) {
+                errorMessage = std::move(*reader.message);
             } else {
                 errorMessage = "Unknown error occurred";
             }
         }
     } else {
-        errorMessage = curl_easy_strerror(res);
+        errorMessage = curl_easy_strerror(response.result);
     }
     
-    curl_mime_free(mime);
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    
     return {success, errorMessage, newServer, newKey};
 }
 
-static int levenshteinDistance(const std::string& s1, const std::string& s2) {
-    const int m = static_cast<int>(s1.size());
-    const int n = static_cast<int>(s2.size());
-    if (m == 0) return n;
-    if (n == 0) return m;
-
-    std::vector<int> costs(n + 1);
-    for (int i = 0; i <= n; ++i) {
-        costs[i] = i;
-    }
+HttpRequestId StreamlabsAPI::StartStream(const std::string& token, const std::string& title, const std::string& category, const int audienceType, std::function<void(StartStreamResult)> callback)
+{
+    HttpRequest request;
+    request.url = BaseUrl() + "/stream/start";
+    request.bearerToken = token;
+    request.formFields = {
+        { "title", title },
+        { "category", category },
+        { "audience_type", std::to_string(audienceType) },
+        { "device_platform", "win32" },
+    };
 
-    for (int i = 0; i < m; ++i) {
-        costs[0] = i + 1;
-        int corner = i;
-        for (int j = 0; j < n; ++j) {
-            int upper = costs[j + 1];
-            costs[j + 1] = std::min({
-                costs[j] + 1,
-                upper + 1,
-                corner + (s1[static_cast<size_t>(i)] == s2[static_cast<size_t>(j)] ? 0 : 1)
-            });
-            corner = upper;
-        }
-    }
-    return costs[n];
+    return GetHttpClient()->Submit(request, [callback](HttpResponse& response) {
+        auto result = ParseStartStreamResponse(response);
+        if (callback)
+            callback(std::move(result));
+    });
 }
 
-std::string StreamlabsAPI::CategorySearch(const std::string& token, const std::string& category) {
-    if (category.empty()) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: Empty category input");
-        return "";
-    }
-
+static std::string ParseCategorySearchResponse(const std::string& response_data, const std::string& category)
+{
     std::string truncated_category = category.substr(0, 25);
-    
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: Could not initialize cURL");
-        return "";
-    }
 
-    char* escaped = curl_easy_escape(curl, truncated_category.c_str(), static_cast<int>(truncated_category.length()));
-    if (!escaped) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: URL escaping failed for category '%s'", truncated_category.c_str());
-        curl_easy_cleanup(curl);
-        return "";
-    }
-    
-    std::string url = "https://streamlabs.com/api/v5/slobs/tiktok/info?category=" + std::string(escaped);
-    curl_free(escaped);
-    
-    std::string response_data;
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
-    
-    struct curl_slist* headers = nullptr;
-    std::string authHeader = "Authorization: Bearer " + token;
-    headers = curl_slist_append(headers, authHeader.c_str());
-    headers = curl_slist_append(headers, 
-        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) "
-        "AppleWebKit/537.36 (KHTML, like Gecko) "
-        "StreamlabsDesktop/1.17.0 Chrome/122.0.6261.156 "
-        "Electron/29.3.1 Safari/537.36"
-    );
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
-    
-    if (res != CURLE_OK) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: cURL request failed with error: %s", curl_easy_strerror(res));
-        curl_easy_cleanup(curl);
+    StreamlabsResponseReader reader;
+    if (!reader.Parse(response_data)) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: JSON parse error %s", reader.error.c_str());
         return "";
     }
 
-    curl_easy_cleanup(curl);
-
-    QJsonParseError parseError;
-    QJsonDocument doc = QJsonDocument::fromJson(QByteArray(response_data.c_str(), static_cast<int>(response_data.size())), &parseError);
-    if (doc.isNull() || parseError.error != QJsonParseError::NoError) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: JSON parse error at offset %d: %s", 
-             parseError.offset, parseError.errorString().toUtf8().constData());
+    if (!reader.hasCategories) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: Response missing 'categories' array");
         return "";
     }
 
-    QJsonObject root = doc.object();
-    if (!root.contains("categories")) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: Response missing 'categories' field");
+    auto& categories = reader.categories;
+    if (categories.empty()) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: No categories found for '%s'", truncated_category.c_str());
         return "";
     }
 
-    QJsonValue categoriesValue = root.value("categories");
-    if (!categoriesValue.isArray()) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: 'categories' field is not an array");
-        return "";
-    }
+    FuzzyMatcher matcher;
+    size_t totalLength = 0;
+    for (auto& x : categories)
+        totalLength += x.fullName.size();
+    matcher.Reserve(categories.size(), totalLength);
+    for (auto& x : categories)
+        matcher.Add(x.fullName);
 
-    QJsonArray categories = categoriesValue.toArray();
-    if (categories.isEmpty()) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: No categories found for '%s'", truncated_category.c_str());
+    auto match = matcher.Best(category);
+    if (!match.has_value()) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: No valid category match found for '%s'", category.c_str());
         return "";
     }
 
-    std::string originalLower = category;
-    std::transform(originalLower.begin(), originalLower.end(), originalLower.begin(), ::tolower);
-
-    QJsonObject bestMatch;
-    bool exactMatchFound = false;
-
-    for (const QJsonValue& val : categories) {
-        if (!val.isObject()) {
-            continue;
-        }
-        QJsonObject obj = val.toObject();
-        if (!obj.contains("full_name")) {
-            continue;
-        }
-        QJsonValue nameVal = obj.value("full_name");
-        if (!nameVal.isString()) {
-            continue;
-        }
-        std::string fullName = nameVal.toString().toStdString();
-        std::string fullNameLower = fullName;
-        std::transform(fullNameLower.begin(), fullNameLower.end(), fullNameLower.begin(), ::tolower);
-
-        if (fullNameLower == originalLower) {
-            bestMatch = obj;
-            exactMatchFound = true;
-            break;
-        }
+    auto& bestMatch = categories[match->index];
+    if (!bestMatch.gameMaskId.has_value()) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: Best match category missing 'game_mask_id' string");
+        return "";
     }
 
-    if (!exactMatchFound) {
-        int minDistance = INT_MAX;
-        for (const QJsonValue& val : categories) {
-            if (!val.isObject()) {
-                continue;
-            }
-            QJsonObject obj = val.toObject();
-            if (!obj.contains("full_name")) {
-                continue;
-            }
-            QJsonValue nameVal = obj.value("full_name");
-            if (!nameVal.isString()) {
-                continue;
-            }
-            std::string fullName = nameVal.toString().toStdString();
-            std::string fullNameLower = fullName;
-            std::transform(fullNameLower.begin(), fullNameLower.end(), fullNameLower.begin(), ::tolower);
-
-            int distance = levenshteinDistance(originalLower, fullNameLower);
-            if (distance < minDistance) {
-                minDistance = distance;
-                bestMatch = obj;
-            } else if (distance == minDistance) {
-                std::string currentBestName = bestMatch["full_name"].toString().toStdString();
-                std::string candidateName = obj["full_name"].toString().toStdString();
-                if (candidateName.length() > currentBestName.length()) {
-                    bestMatch = obj;
-                }
-            }
-        }
-    }
+    return *bestMatch.gameMaskId;
+}
 
-    if (bestMatch.isEmpty()) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: No valid category match found for '%s'", category.c_str());
-        return "";
+HttpRequestId StreamlabsAPI::CategorySearch(const std::string& token, const std::string& category, std::function<void(std::string)> callback)
+{
+    if (category.empty()) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: Empty category input");
+        callback("");
+        return 0;
     }
 
-    if (!bestMatch.contains("game_mask_id")) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: Best match category missing 'game_mask_id'");
-        return "";
+    std::string truncated_category = category.substr(0, 25);
+    
+    std::string escaped = GetHttpClient()->Escape(truncated_category);
+    if (escaped.empty()) {
+        blog(LOG_WARNING, TAG "CategorySearch failed: URL escaping failed for category '%s'", truncated_category.c_str());
+        callback("");
+        return 0;
     }
 
-    QJsonValue gameMaskIdValue = bestMatch.value("game_mask_id");
-    if (!gameMaskIdValue.isString()) {
-        blog(LOG_WARNING, TAG "CategorySearch failed: 'game_mask_id' is not a string in best match");
-        return "";
-    }
+    HttpRequest request;
+    request.url = BaseUrl() + "/info?category=" + escaped;
+    request.bearerToken = token;
 
-    return gameMaskIdValue.toString().toStdString();
+    return GetHttpClient()->Submit(request, [category, callback](HttpResponse& response) {
+        if (response.result != CURLE_OK) {
+            blog(LOG_WARNING, TAG "CategorySearch failed: cURL request failed with error: %s", curl_easy_strerror(response.result));
+            callback("");
+            return;
+        }
+        callback(ParseCategorySearchResponse(response.body, category));
+    });
 }
@@ -1,16 +1,21 @@
 #pragma once
 
 #include <string>
+#include <tuple>
 #include <functional>
-#include <curl/curl.h>
+#include "http-client.h"
 
+// success, error message, server, key
+using StartStreamResult = std::tuple<bool, std::string, std::string, std::string>;
+
+// All requests are asynchronous. Callbacks are invoked on the HTTP client thread.
 class StreamlabsAPI {
 public:
+    // Defaults to the public API. Overridden by the OBS_MULTI_RTMP_STREAMLABS_API environment
+    // variable or StreamlabsApiBaseUrl in the [obs-multi-rtmp] section of user.ini; read once.
+    static const std::string& BaseUrl();
     static std::string ExtractStreamId(const std::string &key);
-    static std::string CategorySearch(const std::string& token, const std::string& category);
-    static std::tuple<bool, std::string, std::string, std::string> StartStream(const std::string& token, const std::string& title, const std::string& category, const int audienceType);
-    static bool EndStream(const std::string &token, const std::string &streamID);
-
-private:
-    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp);
-};
\ No newline at end of file
+    static HttpRequestId CategorySearch(const std::string& token, const std::string& category, std::function<void(std::string)> callback);
+    static HttpRequestId StartStream(const std::string& token, const std::string& title, const std::string& category, const int audienceType, std::function<void(StartStreamResult)> callback);
+    static HttpRequestId EndStream(const std::string &token, const std::string &streamID, std::function<void(bool)> callback = {});
+};
@@ -0,0 +1,124 @@
+#include "trace.h"
+#include "pch.h"
+
+#include <json.hpp>
+#include <util/platform.h>
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+// a few hundred Start All cycles of a dozen targets
+static const size_t kRingSize = 16384;
+
+uint64_t TraceNow()
+{
+    return os_gettime_ns();
+}
+
+class TracerImpl : public Tracer {
+    // Each slot is guarded by a sequence number: odd while being written, 2 * index + 2 once complete.
+    // Writers never wait; a reader skips slots that change underneath it.
+    struct Slot {
+        std::atomic<uint64_t> seq = 0;
+        std::atomic<const char*> name = nullptr;
+        std::atomic<int> lane = 0;
+        std::atomic<char> phase = 0;
+        std::atomic<uint64_t> ts = 0;
+        std::atomic<uint64_t> dur = 0;
+    };
+
+    std::unique_ptr<Slot[]> slots_{ new Slot[kRingSize] };
+    std::atomic<uint64_t> next_ = 0;
+
+    std::mutex laneMutex_;
+    std::vector<std::string> lanes_;
+
+    void Write(int lane, const char* name, char phase, uint64_t ts, uint64_t dur)
+    {
+        auto index = next_.fetch_add(1, std::memory_order_relaxed);
+        auto& slot = slots_[index % kRingSize];
+        slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.lane.store(lane, std::memory_order_relaxed);
+        slot.phase.store(phase, std::memory_order_relaxed);
+        slot.ts.store(ts, std::memory_order_relaxed);
+        slot.dur.store(dur, std::memory_order_relaxed);
+        slot.seq.store(index * 2 + 2, std::memory_order_release);
+    }
+
+public:
+    int Lane(const std::string& name) override
+    {
+        std::unique_lock lock(laneMutex_);
+        for (size_t i = 0; i < lanes_.size(); ++i) {
+            if (lanes_[i] == name)
+                return static_cast<int>(i) + 1;
+        }
+        lanes_.push_back(name);
+        return static_cast<int>(lanes_.size());
+    }
+
+    void Complete(int lane, const char* name, uint64_t beginNs, uint64_t endNs) override
+    {
+        Write(lane, name, 'X', beginNs, endNs > beginNs ? endNs - beginNs : 0);
+    }
+
+    void Instant(int lane, const char* name) override
+    {
+        Write(lane, name, 'i', TraceNow(), 0);
+    }
+
+    std::string ExportChromeJson() override
+    {
+        nlohmann::json events(nlohmann::json::value_t::array);
+        {
+            std::unique_lock lock(laneMutex_);
+            for (size_t i = 0; i < lanes_.size(); ++i) {
+                events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", i + 1 },
+                    { "args", { { "name", lanes_[i] } } } });
+            }
+        }
+
+        auto end = next_.load(std::memory_order_acquire);
+        auto begin = end > kRingSize ? end - kRingSize : 0;
+        for (auto index = begin; index < end; ++index) {
+            auto& slot = slots_[index % kRingSize];
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != index * 2 + 2)
+                continue;
+            auto name = slot.name.load(std::memory_order_relaxed);
+            auto lane = slot.lane.load(std::memory_order_relaxed);
+            auto phase = slot.phase.load(std::memory_order_relaxed);
+            auto ts = slot.ts.load(std::memory_order_relaxed);
+            auto dur = slot.dur.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq || !name)
+                continue;
+
+            nlohmann::json event = { { "name", name }, { "ph", std::string(1, phase) }, { "pid", 1 }, { "tid", lane },
+                { "ts", ts / 1000.0 } };
+            if (phase == 'X')
+                event["dur"] = dur / 1000.0;
+            else
+                event["s"] = "t";
+            events.push_back(std::move(event));
+        }
+
+        return nlohmann::json{ { "traceEvents", events }, { "displayTimeUnit", "ms" } }.dump();
+    }
+
+    void Clear() override
+    {
+        // skipping a whole ring puts every earlier slot outside the exported range
+        next_.fetch_add(kRingSize, std::memory_order_acq_rel);
+    }
+};
+
+Tracer* GetTracer()
+{
+    static TracerImpl impl_;
+    return &impl_;
+}
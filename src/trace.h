@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// In-memory tracing of output lifecycle phases. Events go to a fixed-size
+// lock-free ring, so recording is cheap enough for any thread, and the ring
+// can be exported as Chrome trace-event JSON (chrome://tracing, Perfetto)
+// with one lane per target.
+class Tracer {
+public:
+    virtual ~Tracer() {}
+    // Lanes are looked up by name; registering an existing name returns its id.
+    virtual int Lane(const std::string& name) = 0;
+    // name must be a string literal or otherwise outlive the tracer.
+    virtual void Complete(int lane, const char* name, uint64_t beginNs, uint64_t endNs) = 0;
+    virtual void Instant(int lane, const char* name) = 0;
+    virtual std::string ExportChromeJson() = 0;
+    virtual void Clear() = 0;
+};
+
+Tracer* GetTracer();
+
+uint64_t TraceNow();
+
+class TraceScope {
+public:
+    TraceScope(int lane, const char* name)
+        : lane_(lane), name_(name), begin_(TraceNow())
+    {
+    }
+
+    ~TraceScope()
+    {
+        GetTracer()->Complete(lane_, name_, begin_, TraceNow());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    int lane_;
+    const char* name_;
+    uint64_t begin_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(lane, name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(lane, name)
@@ -0,0 +1,208 @@
+#include "video-mix-cache.h"
+#include "pch.h"
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#if LIBOBS_API_VER >= MAKE_SEMANTIC_VERSION(31, 1, 0)
+#define USE_OBS_CANVAS 1
+#else
+#define USE_OBS_CANVAS 0
+#endif
+
+static obs_scale_type ParseScaleType(const std::string& name)
+{
+    if (name == "bilinear")
+        return OBS_SCALE_BILINEAR;
+    if (name == "lanczos")
+        return OBS_SCALE_LANCZOS;
+    if (name == "area")
+        return OBS_SCALE_AREA;
+    return OBS_SCALE_BICUBIC;
+}
+
+class VideoMixCacheImpl : public VideoMixCache {
+    struct Mix {
+        std::string scene;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        obs_scale_type scaleType = OBS_SCALE_BICUBIC;
+        uint32_t fpsDivisor = 1;
+        obs_source_t* source = nullptr;
+#if USE_OBS_CANVAS
+        obs_canvas_t* canvas = nullptr;
+#else
+        obs_view_t* view = nullptr;
+#endif
+        video_t* video = nullptr;
+        int refs = 0;
+    };
+
+    std::mutex mutex_;
+    std::vector<Mix> mixes_;
+
+    static void SetChannel(Mix& mix, uint32_t channel, obs_source_t* source)
+    {
+#if USE_OBS_CANVAS
+        obs_canvas_set_channel(mix.canvas, channel, source);
+#else
+        obs_view_set_source(mix.view, channel, source);
+#endif
+    }
+
+    static void SetProgramChannels(Mix& mix)
+    {
+        for (uint32_t channel = 0; channel < MAX_CHANNELS; ++channel) {
+            auto source = obs_get_output_source(channel);
+            SetChannel(mix, channel, source);
+            obs_source_release(source);
+        }
+    }
+
+    static bool Create(Mix& mix, obs_video_info& ovi)
+    {
+#if USE_OBS_CANVAS
+        auto name = "multi-rtmp " + (mix.scene.empty() ? std::string("program") : mix.scene)
+            + " " + std::to_string(mix.width) + "x" + std::to_string(mix.height)
+            + " /" + std::to_string(mix.fpsDivisor);
+        // ephemeral: never saved with the scene collection
+        mix.canvas = obs_canvas_create_private(name.c_str(), &ovi, ACTIVATE | EPHEMERAL);
+        if (!mix.canvas)
+            return false;
+#else
+        mix.view = obs_view_create();
+#endif
+
+        if (mix.scene.empty()) {
+            SetProgramChannels(mix);
+        } else {
+            mix.source = obs_get_source_by_name(mix.scene.c_str());
+            if (!mix.source) {
+                Destroy(mix);
+                return false;
+            }
+            SetChannel(mix, 0, mix.source);
+            obs_source_inc_active(mix.source);
+        }
+
+#if USE_OBS_CANVAS
+        mix.video = obs_canvas_get_video(mix.canvas);
+#else
+        mix.video = obs_view_add2(mix.view, &ovi);
+#endif
+        if (!mix.video) {
+            blog(LOG_ERROR, TAG "Failed to create a %ux%u video mix", mix.width, mix.height);
+            Destroy(mix);
+            return false;
+        }
+        return true;
+    }
+
+    static void Destroy(Mix& mix)
+    {
+#if USE_OBS_CANVAS
+        if (mix.canvas) {
+            for (uint32_t channel = 0; channel < MAX_CHANNELS; ++channel)
+                obs_canvas_set_channel(mix.canvas, channel, nullptr);
+            obs_canvas_remove(mix.canvas);
+            obs_canvas_release(mix.canvas);
+            mix.canvas = nullptr;
+        }
+#else
+        if (mix.view) {
+            obs_view_remove(mix.view);
+            for (uint32_t channel = 0; channel < MAX_CHANNELS; ++channel)
+                obs_view_set_source(mix.view, channel, nullptr);
+            obs_view_destroy(mix.view);
+            mix.view = nullptr;
+        }
+#endif
+        if (mix.source) {
+            obs_source_dec_active(mix.source);
+            obs_source_release(mix.source);
+            mix.source = nullptr;
+        }
+    }
+
+public:
+    video_t* Acquire(const VideoMixSpec& spec, uint32_t& encoderDivisor) override
+    {
+        obs_video_info ovi = {};
+        if (!obs_get_video_info(&ovi))
+            return nullptr;
+        if (spec.width > 0 && spec.height > 0) {
+            ovi.output_width = spec.width;
+            ovi.output_height = spec.height;
+            ovi.scale_type = ParseScaleType(spec.scaleType);
+        }
+
+        auto divisor = std::max<uint32_t>(spec.fpsDivisor, 1);
+#if USE_OBS_CANVAS
+        // the canvas renders only the frames it outputs
+        ovi.fps_den *= divisor;
+        encoderDivisor = 1;
+#else
+        encoderDivisor = divisor;
+        divisor = 1;
+#endif
+
+        std::unique_lock lock(mutex_);
+        for (auto& mix : mixes_) {
+            if (mix.scene == spec.scene && mix.width == ovi.output_width && mix.height == ovi.output_height
+                && mix.scaleType == ovi.scale_type && mix.fpsDivisor == divisor) {
+                ++mix.refs;
+                return mix.video;
+            }
+        }
+
+        Mix mix;
+        mix.scene = spec.scene;
+        mix.width = ovi.output_width;
+        mix.height = ovi.output_height;
+        mix.scaleType = ovi.scale_type;
+        mix.fpsDivisor = divisor;
+        if (!Create(mix, ovi))
+            return nullptr;
+        mix.refs = 1;
+        mixes_.push_back(mix);
+
+        blog(LOG_INFO, TAG "Video mix %ux%u / %u (scale type %d) created for %s, %d active",
+            mix.width, mix.height, mix.fpsDivisor, static_cast<int>(mix.scaleType),
+            spec.scene.empty() ? "program output" : spec.scene.c_str(), static_cast<int>(mixes_.size()));
+        return mix.video;
+    }
+
+    void Release(video_t* video) override
+    {
+        std::unique_lock lock(mutex_);
+        auto it = std::find_if(mixes_.begin(), mixes_.end(), [video](const Mix& mix) { return mix.video == video; });
+        if (it == mixes_.end() || --it->refs > 0)
+            return;
+
+        Destroy(*it);
+        mixes_.erase(it);
+        blog(LOG_INFO, TAG "Video mix released, %d active", static_cast<int>(mixes_.size()));
+    }
+
+    void SyncProgramChannels() override
+    {
+        std::unique_lock lock(mutex_);
+        for (auto& mix : mixes_) {
+            if (mix.scene.empty())
+                SetProgramChannels(mix);
+        }
+    }
+
+    int GetActiveMixCount() override
+    {
+        std::unique_lock lock(mutex_);
+        return static_cast<int>(mixes_.size());
+    }
+};
+
+VideoMixCache* GetVideoMixCache()
+{
+    static VideoMixCacheImpl impl_;
+    return &impl_;
+}
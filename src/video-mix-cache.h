@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+typedef struct video_output video_t;
+
+struct VideoMixSpec {
+    // empty means the program output
+    std::string scene;
+    // 0 keeps the output resolution of OBS
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // "bilinear", "bicubic", "lanczos" or "area"
+    std::string scaleType;
+    uint32_t fpsDivisor = 1;
+};
+
+// Scaled video mixes shared between dedicated video encoders. Encoders that
+// render the same scene at the same size, filter and frame rate are fed from
+// one mix, so the scene is rendered, scaled and colour converted once instead
+// of once per encoder.
+//
+// With the canvas API of OBS 31.1 every mix is a private canvas that renders
+// at its own frame rate. Older libobs falls back to obs_view mixes running at
+// the OBS frame rate, and the frame rate divisor is left to the encoder.
+class VideoMixCache {
+public:
+    virtual ~VideoMixCache() {}
+    // Returns nullptr if the scene does not exist. encoderDivisor receives the
+    // frame rate divisor the encoder still has to apply on top of the mix.
+    virtual video_t* Acquire(const VideoMixSpec& spec, uint32_t& encoderDivisor) = 0;
+    virtual void Release(video_t* video) = 0;
+    // Re-reads the output channels of OBS into the program mixes, e.g. after the transition changed.
+    virtual void SyncProgramChannels() = 0;
+    virtual int GetActiveMixCount() = 0;
+};
+
+VideoMixCache* GetVideoMixCache();
@@ -0,0 +1,170 @@
+// Times the category matcher over a large synthetic category list.
+//
+//   multi-rtmp-fuzzy-bench [--categories N] [--queries N] [--seed N]
+//
+// Each query runs twice: through FuzzyMatcher, and through the matching the
+// plugin used before it, which lowercased a copy of every name and ran the full
+// Levenshtein table against each one. Both must pick the same category.
+
+#include "../src/fuzzy-match.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const kWords[] = {
+    "Call", "of", "Duty", "Counter", "Strike", "League", "Legends", "Grand", "Theft", "Auto", "Minecraft",
+    "Fortnite", "Just", "Chatting", "Apex", "World", "Warcraft", "Dark", "Souls", "Elden", "Ring", "Rocket",
+    "Valorant", "Overwatch", "Street", "Fighter", "Final", "Fantasy", "Battlefield", "Racing", "Simulator",
+    "Farming", "Tales", "Chronicles", "Legacy", "Online", "Remastered", "Edition", "Warfare", "Kingdom",
+    "Hearts", "Star", "Wars", "Dungeons", "Dragons", "Music", "Art", "Sports", "Talk", "Shows", "Podcast",
+};
+
+static std::string RandomName(std::mt19937& rng)
+{
+    std::string name;
+    int words = 1 + static_cast<int>(rng() % 4);
+    for (int i = 0; i < words; ++i) {
+        if (i)
+            name += ' ';
+        name += kWords[rng() % std::size(kWords)];
+    }
+    if (rng() % 3 == 0)
+        name += " " + std::to_string(rng() % 10);
+    return name;
+}
+
+// A listed name with a typo or two, or now and then an unrelated one.
+static std::string RandomQuery(std::mt19937& rng, const std::vector<std::string>& names)
+{
+    if (rng() % 8 == 0)
+        return RandomName(rng);
+    auto query = names[rng() % names.size()];
+    int typos = static_cast<int>(rng() % 3);
+    for (int i = 0; i < typos && !query.empty(); ++i) {
+        size_t at = rng() % query.size();
+        switch (rng() % 3) {
+        case 0: query[at] = static_cast<char>('a' + rng() % 26); break;
+        case 1: query.erase(at, 1); break;
+        default: query.insert(at, 1, static_cast<char>('a' + rng() % 26)); break;
+        }
+    }
+    return query.substr(0, 25);
+}
+
+static int Levenshtein(const std::string& s1, const std::string& s2)
+{
+    const int m = static_cast<int>(s1.size());
+    const int n = static_cast<int>(s2.size());
+    if (m == 0) return n;
+    if (n == 0) return m;
+
+    std::vector<int> costs(n + 1);
+    for (int i = 0; i <= n; ++i)
+        costs[i] = i;
+    for (int i = 0; i < m; ++i) {
+        costs[0] = i + 1;
+        int corner = i;
+        for (int j = 0; j < n; ++j) {
+            int upper = costs[j + 1];
+            costs[j + 1] = std::min({ costs[j] + 1, upper + 1, corner + (s1[i] == s2[j] ? 0 : 1) });
+            corner = upper;
+        }
+    }
+    return costs[n];
+}
+
+static std::string Lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+    return text;
+}
+
+// The pre-FuzzyMatcher selection: an exact pass, then the closest name, ties to the longer one.
+static size_t BaselineBest(const std::string& query, const std::vector<std::string>& names)
+{
+    auto queryLower = Lower(query);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (Lower(names[i]) == queryLower)
+            return i;
+    }
+
+    size_t best = 0;
+    int minDistance = INT_MAX;
+    for (size_t i = 0; i < names.size(); ++i) {
+        int distance = Levenshtein(queryLower, Lower(names[i]));
+        if (distance < minDistance || (distance == minDistance && names[i].size() > names[best].size())) {
+            minDistance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    size_t categories = 5000, queries = 200;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--categories" && hasValue)
+            categories = std::max(strtoul(argv[++i], nullptr, 10), 1ul);
+        else if (arg == "--queries" && hasValue)
+            queries = std::max(strtoul(argv[++i], nullptr, 10), 1ul);
+        else if (arg == "--seed" && hasValue)
+            seed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else {
+            fprintf(stderr, "usage: %s [--categories N] [--queries N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<std::string> names(categories);
+    for (auto& name : names)
+        name = RandomName(rng);
+    std::vector<std::string> inputs(queries);
+    for (auto& query : inputs)
+        query = RandomQuery(rng, names);
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    std::vector<size_t> expected;
+    expected.reserve(queries);
+    for (auto& query : inputs)
+        expected.push_back(BaselineBest(query, names));
+    double baselineMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    // built per query, as CategorySearch does for every response
+    start = Clock::now();
+    size_t mismatches = 0;
+    for (size_t q = 0; q < queries; ++q) {
+        FuzzyMatcher matcher;
+        size_t totalLength = 0;
+        for (auto& name : names)
+            totalLength += name.size();
+        matcher.Reserve(names.size(), totalLength);
+        for (auto& name : names)
+            matcher.Add(name);
+        auto match = matcher.Best(inputs[q]);
+        if (!match.has_value() || match->index != expected[q])
+            ++mismatches;
+    }
+    double matcherMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    printf("%zu categories, %zu queries\n", categories, queries);
+    printf("baseline      %10.3f ms per query\n", baselineMs / queries);
+    printf("FuzzyMatcher  %10.3f ms per query (%.1fx)\n", matcherMs / queries, baselineMs / matcherMs);
+    if (mismatches > 0) {
+        printf("%zu queries picked a different category than the baseline\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+// Local HTTPS stand-in for the Streamlabs API, used to measure the per-call
+// latency of the plugin's HttpClient with cold and warm connections.
+//
+//   multi-rtmp-http-bench [--rounds N] [--rtt MS] [--close-every N]
+//
+// Each round makes the three calls of a Streamlabs start: a category search,
+// the stream start and the stream end. The same rounds then run the way the
+// plugin called the API before the pooled client: a new easy handle without
+// shared caches for every call.
+//
+// The stand-in listens on 127.0.0.1 with a self-signed certificate made at
+// startup. --rtt delays every response by MS, and a new connection by two more
+// round trips for the TCP and TLS handshakes. --close-every makes the server
+// drop a connection after N responses, so that reconnects and TLS session
+// resumption show up in the pooled numbers.
+
+#include "../src/http-client.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#endif
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void SleepMs(int ms)
+{
+    if (ms > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Self-signed certificate for 127.0.0.1, also written to certPath for the client.
+static SSL_CTX* CreateServerContext(const std::string& certPath)
+{
+    EVP_PKEY* key = nullptr;
+    auto keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (!keyContext || EVP_PKEY_keygen_init(keyContext) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048) <= 0
+        || EVP_PKEY_keygen(keyContext, &key) <= 0) {
+        EVP_PKEY_CTX_free(keyContext);
+        return nullptr;
+    }
+    EVP_PKEY_CTX_free(keyContext);
+
+    auto cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    auto name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509V3_CTX extensions;
+    X509V3_set_ctx_nodb(&extensions);
+    X509V3_set_ctx(&extensions, cert, cert, nullptr, nullptr, 0);
+    auto san = X509V3_EXT_conf_nid(nullptr, &extensions, NID_subject_alt_name, "IP:127.0.0.1");
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(cert, key, EVP_sha256());
+
+    SSL_CTX* context = nullptr;
+    if (auto file = fopen(certPath.c_str(), "w")) {
+        PEM_write_X509(file, cert);
+        fclose(file);
+        context = SSL_CTX_new(TLS_server_method());
+        if (context && (SSL_CTX_use_certificate(context, cert) != 1 || SSL_CTX_use_PrivateKey(context, key) != 1)) {
+            SSL_CTX_free(context);
+            context = nullptr;
+        }
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return context;
+}
+
+static std::string JsonResponse(const std::string& path)
+{
+    if (path.rfind("/stream/start", 0) == 0)
+        return R"({"id":"standin","rtmp":"rtmp://127.0.0.1/live","key":"standin-key"})";
+    if (path.find("/end") != std::string::npos)
+        return R"({"success":true})";
+    if (path.rfind("/info", 0) == 0) {
+        std::string body = R"({"categories":[)";
+        for (int i = 0; i < 20; ++i)
+            body += (i ? "," : "") + std::string(R"({"full_name":"Category )") + std::to_string(i) + R"(","game_mask_id":")" + std::to_string(i) + "\"}";
+        return body + "]}";
+    }
+    return {};
+}
+
+class Standin {
+    SSL_CTX* context_;
+    SocketHandle listener_ = kInvalidSocket;
+    int rttMs_;
+    int closeEvery_;
+    std::atomic<int> connections_ = 0;
+
+    // Reads one request, false once the client is gone.
+    static bool ReadRequest(SSL* ssl, std::string& buffer, std::string& path)
+    {
+        char chunk[4096];
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            int n = SSL_read(ssl, chunk, sizeof(chunk));
+            if (n <= 0)
+                return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+
+        auto headers = buffer.substr(0, end);
+        auto space = headers.find(' ');
+        path = headers.substr(space + 1, headers.find(' ', space + 1) - space - 1);
+        size_t contentLength = 0;
+        for (auto& field : { "\r\nContent-Length:", "\r\ncontent-length:" }) {
+            auto at = headers.find(field);
+            if (at != std::string::npos)
+                contentLength = strtoul(headers.c_str() + at + strlen(field), nullptr, 10);
+        }
+
+        auto total = end + 4 + contentLength;
+        while (buffer.size() < total) {
+            int n = SSL_read(ssl, chunk, sizeof(chunk));
+            if (n <= 0)
+                return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        buffer.erase(0, total);
+        return true;
+    }
+
+    void Serve(SocketHandle client)
+    {
+        ++connections_;
+        // TCP and TLS 1.3 handshakes are a round trip each
+        SleepMs(2 * rttMs_);
+        auto ssl = SSL_new(context_);
+        SSL_set_fd(ssl, static_cast<int>(client));
+        if (SSL_accept(ssl) == 1) {
+            std::string buffer, path;
+            for (int served = 0; closeEvery_ <= 0 || served < closeEvery_; ++served) {
+                if (!ReadRequest(ssl, buffer, path))
+                    break;
+                auto body = JsonResponse(path);
+                std::string response = body.empty()
+                    ? "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+                    : "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                SleepMs(rttMs_);
+                if (SSL_write(ssl, response.data(), static_cast<int>(response.size())) <= 0)
+                    break;
+            }
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        CloseSocket(client);
+    }
+
+public:
+    Standin(SSL_CTX* context, int rttMs, int closeEvery) : context_(context), rttMs_(rttMs), closeEvery_(closeEvery) {}
+
+    int Listen()
+    {
+        listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener_ == kInvalidSocket)
+            return 0;
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (::bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener_, 16) != 0
+            || getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &length) != 0)
+            return 0;
+
+        std::thread([this]() {
+            for (;;) {
+                auto client = ::accept(listener_, nullptr, nullptr);
+                if (client == kInvalidSocket)
+                    return;
+                // keep Nagle and delayed ACKs from adding their own 40 ms to small responses
+                int one = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+                std::thread(&Standin::Serve, this, client).detach();
+            }
+        }).detach();
+        return ntohs(addr.sin_port);
+    }
+
+    int Connections() const { return connections_; }
+};
+
+struct Sample {
+    const char* call;
+    double totalMs;
+    double tlsMs;
+    bool cold;
+};
+
+struct Call {
+    const char* name;
+    std::string path;
+    bool post;
+    bool form;
+};
+
+static std::vector<Call> StartCalls()
+{
+    return {
+        { "category search", "/info?category=category%207", false, false },
+        { "stream start", "/stream/start", true, true },
+        { "stream end", "/stream/standin/end", true, false },
+    };
+}
+
+static bool RunPooled(const std::string& base, const std::string& caFile, int rounds, std::vector<Sample>& samples)
+{
+    for (int round = 0; round < rounds; ++round) {
+        for (auto& call : StartCalls()) {
+            HttpRequest request;
+            request.url = base + call.path;
+            request.bearerToken = "standin-token";
+            request.post = call.post;
+            if (call.form)
+                request.formFields = { { "title", "bench" }, { "category", "7" } };
+            request.caFile = caFile;
+            auto response = GetHttpClient()->Perform(request);
+            if (response.result != CURLE_OK || response.status != 200) {
+                fprintf(stderr, "%s failed: %s, HTTP %ld\n", call.name, curl_easy_strerror(response.result), response.status);
+                return false;
+            }
+            samples.push_back({ call.name, response.totalMs, response.tlsMs, response.cold });
+        }
+    }
+    return true;
+}
+
+static size_t Discard(void*, size_t size, size_t count, void*)
+{
+    return size * count;
+}
+
+// What the plugin did before the pooled client: a new easy handle per call.
+static bool RunPerCall(const std::string& base, const std::string& caFile, int rounds, std::vector<Sample>& samples)
+{
+    for (int round = 0; round < rounds; ++round) {
+        for (auto& call : StartCalls()) {
+            auto curl = curl_easy_init();
+            curl_slist* headers = curl_slist_append(nullptr, "Authorization: Bearer standin-token");
+            curl_mime* mime = nullptr;
+            auto url = base + call.path;
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+            curl_easy_setopt(curl, CURLOPT_CAINFO, caFile.c_str());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Discard);
+            if (call.form) {
+                mime = curl_mime_init(curl);
+                auto part = curl_mime_addpart(mime);
+                curl_mime_name(part, "title");
+                curl_mime_data(part, "bench", CURL_ZERO_TERMINATED);
+                curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+            } else if (call.post) {
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+            }
+
+            auto result = curl_easy_perform(curl);
+            curl_off_t total = 0, appconnect = 0;
+            curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+            curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+            curl_mime_free(mime);
+            curl_slist_free_all(headers);
+            curl_easy_cleanup(curl);
+            if (result != CURLE_OK) {
+                fprintf(stderr, "%s failed: %s\n", call.name, curl_easy_strerror(result));
+                return false;
+            }
+            samples.push_back({ call.name, total / 1000.0, appconnect / 1000.0, true });
+        }
+    }
+    return true;
+}
+
+static void Report(const char* client, const std::vector<Sample>& samples)
+{
+    for (auto& sample : samples) {
+        printf("%-10s %-16s %-5s %9.2f %9.2f\n", client, sample.call, sample.cold ? "cold" : "warm", sample.totalMs,
+            sample.tlsMs);
+    }
+}
+
+static void Summarize(const char* client, const std::vector<Sample>& samples)
+{
+    for (bool cold : { true, false }) {
+        int count = 0;
+        double sum = 0, tls = 0;
+        for (auto& sample : samples) {
+            if (sample.cold != cold)
+                continue;
+            ++count;
+            sum += sample.totalMs;
+            tls += sample.tlsMs;
+        }
+        if (count > 0) {
+            printf("%-10s %-5s %3d calls, mean %.2f ms, of which %.2f ms to set up TLS\n", client, cold ? "cold" : "warm",
+                count, sum / count, tls / count);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = 5, rttMs = 0, closeEvery = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--rounds" && hasValue)
+            rounds = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--rtt" && hasValue)
+            rttMs = std::max(atoi(argv[++i]), 0);
+        else if (arg == "--close-every" && hasValue)
+            closeEvery = std::max(atoi(argv[++i]), 0);
+        else {
+            fprintf(stderr, "usage: %s [--rounds N] [--rtt MS] [--close-every N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+    auto caFile = (std::filesystem::temp_directory_path() / "multi-rtmp-http-bench.pem").string();
+    auto context = CreateServerContext(caFile);
+    if (!context) {
+        fprintf(stderr, "cannot create the TLS context\n");
+        return 1;
+    }
+    Standin standin(context, rttMs, closeEvery);
+    int port = standin.Listen();
+    if (port == 0) {
+        fprintf(stderr, "cannot listen on 127.0.0.1\n");
+        return 1;
+    }
+    auto base = "https://127.0.0.1:" + std::to_string(port);
+    printf("stand-in on %s, %d rounds, rtt %d ms\n\n", base.c_str(), rounds, rttMs);
+
+    std::vector<Sample> pooled, perCall;
+    if (!RunPooled(base, caFile, rounds, pooled))
+        return 1;
+    int pooledConnections = standin.Connections();
+    if (!RunPerCall(base, caFile, rounds, perCall))
+        return 1;
+    GetHttpClient()->Shutdown();
+
+    printf("%-10s %-16s %-5s %9s %9s\n", "client", "call", "conn", "total ms", "tls ms");
+    Report("pooled", pooled);
+    Report("per-call", perCall);
+    printf("\n");
+    Summarize("pooled", pooled);
+    Summarize("per-call", perCall);
+    printf("\nconnections opened: pooled %d, per-call %d\n", pooledConnections, standin.Connections() - pooledConnections);
+
+    std::filesystem::remove(caFile);
+    SSL_CTX_free(context);
+    return 0;
+}
@@ -0,0 +1,678 @@
+// Network impairment proxy for reproducible reconnect and congestion tests.
+// Sits between plugin outputs and a local sink and adds latency, jitter, a
+// bandwidth cap, loss and scripted outages.
+//
+//   multi-rtmp-impair --listen PORT --upstream HOST:PORT [--udp]
+//                     [--latency MS] [--jitter MS] [--rate KBPS] [--loss PCT]
+//                     [--script FILE] [--csv FILE]
+//
+// TCP (RTMP) cannot lose bytes, so loss there stalls the stream for a
+// retransmission timeout instead. UDP (SRT, RIST) datagrams are dropped.
+//
+// A script is a list of "SECONDS ACTION [ARGS]" lines, relative to start:
+//
+//   10  set latency=150 jitter=40 rate=4000 loss=1
+//   30  outage 8      # forward nothing for 8 seconds
+//   60  reset         # close every connection
+//   90  end
+//
+// With "Publish stats in shared memory" enabled in the dock, the run ends
+// with a per-target report of time to reconnect, dropped frames and send
+// queue peak, plus the peak resident memory of OBS on Linux. --csv appends
+// the report to a file for comparing runs.
+
+#ifdef _WIN32
+// before shm-reader.h, Windows.h would pull in the old winsock.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "shm-reader.h"
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <ctime>
+#include <cstdio>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#define poll WSAPoll
+using pollfd = WSAPOLLFD;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t kReadChunk = 16 * 1024;
+// per direction, a full buffer stops reading so that TCP backpressure reaches the sender
+static const size_t kMaxBufferedBytes = 2 * 1024 * 1024;
+static const auto kRetransmitStall = std::chrono::milliseconds(200);
+
+struct Impairment {
+    int latencyMs = 0;
+    int jitterMs = 0;
+    int rateKbps = 0;
+    double lossPct = 0;
+    Clock::time_point outageUntil;
+};
+
+static std::mutex s_impairmentMutex;
+static Impairment s_impairment;
+static std::atomic<int> s_resetGeneration = 0;
+static volatile std::sig_atomic_t s_interrupted = 0;
+
+static Impairment CurrentImpairment()
+{
+    std::unique_lock lock(s_impairmentMutex);
+    return s_impairment;
+}
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void SetNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(socket, FIONBIO, &mode);
+#else
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static bool WouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static bool SetOption(const std::string& key, const std::string& value, Impairment& impairment)
+{
+    if (key == "latency")
+        impairment.latencyMs = std::max(atoi(value.c_str()), 0);
+    else if (key == "jitter")
+        impairment.jitterMs = std::max(atoi(value.c_str()), 0);
+    else if (key == "rate")
+        impairment.rateKbps = std::max(atoi(value.c_str()), 0);
+    else if (key == "loss")
+        impairment.lossPct = std::clamp(atof(value.c_str()), 0.0, 100.0);
+    else
+        return false;
+    return true;
+}
+
+// One direction of a link: data waits until its delivery time and leaves at the capped rate.
+class DelayLine {
+    struct Chunk {
+        std::vector<uint8_t> data;
+        size_t offset = 0;
+        Clock::time_point ready;
+    };
+
+    std::deque<Chunk> queue_;
+    size_t bytes_ = 0;
+    Clock::time_point lastReady_;
+    Clock::time_point txFree_;
+    bool impaired_;
+    bool stream_;
+    std::mt19937& random_;
+
+public:
+    DelayLine(bool impaired, bool stream, std::mt19937& random)
+        : impaired_(impaired), stream_(stream), random_(random) {}
+
+    bool Full() const { return bytes_ >= kMaxBufferedBytes; }
+    bool Empty() const { return queue_.empty(); }
+
+    void Push(const uint8_t* data, size_t size, const Impairment& impairment)
+    {
+        auto now = Clock::now();
+        bool lost = impaired_ && impairment.lossPct > 0
+            && std::uniform_real_distribution<double>(0, 100)(random_) < impairment.lossPct;
+        if (lost && !stream_)
+            return;
+        if (!stream_ && (now < impairment.outageUntil || Full()))
+            return;
+
+        int jitter = impairment.jitterMs > 0
+            ? std::uniform_int_distribution<int>(-impairment.jitterMs, impairment.jitterMs)(random_) : 0;
+        auto ready = now + std::chrono::milliseconds(std::max(impairment.latencyMs + jitter, 0));
+        if (lost)
+            ready += kRetransmitStall;
+        // a stream keeps its order, datagrams may overtake each other
+        if (stream_)
+            ready = std::max(ready, lastReady_);
+        lastReady_ = ready;
+
+        Chunk chunk;
+        chunk.data.assign(data, data + size);
+        chunk.ready = ready;
+        bytes_ += size;
+        auto at = queue_.end();
+        if (!stream_) {
+            while (at != queue_.begin() && std::prev(at)->ready > ready)
+                --at;
+        }
+        queue_.insert(at, std::move(chunk));
+    }
+
+    // Time the next chunk may leave, max when nothing is queued.
+    Clock::time_point NextDue(const Impairment& impairment) const
+    {
+        if (queue_.empty())
+            return Clock::time_point::max();
+        auto due = std::max(queue_.front().ready, txFree_);
+        if (stream_)
+            due = std::max(due, impairment.outageUntil);
+        return due;
+    }
+
+    // Sends what is due. False once the destination is gone.
+    bool Drain(SocketHandle socket, const sockaddr* to, int toLength, const Impairment& impairment)
+    {
+        for (;;) {
+            auto now = Clock::now();
+            if (queue_.empty() || NextDue(impairment) > now)
+                return true;
+
+            auto& chunk = queue_.front();
+            auto size = chunk.data.size() - chunk.offset;
+            int sent;
+            if (to)
+                sent = ::sendto(socket, reinterpret_cast<const char*>(chunk.data.data()), static_cast<int>(size), 0, to, toLength);
+            else
+                sent = ::send(socket, reinterpret_cast<const char*>(chunk.data.data() + chunk.offset), static_cast<int>(size), 0);
+            if (sent < 0 && WouldBlock())
+                return true;
+            if (sent < 0 && !stream_) {
+                // a datagram that cannot be sent is simply lost
+                sent = static_cast<int>(size);
+            } else if (sent <= 0) {
+                return false;
+            }
+
+            if (impaired_ && impairment.rateKbps > 0) {
+                auto cost = std::chrono::microseconds(static_cast<int64_t>(sent) * 8000 / impairment.rateKbps);
+                txFree_ = std::max(txFree_, now) + cost;
+            }
+            chunk.offset += static_cast<size_t>(sent);
+            bytes_ -= static_cast<size_t>(sent);
+            if (chunk.offset == chunk.data.size())
+                queue_.pop_front();
+        }
+    }
+};
+
+static int TimeoutMs(Clock::time_point due)
+{
+    if (due == Clock::time_point::max())
+        return 100;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+    return static_cast<int>(std::clamp<int64_t>(ms, 0, 100));
+}
+
+static SocketHandle ConnectUpstream(const addrinfo& upstream)
+{
+    auto s = ::socket(upstream.ai_family, upstream.ai_socktype, upstream.ai_protocol);
+    if (s == kInvalidSocket)
+        return kInvalidSocket;
+    if (::connect(s, upstream.ai_addr, static_cast<int>(upstream.ai_addrlen)) != 0) {
+        CloseSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+static void RelayTcp(SocketHandle client, SocketHandle server, int id)
+{
+    std::mt19937 random{ std::random_device{}() };
+    DelayLine up(true, true, random);
+    DelayLine down(false, true, random);
+    SocketHandle sockets[2] = { client, server };
+    DelayLine* lines[2] = { &up, &down };
+    int one = 1;
+    for (auto s : sockets) {
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        SetNonBlocking(s);
+    }
+
+    auto generation = s_resetGeneration.load();
+    bool open[2] = { true, true };
+    std::vector<uint8_t> buffer(kReadChunk);
+    while (s_resetGeneration == generation) {
+        auto impairment = CurrentImpairment();
+        // a side that closed still gets what is queued for the other one
+        if (!open[0] && up.Empty())
+            break;
+        if (!open[1] && down.Empty())
+            break;
+
+        pollfd fds[2];
+        for (int i = 0; i < 2; ++i) {
+            fds[i] = { sockets[i], 0, 0 };
+            if (open[i] && !lines[i]->Full())
+                fds[i].events |= POLLIN;
+            if (lines[1 - i]->NextDue(impairment) <= Clock::now())
+                fds[i].events |= POLLOUT;
+        }
+        auto due = std::min(up.NextDue(impairment), down.NextDue(impairment));
+        if (poll(fds, 2, TimeoutMs(due)) < 0)
+            break;
+
+        bool failed = false;
+        for (int i = 0; i < 2 && !failed; ++i) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                auto n = ::recv(sockets[i], reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0);
+                if (n > 0)
+                    lines[i]->Push(buffer.data(), static_cast<size_t>(n), impairment);
+                else if (n == 0 || !WouldBlock())
+                    open[i] = false;
+            }
+        }
+        failed = !up.Drain(server, nullptr, 0, impairment) || !down.Drain(client, nullptr, 0, impairment);
+        if (failed)
+            break;
+    }
+
+    printf("connection #%d closed%s\n", id, s_resetGeneration != generation ? " by reset" : "");
+    fflush(stdout);
+    CloseSocket(client);
+    CloseSocket(server);
+}
+
+static void ServeTcp(SocketHandle listener, addrinfo upstream)
+{
+    int nextId = 1;
+    for (;;) {
+        auto client = ::accept(listener, nullptr, nullptr);
+        if (client == kInvalidSocket)
+            continue;
+        auto server = ConnectUpstream(upstream);
+        if (server == kInvalidSocket) {
+            fprintf(stderr, "cannot reach the upstream, dropping the connection\n");
+            CloseSocket(client);
+            continue;
+        }
+        int id = nextId++;
+        printf("connection #%d opened\n", id);
+        fflush(stdout);
+        std::thread(RelayTcp, client, server, id).detach();
+    }
+}
+
+// One client at a time: the most recent sender gets the replies.
+static void ServeUdp(SocketHandle front, addrinfo upstream)
+{
+    auto back = ::socket(upstream.ai_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (back == kInvalidSocket || ::connect(back, upstream.ai_addr, static_cast<int>(upstream.ai_addrlen)) != 0) {
+        fprintf(stderr, "cannot open the upstream socket\n");
+        return;
+    }
+    SetNonBlocking(front);
+    SetNonBlocking(back);
+
+    std::mt19937 random{ std::random_device{}() };
+    DelayLine up(true, false, random);
+    DelayLine down(false, false, random);
+    sockaddr_storage client = {};
+    socklen_t clientLength = 0;
+    auto generation = s_resetGeneration.load();
+    std::vector<uint8_t> buffer(65536);
+
+    for (;;) {
+        auto impairment = CurrentImpairment();
+        if (s_resetGeneration != generation) {
+            // no connection to close, forget the peer instead
+            generation = s_resetGeneration;
+            clientLength = 0;
+        }
+
+        pollfd fds[2] = { { front, POLLIN, 0 }, { back, POLLIN, 0 } };
+        auto due = std::min(up.NextDue(impairment), down.NextDue(impairment));
+        if (poll(fds, 2, TimeoutMs(due)) < 0)
+            return;
+
+        if (fds[0].revents & POLLIN) {
+            sockaddr_storage from = {};
+            socklen_t fromLength = sizeof(from);
+            auto n = ::recvfrom(front, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0,
+                reinterpret_cast<sockaddr*>(&from), &fromLength);
+            if (n > 0) {
+                client = from;
+                clientLength = fromLength;
+                up.Push(buffer.data(), static_cast<size_t>(n), impairment);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            auto n = ::recv(back, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0);
+            if (n > 0 && clientLength > 0)
+                down.Push(buffer.data(), static_cast<size_t>(n), impairment);
+        }
+
+        up.Drain(back, nullptr, 0, impairment);
+        if (clientLength > 0)
+            down.Drain(front, reinterpret_cast<sockaddr*>(&client), static_cast<int>(clientLength), impairment);
+    }
+}
+
+struct ScriptStep {
+    double atSec = 0;
+    std::string action;
+    std::vector<std::string> args;
+};
+
+static bool LoadScript(const std::string& path, std::vector<ScriptStep>& steps)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        ScriptStep step;
+        if (!(words >> step.atSec))
+            continue;
+        if (!(words >> step.action)) {
+            fprintf(stderr, "%s:%d: missing action\n", path.c_str(), number);
+            return false;
+        }
+        for (std::string arg; words >> arg;)
+            step.args.push_back(arg);
+        if (step.action != "set" && step.action != "outage" && step.action != "reset" && step.action != "end") {
+            fprintf(stderr, "%s:%d: unknown action %s\n", path.c_str(), number, step.action.c_str());
+            return false;
+        }
+        steps.push_back(std::move(step));
+    }
+    std::stable_sort(steps.begin(), steps.end(), [](auto& a, auto& b) { return a.atSec < b.atSec; });
+    return true;
+}
+
+static void RunStep(const ScriptStep& step)
+{
+    std::unique_lock lock(s_impairmentMutex);
+    if (step.action == "set") {
+        for (auto& arg : step.args) {
+            auto eq = arg.find('=');
+            if (eq == std::string::npos || !SetOption(arg.substr(0, eq), arg.substr(eq + 1), s_impairment))
+                fprintf(stderr, "ignoring %s\n", arg.c_str());
+        }
+    } else if (step.action == "outage") {
+        auto sec = step.args.empty() ? 5.0 : atof(step.args[0].c_str());
+        s_impairment.outageUntil = Clock::now() + std::chrono::milliseconds(static_cast<int64_t>(sec * 1000));
+    } else if (step.action == "reset") {
+        ++s_resetGeneration;
+    }
+    printf("[%6.1f s] %s", step.atSec, step.action.c_str());
+    for (auto& arg : step.args)
+        printf(" %s", arg.c_str());
+    printf("  (latency %d ms, jitter %d ms, rate %d kbps, loss %.1f%%)\n", s_impairment.latencyMs,
+        s_impairment.jitterMs, s_impairment.rateKbps, s_impairment.lossPct);
+    fflush(stdout);
+}
+
+// Per-target results over the run, sampled from the stats segment.
+class Observer {
+    struct Target {
+        std::string name;
+        RecordCopy first = {};
+        RecordCopy last = {};
+        bool down = false;
+        Clock::time_point downSince;
+        std::vector<int64_t> outagesMs;
+        uint64_t queuePeak = 0;
+    };
+
+    const StatsShmSegment* segment_ = nullptr;
+    std::map<std::string, Target> targets_;
+    uint64_t peakRssKb_ = 0;
+
+    // VmHWM of the plugin process, Linux only
+    uint64_t ReadPeakRssKb() const
+    {
+#ifdef __linux__
+        auto pid = segment_->header.writerPid;
+        std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmHWM:", 0) == 0)
+                return strtoull(line.c_str() + 6, nullptr, 10);
+        }
+#endif
+        return 0;
+    }
+
+public:
+    bool Open()
+    {
+        segment_ = MapSegment();
+        return segment_ && SegmentUsable(*segment_);
+    }
+
+    void Sample()
+    {
+        if (!segment_ || segment_->header.magic.load(std::memory_order_acquire) != kStatsShmMagic)
+            return;
+        auto now = Clock::now();
+        auto used = std::min(segment_->header.used.load(std::memory_order_acquire), kStatsShmCapacity);
+        for (uint32_t i = 0; i < used; ++i) {
+            RecordCopy copy;
+            if (!ReadRecord(segment_->records[i], copy) || copy.state == StatsShmFree)
+                continue;
+            auto [it, added] = targets_.try_emplace(copy.id);
+            auto& target = it->second;
+            if (added)
+                target.first = copy;
+            target.last = copy;
+            target.name = copy.name[0] ? copy.name : copy.id;
+            target.queuePeak = std::max(target.queuePeak, copy.sendQueuePeak);
+
+            bool down = copy.state == StatsShmReconnecting;
+            if (down && !target.down) {
+                target.downSince = now;
+            } else if (!down && target.down && copy.state == StatsShmRunning) {
+                target.outagesMs.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(now - target.downSince).count());
+            }
+            target.down = down;
+        }
+        peakRssKb_ = std::max(peakRssKb_, ReadPeakRssKb());
+    }
+
+    void Report(double elapsedSec, const std::string& csvPath)
+    {
+        printf("\n%-24s %6s %10s %10s %8s %8s %12s\n", "target", "outage", "ttr avg ms", "ttr max ms", "retries", "dropped", "queue peak");
+        FILE* csv = nullptr;
+        if (!csvPath.empty()) {
+            csv = fopen(csvPath.c_str(), "a");
+            if (csv && ftell(csv) == 0)
+                fprintf(csv, "time,elapsed_s,target,outages,ttr_avg_ms,ttr_max_ms,unfinished_outage,retries,dropped_frames,send_queue_peak,peak_rss_kb\n");
+        }
+        auto stamp = static_cast<long long>(time(nullptr));
+        for (auto& [id, target] : targets_) {
+            int64_t sum = 0, longest = 0;
+            for (auto ms : target.outagesMs) {
+                sum += ms;
+                longest = std::max(longest, ms);
+            }
+            auto count = static_cast<int64_t>(target.outagesMs.size());
+            auto average = count > 0 ? sum / count : 0;
+            auto retries = target.last.reconnects - std::min(target.first.reconnects, target.last.reconnects);
+            auto dropped = target.last.droppedFrames - std::min(target.first.droppedFrames, target.last.droppedFrames);
+            printf("%-24s %7lld %10lld %10lld %8llu %8llu %12llu%s\n", target.name.substr(0, 24).c_str(), (long long)count,
+                (long long)average, (long long)longest, (unsigned long long)retries, (unsigned long long)dropped,
+                (unsigned long long)target.queuePeak, target.down ? "  (still reconnecting)" : "");
+            if (csv) {
+                fprintf(csv, "%lld,%.1f,%s,%lld,%lld,%lld,%d,%llu,%llu,%llu,%llu\n", stamp, elapsedSec, id.c_str(),
+                    (long long)count, (long long)average, (long long)longest, target.down ? 1 : 0,
+                    (unsigned long long)retries, (unsigned long long)dropped, (unsigned long long)target.queuePeak,
+                    (unsigned long long)peakRssKb_);
+            }
+        }
+        if (peakRssKb_ > 0)
+            printf("OBS peak resident memory %.1f MB\n", peakRssKb_ / 1024.0);
+        if (csv)
+            fclose(csv);
+        fflush(stdout);
+    }
+};
+
+static bool Resolve(const std::string& hostPort, bool udp, addrinfo*& result)
+{
+    auto colon = hostPort.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+    return getaddrinfo(hostPort.substr(0, colon).c_str(), hostPort.substr(colon + 1).c_str(), &hints, &result) == 0 && result;
+}
+
+static SocketHandle Bind(int port, bool udp)
+{
+    auto s = ::socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, udp ? IPPROTO_UDP : IPPROTO_TCP);
+    if (s == kInvalidSocket)
+        return kInvalidSocket;
+    int one = 1;
+#ifdef _WIN32
+    setsockopt(s, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char*>(&one), sizeof(one));
+#else
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+#endif
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || (!udp && ::listen(s, 64) != 0)) {
+        CloseSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+static int Usage(const char* self)
+{
+    fprintf(stderr, "usage: %s --listen PORT --upstream HOST:PORT [--udp] [--latency MS] [--jitter MS]\n"
+        "       [--rate KBPS] [--loss PCT] [--script FILE] [--csv FILE]\n", self);
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    int listenPort = 0;
+    std::string upstreamAddress, scriptPath, csvPath;
+    bool udp = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--listen" && hasValue)
+            listenPort = atoi(argv[++i]);
+        else if (arg == "--upstream" && hasValue)
+            upstreamAddress = argv[++i];
+        else if (arg == "--udp")
+            udp = true;
+        else if (arg == "--script" && hasValue)
+            scriptPath = argv[++i];
+        else if (arg == "--csv" && hasValue)
+            csvPath = argv[++i];
+        else if (arg.rfind("--", 0) == 0 && hasValue && SetOption(arg.substr(2), argv[i + 1], s_impairment))
+            ++i;
+        else
+            return Usage(argv[0]);
+    }
+    if (listenPort <= 0 || upstreamAddress.empty())
+        return Usage(argv[0]);
+
+    std::vector<ScriptStep> steps;
+    if (!scriptPath.empty() && !LoadScript(scriptPath, steps))
+        return 1;
+
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+    addrinfo* upstream = nullptr;
+    if (!Resolve(upstreamAddress, udp, upstream)) {
+        fprintf(stderr, "cannot resolve %s\n", upstreamAddress.c_str());
+        return 1;
+    }
+    auto listener = Bind(listenPort, udp);
+    if (listener == kInvalidSocket) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%d\n", listenPort);
+        return 1;
+    }
+    printf("%s 127.0.0.1:%d -> %s\n", udp ? "udp" : "tcp", listenPort, upstreamAddress.c_str());
+    fflush(stdout);
+
+    std::thread([listener, udp, upstream]() {
+        if (udp)
+            ServeUdp(listener, *upstream);
+        else
+            ServeTcp(listener, *upstream);
+    }).detach();
+
+    Observer observer;
+    bool observing = observer.Open();
+    if (!observing)
+        fprintf(stderr, "no stats segment, the run ends without a per-target report\n");
+
+    // without an "end" step the run lasts until Ctrl+C
+    signal(SIGINT, [](int) { s_interrupted = true; });
+    auto start = Clock::now();
+    size_t next = 0;
+    bool ended = false;
+    while (!ended && !s_interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        for (; next < steps.size() && steps[next].atSec <= elapsed && !ended; ++next) {
+            RunStep(steps[next]);
+            ended = steps[next].action == "end";
+        }
+        if (observing)
+            observer.Sample();
+    }
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (observing)
+        observer.Report(elapsed, csvPath);
+    return 0;
+}
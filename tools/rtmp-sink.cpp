@@ -0,0 +1,644 @@
+// Minimal local RTMP ingest for soak tests. Accepts publishers, answers the
+// connect / createStream / publish handshake, reads and discards the FLV
+// payload and prints the throughput of every connection.
+//
+//   multi-rtmp-sink [--port 1935] [--report-sec 10] [--drop-every SEC [--drop-one]]
+//
+// --drop-every closes every connection each SEC seconds (or one random
+// connection with --drop-one), to exercise reconnects under load.
+// Point the dock's "Add soak targets..." at rtmp://127.0.0.1:<port>/live.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+static const SocketHandle kInvalidSocket = -1;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t kHandshakeSize = 1536;
+static const uint32_t kOutChunkSize = 4096;
+static const uint32_t kAckWindow = 2500000;
+
+static void CloseSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void ShutdownSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    shutdown(socket, SD_BOTH);
+#else
+    shutdown(socket, SHUT_RDWR);
+#endif
+}
+
+static void PutBE16(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+static void PutBE24(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+static void PutBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    PutBE24(out, v);
+}
+
+static uint32_t BE24(const uint8_t* p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+static uint32_t BE32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | BE24(p + 1); }
+static uint32_t LE32(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+
+class AmfWriter {
+public:
+    std::vector<uint8_t> data;
+
+    void Number(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        data.push_back(0x00);
+        for (int i = 7; i >= 0; --i)
+            data.push_back(uint8_t(bits >> (i * 8)));
+    }
+
+    void String(const std::string& value)
+    {
+        data.push_back(0x02);
+        Key(value);
+    }
+
+    void Key(const std::string& key)
+    {
+        PutBE16(data, uint32_t(key.size()));
+        data.insert(data.end(), key.begin(), key.end());
+    }
+
+    void Null() { data.push_back(0x05); }
+    void BeginObject() { data.push_back(0x03); }
+    void EndObject() { PutBE24(data, 0x000009); }
+
+    void Property(const std::string& key, const std::string& value)
+    {
+        Key(key);
+        String(value);
+    }
+};
+
+// Reads the leading strings and numbers of a command, skipping everything else.
+class AmfReader {
+    const uint8_t* p_;
+    const uint8_t* end_;
+
+    bool Skip(int depth)
+    {
+        if (p_ >= end_ || depth > 16)
+            return false;
+        auto type = *p_++;
+        switch (type) {
+        case 0x00: return Advance(8);
+        case 0x01: return Advance(1);
+        case 0x02: return SkipString(2);
+        case 0x0C: return SkipString(4);
+        case 0x05: case 0x06: return true;
+        case 0x08: if (!Advance(4)) return false; [[fallthrough]];
+        case 0x03:
+            for (;;) {
+                if (end_ - p_ >= 3 && p_[0] == 0 && p_[1] == 0 && p_[2] == 9) {
+                    p_ += 3;
+                    return true;
+                }
+                if (!SkipString(2) || !Skip(depth + 1))
+                    return false;
+            }
+        case 0x0A: {
+            if (end_ - p_ < 4)
+                return false;
+            auto count = BE32(p_);
+            p_ += 4;
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!Skip(depth + 1))
+                    return false;
+            }
+            return true;
+        }
+        case 0x0B: return Advance(10);
+        default: return false;
+        }
+    }
+
+    bool Advance(size_t n)
+    {
+        if (static_cast<size_t>(end_ - p_) < n)
+            return false;
+        p_ += n;
+        return true;
+    }
+
+    bool SkipString(int lengthBytes)
+    {
+        if (end_ - p_ < lengthBytes)
+            return false;
+        size_t length = lengthBytes == 2 ? (size_t(p_[0]) << 8 | p_[1]) : BE32(p_);
+        p_ += lengthBytes;
+        return Advance(length);
+    }
+
+public:
+    AmfReader(const std::vector<uint8_t>& data) : p_(data.data()), end_(data.data() + data.size()) {}
+
+    bool AtEnd() const { return p_ >= end_; }
+
+    bool String(std::string& value)
+    {
+        if (end_ - p_ < 3 || *p_ != 0x02)
+            return false;
+        size_t length = size_t(p_[1]) << 8 | p_[2];
+        p_ += 3;
+        if (static_cast<size_t>(end_ - p_) < length)
+            return false;
+        value.assign(reinterpret_cast<const char*>(p_), length);
+        p_ += length;
+        return true;
+    }
+
+    bool Number(double& value)
+    {
+        if (end_ - p_ < 9 || *p_ != 0x00)
+            return false;
+        uint64_t bits = 0;
+        for (int i = 1; i <= 8; ++i)
+            bits = (bits << 8) | p_[i];
+        memcpy(&value, &bits, sizeof(value));
+        p_ += 9;
+        return true;
+    }
+
+    bool Next() { return Skip(0); }
+};
+
+struct Connection {
+    int id = 0;
+    SocketHandle socket = kInvalidSocket;
+    std::string peer;
+    std::mutex keyMutex;
+    std::string streamKey;
+    Clock::time_point since = Clock::now();
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> videoFrames = 0;
+    std::atomic<uint64_t> audioFrames = 0;
+    std::atomic<bool> publishing = false;
+    std::atomic<bool> finished = false;
+    // values at the last report
+    uint64_t reportedBytes = 0;
+    uint64_t reportedFrames = 0;
+
+    std::string Key()
+    {
+        std::unique_lock lock(keyMutex);
+        return streamKey;
+    }
+};
+using ConnectionPtr = std::shared_ptr<Connection>;
+
+class Session {
+    struct ChunkStream {
+        uint32_t timestamp = 0;
+        uint32_t length = 0;
+        uint8_t type = 0;
+        uint32_t streamId = 0;
+        bool extended = false;
+        std::vector<uint8_t> payload;
+    };
+
+    Connection& connection_;
+    uint32_t inChunkSize_ = 128;
+    uint32_t peerAckWindow_ = kAckWindow;
+    uint64_t received_ = 0;
+    uint64_t acked_ = 0;
+    std::map<uint32_t, ChunkStream> streams_;
+
+    bool ReadExact(uint8_t* data, size_t size)
+    {
+        while (size > 0) {
+            auto n = ::recv(connection_.socket, reinterpret_cast<char*>(data), static_cast<int>(size), 0);
+            if (n <= 0) {
+#ifndef _WIN32
+                if (n < 0 && errno == EINTR)
+                    continue;
+#endif
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+            received_ += static_cast<uint64_t>(n);
+            connection_.bytes += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool SendAll(const std::vector<uint8_t>& data)
+    {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            auto n = ::send(connection_.socket, reinterpret_cast<const char*>(data.data() + offset),
+                static_cast<int>(data.size() - offset), 0);
+            if (n <= 0)
+                return false;
+            offset += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool Write(uint32_t csid, uint8_t type, uint32_t streamId, const std::vector<uint8_t>& payload)
+    {
+        std::vector<uint8_t> out;
+        out.push_back(uint8_t(csid));
+        PutBE24(out, 0);
+        PutBE24(out, static_cast<uint32_t>(payload.size()));
+        out.push_back(type);
+        for (int i = 0; i < 4; ++i)
+            out.push_back(uint8_t(streamId >> (8 * i)));
+        size_t offset = 0;
+        do {
+            if (offset > 0)
+                out.push_back(uint8_t(0xC0 | csid));
+            auto n = std::min<size_t>(payload.size() - offset, kOutChunkSize);
+            out.insert(out.end(), payload.begin() + offset, payload.begin() + offset + n);
+            offset += n;
+        } while (offset < payload.size());
+        return SendAll(out);
+    }
+
+    bool WriteControl(uint8_t type, uint32_t value, int extraByte = -1)
+    {
+        std::vector<uint8_t> payload;
+        PutBE32(payload, value);
+        if (extraByte >= 0)
+            payload.push_back(uint8_t(extraByte));
+        return Write(2, type, 0, payload);
+    }
+
+    bool Handshake()
+    {
+        std::vector<uint8_t> c0c1(1 + kHandshakeSize);
+        if (!ReadExact(c0c1.data(), c0c1.size()) || c0c1[0] != 0x03)
+            return false;
+
+        std::vector<uint8_t> reply(1 + 2 * kHandshakeSize, 0);
+        reply[0] = 0x03;
+        std::mt19937 random{ std::random_device{}() };
+        for (size_t i = 9; i <= kHandshakeSize; ++i)
+            reply[i] = static_cast<uint8_t>(random());
+        // S2 echoes C1
+        std::copy(c0c1.begin() + 1, c0c1.end(), reply.begin() + 1 + kHandshakeSize);
+        if (!SendAll(reply))
+            return false;
+
+        std::vector<uint8_t> c2(kHandshakeSize);
+        return ReadExact(c2.data(), c2.size());
+    }
+
+    bool ReadMessage(ChunkStream*& complete)
+    {
+        static const size_t kHeaderSizes[] = { 11, 7, 3, 0 };
+        complete = nullptr;
+
+        uint8_t basic[3];
+        if (!ReadExact(basic, 1))
+            return false;
+        uint8_t fmt = basic[0] >> 6;
+        uint32_t csid = basic[0] & 0x3F;
+        if (csid == 0) {
+            if (!ReadExact(basic + 1, 1))
+                return false;
+            csid = 64 + basic[1];
+        } else if (csid == 1) {
+            if (!ReadExact(basic + 1, 2))
+                return false;
+            csid = 64 + basic[1] + basic[2] * 256;
+        }
+
+        uint8_t header[11];
+        if (!ReadExact(header, kHeaderSizes[fmt]))
+            return false;
+        auto& stream = streams_[csid];
+        if (fmt < 3) {
+            stream.extended = BE24(header) == 0xFFFFFF;
+            stream.timestamp = BE24(header);
+        }
+        if (fmt < 2) {
+            stream.length = BE24(header + 3);
+            stream.type = header[6];
+        }
+        if (fmt == 0)
+            stream.streamId = LE32(header + 7);
+        if (stream.extended) {
+            uint8_t extended[4];
+            if (!ReadExact(extended, 4))
+                return false;
+        }
+
+        if (stream.length > 16 * 1024 * 1024 || stream.payload.size() > stream.length)
+            return false;
+        auto need = std::min<size_t>(stream.length - stream.payload.size(), inChunkSize_);
+        auto offset = stream.payload.size();
+        stream.payload.resize(offset + need);
+        if (!ReadExact(stream.payload.data() + offset, need))
+            return false;
+
+        if (received_ - acked_ >= peerAckWindow_) {
+            acked_ = received_;
+            if (!WriteControl(3, static_cast<uint32_t>(received_)))
+                return false;
+        }
+
+        if (stream.payload.size() == stream.length)
+            complete = &stream;
+        return true;
+    }
+
+    bool OnCommand(const std::vector<uint8_t>& payload)
+    {
+        AmfReader reader(payload);
+        std::string name;
+        double transaction = 0;
+        if (!reader.String(name) || !reader.Number(transaction))
+            return true;
+
+        if (name == "connect") {
+            if (!WriteControl(5, kAckWindow) || !WriteControl(6, kAckWindow, 2) || !WriteControl(1, kOutChunkSize))
+                return false;
+            AmfWriter result;
+            result.String("_result");
+            result.Number(transaction);
+            result.BeginObject();
+            result.Property("fmsVer", "FMS/3,0,1,123");
+            result.EndObject();
+            result.BeginObject();
+            result.Property("level", "status");
+            result.Property("code", "NetConnection.Connect.Success");
+            result.EndObject();
+            return Write(3, 20, 0, result.data);
+        }
+        if (name == "createStream") {
+            AmfWriter result;
+            result.String("_result");
+            result.Number(transaction);
+            result.Null();
+            result.Number(1);
+            return Write(3, 20, 0, result.data);
+        }
+        if (name == "publish") {
+            std::string key;
+            reader.Next();
+            reader.String(key);
+            {
+                std::unique_lock lock(connection_.keyMutex);
+                connection_.streamKey = key;
+            }
+            connection_.publishing = true;
+            AmfWriter status;
+            status.String("onStatus");
+            status.Number(0);
+            status.Null();
+            status.BeginObject();
+            status.Property("level", "status");
+            status.Property("code", "NetStream.Publish.Start");
+            status.Property("description", key + " is now published");
+            status.EndObject();
+            return Write(5, 20, 1, status.data);
+        }
+        return true;
+    }
+
+public:
+    explicit Session(Connection& connection) : connection_(connection) {}
+
+    void Run()
+    {
+        if (!Handshake())
+            return;
+
+        for (;;) {
+            ChunkStream* message = nullptr;
+            if (!ReadMessage(message))
+                return;
+            if (!message)
+                continue;
+
+            switch (message->type) {
+            case 1:
+                if (message->payload.size() >= 4)
+                    inChunkSize_ = std::max<uint32_t>(BE32(message->payload.data()) & 0x7FFFFFFF, 1);
+                break;
+            case 5:
+                if (message->payload.size() >= 4)
+                    peerAckWindow_ = std::max<uint32_t>(BE32(message->payload.data()), 1);
+                break;
+            case 8:
+                ++connection_.audioFrames;
+                break;
+            case 9:
+                ++connection_.videoFrames;
+                break;
+            case 20:
+                if (!OnCommand(message->payload))
+                    return;
+                break;
+            default:
+                break;
+            }
+            message->payload.clear();
+        }
+    }
+};
+
+static SocketHandle Listen(int port)
+{
+    auto s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == kInvalidSocket)
+        return kInvalidSocket;
+    int one = 1;
+#ifdef _WIN32
+    setsockopt(s, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char*>(&one), sizeof(one));
+#else
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+#endif
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(s, 64) != 0) {
+        CloseSocket(s);
+        return kInvalidSocket;
+    }
+    return s;
+}
+
+static void Report(std::list<ConnectionPtr>& connections, double intervalSec)
+{
+    double totalBps = 0;
+    int publishing = 0;
+    for (auto& connection : connections) {
+        auto bytes = connection->bytes.load();
+        auto frames = connection->videoFrames.load();
+        auto bps = (bytes - connection->reportedBytes) * 8 / intervalSec;
+        auto fps = (frames - connection->reportedFrames) / intervalSec;
+        connection->reportedBytes = bytes;
+        connection->reportedFrames = frames;
+        totalBps += bps;
+        publishing += connection->publishing ? 1 : 0;
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - connection->since).count();
+        printf("  #%-4d %-21s %-24s %9.0f kbps %6.2f fps %10.1f MB %6llds\n", connection->id, connection->peer.c_str(),
+            connection->Key().substr(0, 24).c_str(), bps / 1000, fps, bytes / 1048576.0, (long long)age);
+    }
+    printf("%d connections, %d publishing, %.2f Mbps\n\n", static_cast<int>(connections.size()), publishing, totalBps / 1e6);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    int port = 1935;
+    int reportSec = 10;
+    int dropEverySec = 0;
+    bool dropOne = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (arg == "--report-sec" && i + 1 < argc)
+            reportSec = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--drop-every" && i + 1 < argc)
+            dropEverySec = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--drop-one")
+            dropOne = true;
+        else {
+            fprintf(stderr, "usage: %s [--port 1935] [--report-sec 10] [--drop-every SEC [--drop-one]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+    auto listener = Listen(port);
+    if (listener == kInvalidSocket) {
+        fprintf(stderr, "cannot listen on 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    printf("listening on rtmp://127.0.0.1:%d/live\n", port);
+    fflush(stdout);
+
+    std::list<ConnectionPtr> connections;
+    int nextId = 1;
+    std::mt19937 random{ std::random_device{}() };
+    auto lastReport = Clock::now();
+    auto lastDrop = Clock::now();
+
+    for (;;) {
+#ifdef _WIN32
+        WSAPOLLFD pfd = { listener, POLLIN, 0 };
+        int ready = WSAPoll(&pfd, 1, 200);
+#else
+        pollfd pfd = { listener, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 200);
+#endif
+        if (ready > 0) {
+            sockaddr_in peer = {};
+            socklen_t peerSize = sizeof(peer);
+            auto socket = ::accept(listener, reinterpret_cast<sockaddr*>(&peer), &peerSize);
+            if (socket != kInvalidSocket) {
+                auto connection = std::make_shared<Connection>();
+                connection->id = nextId++;
+                connection->socket = socket;
+                char address[INET_ADDRSTRLEN] = { 0 };
+                inet_ntop(AF_INET, &peer.sin_addr, address, sizeof(address));
+                connection->peer = std::string(address) + ":" + std::to_string(ntohs(peer.sin_port));
+                connections.push_back(connection);
+                std::thread([connection]() {
+                    Session(*connection).Run();
+                    connection->finished = true;
+                }).detach();
+            }
+        }
+
+        auto now = Clock::now();
+        if (dropEverySec > 0 && now - lastDrop >= std::chrono::seconds(dropEverySec)) {
+            lastDrop = now;
+            std::vector<ConnectionPtr> live;
+            for (auto& connection : connections) {
+                if (!connection->finished)
+                    live.push_back(connection);
+            }
+            if (dropOne && !live.empty()) {
+                auto victim = live[std::uniform_int_distribution<size_t>(0, live.size() - 1)(random)];
+                live = { victim };
+            }
+            for (auto& connection : live) {
+                printf("dropping #%d %s\n", connection->id, connection->Key().c_str());
+                ShutdownSocket(connection->socket);
+            }
+            fflush(stdout);
+        }
+
+        if (now - lastReport >= std::chrono::seconds(reportSec)) {
+            Report(connections, std::chrono::duration<double>(now - lastReport).count());
+            lastReport = now;
+            for (auto it = connections.begin(); it != connections.end();) {
+                if ((*it)->finished) {
+                    printf("closed #%d %s after %.1f MB\n", (*it)->id, (*it)->Key().c_str(), (*it)->bytes / 1048576.0);
+                    CloseSocket((*it)->socket);
+                    it = connections.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Read side of the shared-memory stats segment, shared by the tools.
+
+#include "../src/stats-shm-layout.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+struct RecordCopy {
+    uint32_t state;
+    char id[sizeof(StatsShmRecord::id)];
+    char name[sizeof(StatsShmRecord::name)];
+    uint64_t totalBytes;
+    uint64_t droppedFrames;
+    uint64_t reconnects;
+    uint64_t bitsPerSec;
+    uint64_t framesPerSecMilli;
+    uint32_t congestionMicro;
+    uint32_t flags;
+    int64_t downtimeMs;
+    int64_t maxReconnectMs;
+    uint64_t sendQueuePeak;
+    int64_t updatedUsec;
+};
+
+// A consistent copy of the record, or false after too many concurrent writes.
+inline bool ReadRecord(const StatsShmRecord& record, RecordCopy& out)
+{
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        auto before = record.seq.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        out.state = record.state.load(std::memory_order_relaxed);
+        memcpy(out.id, record.id, sizeof(out.id));
+        memcpy(out.name, record.name, sizeof(out.name));
+        out.totalBytes = record.totalBytes.load(std::memory_order_relaxed);
+        out.droppedFrames = record.droppedFrames.load(std::memory_order_relaxed);
+        out.reconnects = record.reconnects.load(std::memory_order_relaxed);
+        out.bitsPerSec = record.bitsPerSec.load(std::memory_order_relaxed);
+        out.framesPerSecMilli = record.framesPerSecMilli.load(std::memory_order_relaxed);
+        out.congestionMicro = record.congestionMicro.load(std::memory_order_relaxed);
+        out.flags = record.flags.load(std::memory_order_relaxed);
+        out.downtimeMs = record.downtimeMs.load(std::memory_order_relaxed);
+        out.maxReconnectMs = record.maxReconnectMs.load(std::memory_order_relaxed);
+        out.sendQueuePeak = record.sendQueuePeak.load(std::memory_order_relaxed);
+        out.updatedUsec = record.updatedUsec.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.seq.load(std::memory_order_relaxed) == before) {
+            out.id[sizeof(out.id) - 1] = 0;
+            out.name[sizeof(out.name) - 1] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline const StatsShmSegment* MapSegment()
+{
+#ifdef _WIN32
+    auto mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, STATS_SHM_WIN32_NAME);
+    if (!mapping)
+        return nullptr;
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(StatsShmSegment));
+    CloseHandle(mapping);
+    return static_cast<const StatsShmSegment*>(view);
+#else
+    int fd = shm_open(STATS_SHM_POSIX_NAME, O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+    auto view = mmap(nullptr, sizeof(StatsShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return view == MAP_FAILED ? nullptr : static_cast<const StatsShmSegment*>(view);
+#endif
+}
+
+// Complains on stderr when the segment is missing or from another version.
+inline bool SegmentUsable(const StatsShmSegment& segment)
+{
+    auto& header = segment.header;
+    if (header.magic.load(std::memory_order_acquire) != kStatsShmMagic) {
+        fprintf(stderr, "the segment is not published (plugin stopped or publishing disabled)\n");
+        return false;
+    }
+    if (header.version != kStatsShmVersion || header.recordSize != sizeof(StatsShmRecord)) {
+        fprintf(stderr, "segment version %u does not match this reader (%u)\n", header.version, kStatsShmVersion);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+// Prints the per-target stats that obs-multi-rtmp publishes in shared memory.
+//
+//   multi-rtmp-stats [--once] [interval-ms]
+//
+// Enable "Publish stats in shared memory" in the dock's context menu first.
+
+#include "shm-reader.h"
+
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+static const char* StateName(uint32_t state)
+{
+    switch (state) {
+    case StatsShmStopped: return "stopped";
+    case StatsShmRunning: return "running";
+    case StatsShmReconnecting: return "reconnecting";
+    default: return "?";
+    }
+}
+
+static bool Print(const StatsShmSegment& segment)
+{
+    if (!SegmentUsable(segment))
+        return false;
+    auto& header = segment.header;
+
+    printf("%-24s %-12s %10s %8s %8s %6s %6s %10s\n", "target", "state", "kbps", "fps", "dropped", "recon", "cong%", "down s");
+    auto used = std::min(header.used.load(std::memory_order_acquire), kStatsShmCapacity);
+    for (uint32_t i = 0; i < used; ++i) {
+        RecordCopy copy;
+        if (!ReadRecord(segment.records[i], copy) || copy.state == StatsShmFree)
+            continue;
+        auto label = std::string(copy.name[0] ? copy.name : copy.id).substr(0, 24);
+        printf("%-24s %-12s %10.0f %8.2f %8llu %6llu %6.1f %10.1f\n", label.c_str(), StateName(copy.state),
+            copy.bitsPerSec / 1000.0, copy.framesPerSecMilli / 1000.0, (unsigned long long)copy.droppedFrames,
+            (unsigned long long)copy.reconnects, copy.congestionMicro / 10000.0, copy.downtimeMs / 1000.0);
+    }
+    printf("\n");
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool once = false;
+    int intervalMs = 1000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--once") == 0)
+            once = true;
+        else if (atoi(argv[i]) > 0)
+            intervalMs = atoi(argv[i]);
+        else {
+            fprintf(stderr, "usage: %s [--once] [interval-ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    auto segment = MapSegment();
+    if (!segment) {
+        fprintf(stderr, "cannot open the obs-multi-rtmp stats segment\n");
+        return 1;
+    }
+
+    for (;;) {
+        if (!Print(*segment))
+            return 1;
+        if (once)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}